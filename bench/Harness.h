@@ -0,0 +1,248 @@
+#pragma once
+
+/*
+ * A small benchmark harness for `engine_bench`, modelled on Google Benchmark:
+ *
+ *      Harness::add("ObjParser/1k tris", [](Harness::State* state){
+ *          const std::string path = writeMesh(1000); // Not timed
+ *          while (state->keepRunning())
+ *              parse(path);
+ *          state->setItemsProcessed(state->getIterations()*1000);
+ *      });
+ *      return Harness::runAll(argc, argv);
+ *
+ * Every case is run with a growing iteration count until a run takes at least
+ * the minimum time, then the time per iteration of that run is reported.
+ */
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+// A case is run until one run of it takes at least this long
+#define HARNESS_DEF_MIN_TIME_SEC 0.5
+// Upper limit of the iterations of a run, for cases that the compiler optimized away
+#define HARNESS_MAX_ITERATIONS 1'000'000'000ull
+// A run also ends the case when it took this many times the minimum time including
+// the paused parts, so cases with an expensive untimed setup per iteration finish
+#define HARNESS_MAX_WALL_TIME_FACTOR 5
+
+namespace Harness
+{
+
+// Keeps the compiler from dropping the computation of `value`
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State final
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+private:
+    uint64_t m_iterations{};
+    uint64_t m_doneIterations{};
+    bool m_isTiming{};
+    clock_t::time_point m_startTime;
+    clock_t::duration m_elapsed{};
+    uint64_t m_itemsProcessed{};
+    std::string m_label;
+    // Set by `skip()`, the case is reported with this instead of the results
+    std::string m_skipReason;
+
+public:
+    explicit State(uint64_t iterations)
+        : m_iterations{iterations}
+    {
+    }
+
+    // Copy ctor, copy assignment op
+    State(const State&) = delete;
+    State& operator=(const State&) = delete;
+    // Move ctor, move assignment op
+    State(State&&) = delete;
+    State& operator=(State&&) = delete;
+
+    /*
+     * The timed loop, the code before the first call is not timed:
+     *      while (state->keepRunning()) { ... }
+     */
+    inline bool keepRunning()
+    {
+        if (m_doneIterations == 0 && !m_isTiming)
+            resumeTiming();
+        if (m_doneIterations < m_iterations)
+        {
+            ++m_doneIterations;
+            return true;
+        }
+        pauseTiming();
+        return false;
+    }
+
+    // Excludes the code until `resumeTiming()`, e.g. the setup of an iteration
+    inline void pauseTiming()
+    {
+        if (!m_isTiming)
+            return;
+        m_elapsed += clock_t::now()-m_startTime;
+        m_isTiming = false;
+    }
+    inline void resumeTiming()
+    {
+        m_startTime = clock_t::now();
+        m_isTiming = true;
+    }
+
+    // Marks the case as not runnable, e.g. because an asset is missing
+    inline void skip(const std::string& reason) { m_skipReason = reason; m_iterations = 0; }
+
+    inline uint64_t getIterations() const { return m_iterations; }
+    inline clock_t::duration getElapsed() const { return m_elapsed; }
+    // The number of items handled by the whole run, reported as a rate
+    inline void setItemsProcessed(uint64_t count) { m_itemsProcessed = count; }
+    inline uint64_t getItemsProcessed() const { return m_itemsProcessed; }
+    // Extra information shown after the results
+    inline void setLabel(const std::string& label) { m_label = label; }
+    inline const std::string& getLabel() const { return m_label; }
+    inline const std::string& getSkipReason() const { return m_skipReason; }
+};
+
+using benchFunc_t = std::function<void(State*)>;
+
+struct Case
+{
+    std::string name;
+    benchFunc_t func;
+};
+
+inline std::vector<Case>& getCases()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+inline void add(const std::string& name, benchFunc_t func)
+{
+    getCases().push_back({name, std::move(func)});
+}
+
+// E.g. "12.3 us"
+inline std::string formatDuration(double ns)
+{
+    std::ostringstream output;
+    output << std::fixed << std::setprecision(ns < 10 ? 2 : 1);
+    if (ns < 1e3)       output << ns << " ns";
+    else if (ns < 1e6)  output << ns/1e3 << " us";
+    else if (ns < 1e9)  output << ns/1e6 << " ms";
+    else                output << ns/1e9 << " s";
+    return output.str();
+}
+
+// E.g. "1.5M/s"
+inline std::string formatRate(double perSec)
+{
+    std::ostringstream output;
+    output << std::fixed << std::setprecision(1);
+    if (perSec < 1e3)       output << perSec << "/s";
+    else if (perSec < 1e6)  output << perSec/1e3 << "k/s";
+    else if (perSec < 1e9)  output << perSec/1e6 << "M/s";
+    else                    output << perSec/1e9 << "G/s";
+    return output.str();
+}
+
+/*
+ * Runs the cases whose name contains the filter and prints a line for each.
+ *
+ * Usage: <program> [filter] [--min-time <seconds>]
+ *
+ * Returns: The exit code of the program
+ */
+inline int runAll(int argc, char** argv)
+{
+    std::string filter;
+    double minTimeSec = HARNESS_DEF_MIN_TIME_SEC;
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--min-time" && i+1 < argc)
+        {
+            minTimeSec = std::atof(argv[++i]);
+        }
+        else if (arg.starts_with("--"))
+        {
+            std::cerr << "Usage: " << argv[0] << " [filter] [--min-time <seconds>]\n";
+            return 1;
+        }
+        else
+        {
+            filter = arg;
+        }
+    }
+
+    std::cout << std::left << std::setw(58) << "Case" << std::right
+        << std::setw(12) << "Iterations"
+        << std::setw(14) << "Time/iter"
+        << std::setw(12) << "Items" << "  Info\n";
+
+    size_t runCount{};
+    for (const Case& benchCase : getCases())
+    {
+        if (benchCase.name.find(filter) == std::string::npos)
+            continue;
+        ++runCount;
+
+        uint64_t iterations{1};
+        while (true)
+        {
+            State state{iterations};
+            const auto runStart = State::clock_t::now();
+            benchCase.func(&state);
+            const double wallSec = std::chrono::duration<double>(State::clock_t::now()-runStart).count();
+            if (!state.getSkipReason().empty())
+            {
+                std::cout << std::left << std::setw(58) << benchCase.name
+                    << "skipped: " << state.getSkipReason() << std::endl;
+                break;
+            }
+
+            const double elapsedSec = std::chrono::duration<double>(state.getElapsed()).count();
+            if (elapsedSec >= minTimeSec || iterations >= HARNESS_MAX_ITERATIONS
+             || wallSec >= minTimeSec*HARNESS_MAX_WALL_TIME_FACTOR)
+            {
+                std::cout << std::left << std::setw(58) << benchCase.name << std::right
+                    << std::setw(12) << iterations
+                    << std::setw(14) << formatDuration(elapsedSec*1e9/iterations)
+                    << std::setw(12) << (state.getItemsProcessed()
+                            ? formatRate(state.getItemsProcessed()/elapsedSec) : std::string{"-"})
+                    << "  " << state.getLabel() << std::endl;
+                break;
+            }
+
+            // Aim a bit above the minimum time, so the next run is likely the last one
+            const double scaledSec = std::max(elapsedSec, wallSec/HARNESS_MAX_WALL_TIME_FACTOR);
+            const double multiplier = (scaledSec > 0 ? minTimeSec*1.4/scaledSec : 100);
+            iterations = std::min<uint64_t>(HARNESS_MAX_ITERATIONS,
+                    iterations*std::clamp(multiplier, 2.0, 100.0));
+        }
+    }
+
+    if (runCount == 0)
+    {
+        std::cerr << "No case matches \"" << filter << "\"\n";
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace Harness
@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * Generated maps for the benchmarks that load maps, `map_bench` and `engine_bench`.
+ */
+
+#include <fstream>
+#include <string>
+#include <cstddef>
+
+namespace MapGen
+{
+
+/*
+ * Writes a JSON map of `objectCount` objects. The objects use 50 models and
+ * 20 textures, and have box, sphere and cylinder collision shapes in turn.
+ * The assets don't have to exist, only the descriptors are loaded.
+ */
+inline void writeJsonMap(const std::string& path, size_t objectCount)
+{
+    static constexpr const char* shapes[] = {
+        R"("collShape": {"type": "box", "size": {"x": 1.0, "y": 0.5, "z": 1.0}})",
+        R"("collShape": {"type": "sphere", "radius": 0.5})",
+        R"("collShape": {"type": "cylinder", "radius": 0.5, "height": 2.0})",
+    };
+
+    std::ofstream file{path};
+    file << "{\n\"name\": \"Bench\",\n\"mapFormatVer\": {\"major\": 1, \"minor\": 0},\n\"objects\": [\n";
+    for (size_t i{}; i < objectCount; ++i)
+    {
+        file << "{\"name\": \"Object " << i << "\", "
+            << "\"modelName\": \"model_" << i%50 << ".obj\", "
+            << "\"textureName\": \"textures/texture_" << i%20 << ".png\", "
+            << "\"pos\": {\"x\": " << (i%1000)*2.0 << ", \"y\": " << (i/1000)*0.5 << ", \"z\": " << (i%7)*3.0 << "}, "
+            << "\"scale\": {\"x\": 1.0, \"y\": 1.0, \"z\": 1.0}, "
+            << shapes[i%3] << ", \"mass\": " << (i%4 == 0 ? 0.0 : 1.0) << '}'
+            << (i+1 < objectCount ? ",\n" : "\n");
+    }
+    file << "]\n}\n";
+}
+
+} // namespace MapGen
@@ -0,0 +1,359 @@
+/*
+ * Micro-benchmarks of the CPU hot paths of the engine, linked against the
+ * engine library. Both are built with -O2, like the other benchmarks.
+ *
+ * The physics, file cache and overlay cases need an OpenGL context,
+ * they are skipped if no hidden window can be created.
+ *
+ * Usage: engine_bench [filter] [--min-time <seconds>]
+ *      Only the cases whose name contains the filter are run.
+ */
+
+#include "Harness.h"
+#include "MapGen.h"
+#include "../src/init.h"
+#include "../src/Logger.h"
+#include "../src/Model.h"
+#include "../src/GameMap.h"
+#include "../src/GameObject.h"
+#include "../src/PhysicsWorld.h"
+#include "../src/FileCache.h"
+#include "../src/assets.h"
+#include "../src/ui/OverlayRenderer.h"
+#include <GL/glew.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+
+/*
+ * Writes a flat grid of `quadsPerSide`*`quadsPerSide` quads, as triangles
+ * with positions, UVs and a shared normal.
+ *
+ * Returns: The number of triangles
+ */
+static size_t writeGridObj(const std::string& path, size_t quadsPerSide)
+{
+    std::ofstream file{path};
+    const size_t side = quadsPerSide+1;
+    for (size_t z{}; z < side; ++z)
+    {
+        for (size_t x{}; x < side; ++x)
+            file << "v " << x*0.1f << " 0 " << z*0.1f << '\n';
+    }
+    for (size_t z{}; z < side; ++z)
+    {
+        for (size_t x{}; x < side; ++x)
+            file << "vt " << float(x)/quadsPerSide << ' ' << float(z)/quadsPerSide << '\n';
+    }
+    file << "vn 0 1 0\n";
+    for (size_t z{}; z < quadsPerSide; ++z)
+    {
+        for (size_t x{}; x < quadsPerSide; ++x)
+        {
+            // OBJ indices start at 1
+            const size_t i0 = z*side+x+1;
+            const size_t i1 = i0+1;
+            const size_t i2 = i0+side;
+            const size_t i3 = i2+1;
+            file << "f " << i0 << '/' << i0 << "/1 " << i2 << '/' << i2 << "/1 " << i1 << '/' << i1 << "/1\n";
+            file << "f " << i1 << '/' << i1 << "/1 " << i2 << '/' << i2 << "/1 " << i3 << '/' << i3 << "/1\n";
+        }
+    }
+    return quadsPerSide*quadsPerSide*2;
+}
+
+static void addObjParseCases(const std::filesystem::path& dir)
+{
+    for (size_t quadsPerSide : {16, 64, 256, 512})
+    {
+        const std::string path = (dir/("grid_"+std::to_string(quadsPerSide)+".obj")).string();
+        const size_t triCount = writeGridObj(path, quadsPerSide);
+        Harness::add("Model::parseObjFile/"+std::to_string(triCount)+" tris", [path, triCount](Harness::State* state){
+            Model model;
+            while (state->keepRunning())
+            {
+                ObjParser::Mesh mesh;
+                if (model.parseObjFile(path, &mesh))
+                {
+                    state->skip("Failed to parse "+path);
+                    return;
+                }
+                Harness::doNotOptimize(mesh.indices.data());
+            }
+            state->setItemsProcessed(state->getIterations()*triCount);
+            state->setLabel(std::to_string(std::filesystem::file_size(path)/1024)+" KiB");
+        });
+    }
+}
+
+static void addMapLoadCases(const std::filesystem::path& dir)
+{
+    for (size_t objectCount : {1'000, 10'000, 50'000})
+    {
+        const std::string path = (dir/("map_"+std::to_string(objectCount)+".json")).string();
+        MapGen::writeJsonMap(path, objectCount);
+        Harness::add("GameMap/json/"+std::to_string(objectCount)+" objects", [path, objectCount](Harness::State* state){
+            while (state->keepRunning())
+            {
+                // On the calling thread, without the binary version
+                const GameMap map{path, nullptr, false};
+                Harness::doNotOptimize(map.getTimings());
+            }
+            state->setItemsProcessed(state->getIterations()*objectCount);
+        });
+    }
+}
+
+/*
+ * movedEvery: Every this many objects are moved before an update
+ */
+static void addTransformCase(size_t objectCount, size_t movedEvery)
+{
+    const std::string name = "GameObject::updateTransforms/"+std::to_string(objectCount)+" objects, "
+        +(movedEvery == 1 ? std::string{"all"} : "1/"+std::to_string(movedEvery))+" moved";
+    Harness::add(name, [objectCount, movedEvery](Harness::State* state){
+        std::vector<std::unique_ptr<GameObject>> objects;
+        objects.reserve(objectCount);
+        for (size_t i{}; i < objectCount; ++i)
+        {
+            objects.push_back(std::make_unique<GameObject>(
+                    nullptr, glm::vec3{}, nullptr, nullptr, GameObject::MASS_STATIC));
+            objects.back()->setPos({(i%100)*2.0f, 0.0f, (i/100)*2.0f});
+            objects.back()->rotate(i*0.01f, {0.0f, 1.0f, 0.0f});
+        }
+        GameObject::updateTransforms();
+
+        size_t frame{};
+        while (state->keepRunning())
+        {
+            // Like the physics writing back the moved bodies
+            state->pauseTiming();
+            for (size_t i{frame%movedEvery}; i < objectCount; i += movedEvery)
+                objects[i]->translate({0.0f, 0.01f, 0.0f});
+            ++frame;
+            state->resumeTiming();
+
+            Harness::doNotOptimize(GameObject::updateTransforms());
+        }
+        state->setItemsProcessed(state->getIterations()*((objectCount+movedEvery-1)/movedEvery));
+    });
+}
+
+/*
+ * Columns of `stackHeight` boxes on a static floor.
+ * The bodies are kept awake, so every step simulates all of them.
+ */
+static void addPhysicsCase(size_t boxCount, size_t stackHeight)
+{
+    Harness::add("PhysicsWorld::stepTo/"+std::to_string(boxCount)+" boxes", [boxCount, stackHeight](Harness::State* state){
+        PhysicsWorld pworld;
+
+        std::vector<std::unique_ptr<GameObject>> objects;
+        objects.push_back(std::make_unique<GameObject>(
+                nullptr, glm::vec3{}, nullptr,
+                std::make_shared<btBoxShape>(btVector3{100.0f, 0.5f, 100.0f}), GameObject::MASS_STATIC));
+        objects.back()->setPos({0.0f, -0.5f, 0.0f});
+        const auto boxShape = std::make_shared<btBoxShape>(btVector3{0.5f, 0.5f, 0.5f});
+        const size_t columnCount = (boxCount+stackHeight-1)/stackHeight;
+        const size_t columnsPerRow = std::max<size_t>(1, std::sqrt(columnCount));
+        for (size_t i{}; i < boxCount; ++i)
+        {
+            const size_t column = i/stackHeight;
+            objects.push_back(std::make_unique<GameObject>(nullptr, glm::vec3{}, nullptr, boxShape, 1.0f));
+            objects.back()->setPos({
+                    (column%columnsPerRow)*2.0f, 0.5f+(i%stackHeight)*1.01f, (column/columnsPerRow)*2.0f});
+        }
+        std::vector<GameObject*> objectPtrs;
+        for (const auto& object : objects)
+            objectPtrs.push_back(object.get());
+        pworld.addObjects(objectPtrs);
+        {
+            auto lock = pworld.lockWorld();
+            for (size_t i{}; i < pworld.getObjectCount(); ++i)
+            {
+                btCollisionObject* obj = pworld.getObj(i);
+                if (!obj->isStaticObject())
+                    obj->setActivationState(DISABLE_DEACTIVATION);
+            }
+        }
+
+        const auto step = std::chrono::duration_cast<PhysicsWorld::clock_t::duration>(
+                std::chrono::duration<double>{PHYS_FIXED_TIMESTEP});
+        PhysicsWorld::clock_t::time_point simTime{};
+        pworld.startManual(simTime);
+        // Let the stacks settle, the first contacts are more expensive
+        for (int i{}; i < 30; ++i)
+            pworld.stepTo(simTime += step);
+
+        while (state->keepRunning())
+            pworld.stepTo(simTime += step);
+        state->setItemsProcessed(state->getIterations());
+        state->setLabel(std::to_string(pworld.getLastMovedCount())+" moved in the last step");
+
+        pworld.removeObjects(objectPtrs);
+    });
+}
+
+static constexpr auto modelAssetDir = ASSET_DIR_MODELS;
+static constexpr auto noPlaceholderFilename = std::string_view{};
+using modelCache_t = FileCache<Model, modelAssetDir, noPlaceholderFilename>;
+
+static void addFileCacheCases()
+{
+    // A few of the models of the engine, these have compiled meshes after the first load
+    static const std::vector<std::string> modelNames{"cube.obj", "plane.obj", "ico_sphere.obj", "monkey.obj"};
+    auto findMissingModel{[](){
+        for (const std::string& name : modelNames)
+        {
+            if (!std::filesystem::exists(std::string(modelAssetDir)+"/"+name))
+                return name;
+        }
+        return std::string{};
+    }};
+
+    Harness::add("FileCache<Model>::open/hit", [findMissingModel](Harness::State* state){
+        if (const std::string missing = findMissingModel(); !missing.empty())
+        {
+            state->skip("Missing model: "+missing);
+            return;
+        }
+        modelCache_t cache;
+        for (const std::string& name : modelNames)
+            cache.open(name);
+
+        size_t i{};
+        while (state->keepRunning())
+            Harness::doNotOptimize(cache.open(modelNames[i++%modelNames.size()]));
+        state->setItemsProcessed(state->getIterations());
+    });
+
+    Harness::add("FileCache<Model>::open/miss, monkey.obj", [findMissingModel](Harness::State* state){
+        if (const std::string missing = findMissingModel(); !missing.empty())
+        {
+            state->skip("Missing model: "+missing);
+            return;
+        }
+        while (state->keepRunning())
+        {
+            state->pauseTiming();
+            auto cache = std::make_unique<modelCache_t>();
+            state->resumeTiming();
+
+            // Maps the compiled mesh and uploads it
+            Harness::doNotOptimize(cache->open("monkey.obj"));
+
+            state->pauseTiming();
+            cache.reset();
+            state->resumeTiming();
+        }
+        state->setItemsProcessed(state->getIterations());
+    });
+}
+
+/*
+ * Queueing the text and rectangle commands, and `commit()` which turns them into
+ * vertex batches and draws them. The GPU work is finished outside the timed parts.
+ */
+static void addOverlayCases(UI::OverlayRenderer* renderer)
+{
+    static constexpr size_t textCount = 100;
+    static constexpr size_t rectCount = 20;
+    auto queueCommands{[renderer](){
+        static const std::string text = "Frame time:   16ms\nObjs drawn:   1234";
+        for (size_t i{}; i < textCount; ++i)
+        {
+            renderer->renderTextAtPx(text, 1.0f, {10+(int)(i%10)*100, 900-(int)(i/10)*40});
+            if (i%(textCount/rectCount) == 0)
+                renderer->drawFilledRectangle({1.0f, 1.0f+i*0.5f}, {5.0f, 0.4f}, {0.2f, 0.2f, 0.2f});
+        }
+    }};
+    const std::string label = std::to_string(textCount)+" texts, "+std::to_string(rectCount)+" rects";
+
+    Harness::add("OverlayRenderer/queue commands", [renderer, queueCommands, label](Harness::State* state){
+        while (state->keepRunning())
+        {
+            queueCommands();
+
+            state->pauseTiming();
+            renderer->commit();
+            glFinish();
+            state->resumeTiming();
+        }
+        state->setItemsProcessed(state->getIterations()*(textCount+rectCount));
+        state->setLabel(label);
+    });
+
+    Harness::add("OverlayRenderer/commit", [renderer, queueCommands, label](Harness::State* state){
+        while (state->keepRunning())
+        {
+            state->pauseTiming();
+            queueCommands();
+            glFinish();
+            state->resumeTiming();
+
+            renderer->commit();
+        }
+        state->setItemsProcessed(state->getIterations()*(textCount+rectCount));
+        state->setLabel(label+", "+std::to_string(renderer->getDrawCallsLastCommit())+" draw calls");
+    });
+}
+
+int main(int argc, char** argv)
+{
+#ifndef __OPTIMIZE__
+    std::cerr << "Warning: Built without optimization, the results don't reflect a release build\n";
+#endif
+    // The misses of the file cache would log every load
+    Logger::setMinLevel(Logger::Type::Warning);
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path()/"engine_bench";
+    std::filesystem::create_directories(dir);
+
+    addObjParseCases(dir);
+    addMapLoadCases(dir);
+    addTransformCase(1'000, 1);
+    addTransformCase(10'000, 1);
+    addTransformCase(100'000, 1);
+    addTransformCase(100'000, 100);
+
+    SDL_Window* window;
+    SDL_GLContext context;
+    bool isVSyncActive;
+    const bool hasGl = !Init::initVideo(&window, &context, &isVSyncActive, true);
+    std::unique_ptr<UI::OverlayRenderer> overlayRenderer;
+    if (hasGl)
+    {
+        addPhysicsCase(64, 8);
+        addPhysicsCase(256, 8);
+        addPhysicsCase(1024, 8);
+        addFileCacheCases();
+
+        int winW, winH;
+        SDL_GetWindowSize(window, &winW, &winH);
+        overlayRenderer = std::make_unique<UI::OverlayRenderer>();
+        if (overlayRenderer->construct("../assets/crosshair.obj"))
+            return 1;
+        overlayRenderer->setWindowSize(winW, winH);
+        addOverlayCases(overlayRenderer.get());
+    }
+    else
+    {
+        Logger::warn << "No OpenGL context, skipping the physics, file cache and overlay cases" << Logger::End;
+    }
+
+    const int exitCode = Harness::runAll(argc, argv);
+
+    std::filesystem::remove_all(dir);
+    if (hasGl)
+    {
+        overlayRenderer.reset();
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    return exitCode;
+}
@@ -0,0 +1,81 @@
+/*
+ * Compares loading generated maps from JSON and from the binary map format,
+ * on the calling thread and on a thread pool. Only the descriptors are
+ * loaded, the collision shapes and assets are not built.
+ *
+ * Usage: map_bench [iterations]
+ */
+
+#include "MapGen.h"
+#include "../src/GameMap.h"
+#include "../src/ThreadPool.h"
+#include "../src/Logger.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+struct Result
+{
+    double totalMs{};
+    GameMap::LoadTimings timings;
+};
+
+static Result measure(const std::string& path, ThreadPool* pool, int iterations)
+{
+    Result result;
+    for (int i{}; i < iterations; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const GameMap map{path, pool, false};
+        result.totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+        result.timings = map.getTimings();
+    }
+    result.totalMs /= iterations;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = (argc > 1 ? std::stoi(argv[1]) : 3);
+    const std::filesystem::path dir = std::filesystem::temp_directory_path()/"map_bench";
+    std::filesystem::create_directories(dir);
+    ThreadPool pool;
+
+    std::cout << std::left << std::setw(10) << "Objects" << std::setw(10) << "Format" << std::setw(10) << "Threads"
+        << std::right << std::setw(12) << "Size KiB" << std::setw(12) << "Read ms" << std::setw(12) << "Parse ms"
+        << std::setw(12) << "Objects ms" << std::setw(12) << "Total ms" << '\n';
+
+    for (size_t objectCount : {10'000, 50'000, 200'000})
+    {
+        const std::string jsonPath = (dir/("map_"+std::to_string(objectCount)+".json")).string();
+        const std::string binaryPath = BinaryMap::getBakedPath(jsonPath);
+        MapGen::writeJsonMap(jsonPath, objectCount);
+        {
+            const GameMap map{jsonPath, &pool, false};
+            if (map.writeBinary(binaryPath))
+                return 1;
+        }
+
+        for (const std::string& path : {jsonPath, binaryPath})
+        {
+            for (ThreadPool* usedPool : {(ThreadPool*)nullptr, &pool})
+            {
+                const Result result = measure(path, usedPool, iterations);
+                std::cout << std::left << std::setw(10) << objectCount
+                    << std::setw(10) << std::filesystem::path{path}.extension().string()
+                    << std::setw(10) << (usedPool ? usedPool->getThreadCount() : 1)
+                    << std::right << std::fixed << std::setprecision(2)
+                    << std::setw(12) << std::filesystem::file_size(path)/1024
+                    << std::setw(12) << result.timings.readMs
+                    << std::setw(12) << result.timings.parseMs
+                    << std::setw(12) << result.timings.objectsMs
+                    << std::setw(12) << result.totalMs << '\n';
+            }
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
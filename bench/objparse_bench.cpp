@@ -0,0 +1,246 @@
+/*
+ * Compares the throughput of the old `std::stringstream`/`std::stof` based
+ * OBJ parser with `ObjParser` on the models in the model asset folder.
+ *
+ * Usage: objparse_bench [model folder]
+ */
+
+#include "../src/ObjParser.h"
+#include "../src/MappedFile.h"
+#include "../src/Logger.h"
+#include "../src/assets.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Minimum time to spend on each parser per model, to get stable numbers
+#define MIN_BENCH_TIME_SEC 0.5
+
+// The parser that was used by `Model::parseObjFile()` before `ObjParser`, kept for comparison
+static int legacyParseObj(
+        const std::string& filePath,
+        std::vector<float>* outVerts,
+        std::vector<float>* outUvs,
+        std::vector<float>* outNorms
+        )
+{
+    std::string fileContents;
+    {
+        std::ifstream fileObject{filePath};
+        if (!fileObject.is_open())
+            return 1;
+        std::stringstream sstream;
+        sstream << fileObject.rdbuf();
+        fileContents = sstream.str();
+    }
+
+    std::vector<float> verticesTmp;
+    std::vector<float> uvCoordsTmp;
+    std::vector<float> normalsTmp;
+
+    for (size_t i{}; i < fileContents.size();)
+    {
+        std::string token;
+
+        if (fileContents[i] == '#')
+        {
+            while (i < fileContents.size() && fileContents[i] != '\n')
+                ++i;
+        }
+
+        auto getToken{
+            [&](){
+                token.clear();
+                while (i < fileContents.size() && !std::isspace((unsigned char)fileContents[i]))
+                    token += fileContents[i++];
+                while (i < fileContents.size() && (fileContents[i] == ' ' || fileContents[i] == '\t'))
+                    ++i;
+            }
+        };
+
+        auto tokenToFloat{
+            [&](){
+                try
+                {
+                    return std::stof(token.c_str(), nullptr);
+                }
+                catch (...)
+                {
+                    return 0.0f;
+                }
+            }
+        };
+
+        getToken();
+
+        if (token.compare("v") == 0)
+        {
+            for (int j{}; j < 3; ++j)
+            {
+                getToken();
+                verticesTmp.push_back(tokenToFloat());
+            }
+        }
+        else if (token.compare("vt") == 0)
+        {
+            for (int j{}; j < 2; ++j)
+            {
+                getToken();
+                uvCoordsTmp.push_back(tokenToFloat());
+            }
+        }
+        else if (token.compare("vn") == 0)
+        {
+            for (int j{}; j < 3; ++j)
+            {
+                getToken();
+                normalsTmp.push_back(tokenToFloat());
+            }
+        }
+        else if (token.compare("f") == 0)
+        {
+            for (int j{}; j < 3; ++j)
+            {
+                getToken();
+                size_t vertexI, uvCoordI, normalI;
+                size_t numOfProcessed;
+
+                try
+                {
+                    vertexI = std::stoul(token.c_str(), &numOfProcessed);
+                    token = token.substr(numOfProcessed+1);
+                    uvCoordI = std::stoul(token.c_str(), &numOfProcessed);
+                    token = token.substr(numOfProcessed+1);
+                    normalI = std::stoul(token.c_str(), &numOfProcessed);
+                }
+                catch (...)
+                {
+                    return 1;
+                }
+
+                if (vertexI  < 1 || vertexI  > verticesTmp.size()
+                 || uvCoordI < 1 || uvCoordI > uvCoordsTmp.size()
+                 || normalI  < 1 || normalI  > normalsTmp.size())
+                    return 1;
+
+                outVerts->push_back(verticesTmp[(vertexI-1)*3+0]);
+                outVerts->push_back(verticesTmp[(vertexI-1)*3+1]);
+                outVerts->push_back(verticesTmp[(vertexI-1)*3+2]);
+                outUvs->push_back(uvCoordsTmp[(uvCoordI-1)*2+0]);
+                outUvs->push_back(uvCoordsTmp[(uvCoordI-1)*2+1]);
+                outNorms->push_back(normalsTmp[(normalI-1)*3+0]);
+                outNorms->push_back(normalsTmp[(normalI-1)*3+1]);
+                outNorms->push_back(normalsTmp[(normalI-1)*3+2]);
+            }
+            getToken();
+            if (token.size())
+                return 1;
+        }
+
+        while (i < fileContents.size() && fileContents[i] != '\n')
+            ++i;
+        ++i;
+    }
+
+    return 0;
+}
+
+static int newParseObj(const std::string& filePath, size_t* outCornerCount)
+{
+    MappedFile file;
+    if (file.open(filePath))
+        return 1;
+    ObjParser::Mesh mesh;
+    if (ObjParser::parse(file.view(), &mesh) != ObjParser::Status::Ok)
+        return 1;
+    *outCornerCount = mesh.getIndexCount();
+    return 0;
+}
+
+static int oldParseObj(const std::string& filePath, size_t* outCornerCount)
+{
+    std::vector<float> verts, uvs, norms;
+    if (legacyParseObj(filePath, &verts, &uvs, &norms))
+        return 1;
+    *outCornerCount = verts.size()/3;
+    return 0;
+}
+
+/*
+ * Runs `parser` on the file repeatedly.
+ *
+ * Returns: The throughput in MB/s, or a negative number if the parser failed
+ */
+template <typename Parser>
+static double measureMBps(Parser parser, const std::string& filePath, size_t fileSize, size_t* outCornerCount)
+{
+    using clock_t = std::chrono::steady_clock;
+
+    size_t iterations{};
+    const auto start = clock_t::now();
+    double elapsedSec{};
+    do
+    {
+        if (parser(filePath, outCornerCount))
+            return -1;
+        ++iterations;
+        elapsedSec = std::chrono::duration<double>(clock_t::now()-start).count();
+    } while (elapsedSec < MIN_BENCH_TIME_SEC);
+
+    return (double)fileSize*iterations/elapsedSec/(1024.0*1024.0);
+}
+
+int main(int argc, char** argv)
+{
+    const std::string modelDir = (argc > 1 ? argv[1] : ASSET_DIR_MODELS);
+
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator{modelDir, ec})
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".obj")
+            files.push_back(entry.path());
+    }
+    if (ec || files.empty())
+    {
+        Logger::err << "No .obj files found in \"" << modelDir << '"' << Logger::End;
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    std::cout << std::left << std::setw(24) << "Model" << std::right
+        << std::setw(12) << "Size (KiB)"
+        << std::setw(12) << "Corners"
+        << std::setw(14) << "Old (MB/s)"
+        << std::setw(14) << "New (MB/s)"
+        << std::setw(10) << "Speedup" << '\n';
+
+    for (const auto& path : files)
+    {
+        const size_t fileSize = std::filesystem::file_size(path);
+        size_t oldCorners{}, newCorners{};
+        const double oldMBps = measureMBps(oldParseObj, path.string(), fileSize, &oldCorners);
+        const double newMBps = measureMBps(newParseObj, path.string(), fileSize, &newCorners);
+
+        std::cout << std::left << std::setw(24) << path.filename().string() << std::right
+            << std::setw(12) << fileSize/1024
+            << std::setw(12) << newCorners << std::fixed << std::setprecision(1);
+        if (oldMBps < 0) std::cout << std::setw(14) << "failed";
+        else             std::cout << std::setw(14) << oldMBps;
+        if (newMBps < 0) std::cout << std::setw(14) << "failed";
+        else             std::cout << std::setw(14) << newMBps;
+        if (oldMBps > 0 && newMBps > 0)
+            std::cout << std::setw(9) << newMBps/oldMBps << 'x';
+        std::cout << '\n';
+        if (oldMBps > 0 && newMBps > 0 && oldCorners != newCorners)
+            Logger::warn << "Parsers disagree on the face corner count of " << path.filename().string() << Logger::End;
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Measures the draw calls and the CPU time of `UI::OverlayRenderer::commit()`
+ * for overlay text. Before the glyph atlas, every glyph was a separate draw call.
+ *
+ * Usage: text_bench [iterations]
+ */
+
+#include "../src/init.h"
+#include "../src/Logger.h"
+#include "../src/ui/OverlayRenderer.h"
+#include <GL/glew.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+static std::string makeText(size_t glyphCount)
+{
+    static constexpr size_t lineLength = 50;
+    std::string text;
+    for (size_t i{}; i < glyphCount; ++i)
+    {
+        if (i != 0 && i % lineLength == 0)
+            text += '\n';
+        text += char('!'+i%('~'-'!'));
+    }
+    return text;
+}
+
+struct Result
+{
+    size_t glyphs{};
+    size_t drawCalls{};
+    double usPer1kGlyphs{};
+};
+
+/*
+ * commandCount: The text is split into this many commands
+ * withRects: Put a rectangle between the texts, which breaks the batches
+ */
+static Result measure(UI::OverlayRenderer* renderer, size_t glyphCount, size_t commandCount, bool withRects, int iterations)
+{
+    const std::string text = makeText(glyphCount/commandCount);
+    double totalSec{};
+    Result result;
+    for (int i{}; i < iterations; ++i)
+    {
+        for (size_t j{}; j < commandCount; ++j)
+        {
+            renderer->renderTextAtPx(text, 1.0f, {10, 900-(int)(j%50)*16});
+            if (withRects)
+                renderer->drawFilledRectangle({1.0f, 1.0f}, {5.0f, 5.0f}, {0.2f, 0.2f, 0.2f});
+        }
+
+        glFinish(); // Don't measure the previous iteration's GPU work
+        const auto start = std::chrono::steady_clock::now();
+        renderer->commit();
+        totalSec += std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        result.glyphs = renderer->getGlyphsLastCommit();
+        result.drawCalls = renderer->getDrawCallsLastCommit();
+    }
+    result.usPer1kGlyphs = totalSec/iterations*1e6/(result.glyphs/1000.0);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = (argc > 1 ? std::stoi(argv[1]) : 200);
+
+    SDL_Window* window;
+    SDL_GLContext context;
+    bool isVSyncActive;
+    if (Init::initVideo(&window, &context, &isVSyncActive))
+        return 1;
+
+    int winW, winH;
+    SDL_GetWindowSize(window, &winW, &winH);
+    {
+        UI::OverlayRenderer renderer;
+        if (renderer.construct("../assets/crosshair.obj"))
+            return 1;
+        renderer.setWindowSize(winW, winH);
+
+        std::cout << std::left << std::setw(34) << "Case" << std::right
+            << std::setw(10) << "Glyphs"
+            << std::setw(12) << "Draw calls"
+            << std::setw(16) << "us/1k glyphs" << '\n';
+
+        struct Case { const char* name; size_t glyphs; size_t commands; bool withRects; };
+        static constexpr Case cases[] = {
+            {"1 text, 1k glyphs",               1000,   1, false},
+            {"20 texts, 1k glyphs",             1000,  20, false},
+            {"200 texts, 10k glyphs",          10000, 200, false},
+            {"20 texts between rects, 1k",      1000,  20, true},
+        };
+        for (const Case& c : cases)
+        {
+            const Result result = measure(&renderer, c.glyphs, c.commands, c.withRects, iterations);
+            std::cout << std::left << std::setw(34) << c.name << std::right
+                << std::setw(10) << result.glyphs
+                << std::setw(12) << result.drawCalls
+                << std::setw(16) << std::fixed << std::setprecision(1) << result.usPer1kGlyphs << '\n';
+        }
+    }
+
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Compares the model matrix update of `TransformStore` with the way
+ * `GameObject::recalcModelMat()` used to do it: building a translation,
+ * a rotation, a model rotation and a scale matrix, and multiplying them,
+ * for every object stored next to the rest of its data.
+ *
+ * Usage: transform_bench [frames]
+ */
+
+#include "../src/TransformStore.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Mat4
+{
+    float m[16]; // Column-major
+
+    static Mat4 identity()
+    {
+        return {{1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1}};
+    }
+
+    Mat4 operator*(const Mat4& o) const
+    {
+        Mat4 r;
+        for (int c{}; c < 4; ++c)
+        {
+            for (int row{}; row < 4; ++row)
+            {
+                float sum{};
+                for (int k{}; k < 4; ++k)
+                    sum += m[k*4+row]*o.m[c*4+k];
+                r.m[c*4+row] = sum;
+            }
+        }
+        return r;
+    }
+};
+
+static Mat4 quatToMat(float x, float y, float z, float w)
+{
+    Mat4 r = Mat4::identity();
+    r.m[0] = 1-2*(y*y+z*z); r.m[1] = 2*(x*y+w*z);   r.m[2] = 2*(x*z-w*y);
+    r.m[4] = 2*(x*y-w*z);   r.m[5] = 1-2*(x*x+z*z); r.m[6] = 2*(y*z+w*x);
+    r.m[8] = 2*(x*z+w*y);   r.m[9] = 2*(y*z-w*x);   r.m[10] = 1-2*(x*x+y*y);
+    return r;
+}
+
+// Roughly the layout of the old `GameObject`, with the data around the transform
+struct LegacyObject
+{
+    void* model[2]; // shared_ptr
+    float mRot[4];
+    void* texture[2]; // shared_ptr
+    void* collShape;
+    float mass;
+    std::string name;
+    uint8_t flags;
+    float pos[3];
+    float rot[4];
+    float scale[3];
+    Mat4 modelMatrix;
+
+    void recalcModelMat()
+    {
+        Mat4 trans = Mat4::identity();
+        trans.m[12] = pos[0]; trans.m[13] = pos[1]; trans.m[14] = pos[2];
+        const Mat4 rotMat = quatToMat(rot[0], rot[1], rot[2], rot[3]);
+        const Mat4 mrotMat = quatToMat(mRot[0], mRot[1], mRot[2], mRot[3]);
+        Mat4 scaleMat = Mat4::identity();
+        scaleMat.m[0] = scale[0]; scaleMat.m[5] = scale[1]; scaleMat.m[10] = scale[2];
+        modelMatrix = trans * rotMat * mrotMat * scaleMat;
+    }
+};
+
+struct Input
+{
+    float pos[3];
+    float rot[4];
+    float scale[3];
+};
+
+static std::vector<Input> makeInputs(size_t count)
+{
+    std::mt19937 rng{1234};
+    std::uniform_real_distribution<float> dist{-1.0f, 1.0f};
+    std::vector<Input> inputs(count);
+    for (Input& input : inputs)
+    {
+        for (float& v : input.pos) v = dist(rng)*100;
+        float len{};
+        for (float& v : input.rot) { v = dist(rng); len += v*v; }
+        for (float& v : input.rot) v /= std::sqrt(len);
+        for (float& v : input.scale) v = 1+dist(rng)*0.5f;
+    }
+    return inputs;
+}
+
+template <typename F>
+static double measureMsPerFrame(int frames, F&& frame)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i{}; i < frames; ++i)
+        frame(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count()/frames;
+}
+
+int main(int argc, char** argv)
+{
+    const int frames = (argc > 1 ? std::stoi(argv[1]) : 20);
+
+    std::cout << "Group size: " << TransformStore::groupSize << '\n';
+    std::cout << std::left << std::setw(10) << "Count" << std::right
+        << std::setw(16) << "Legacy ms" << std::setw(16) << "Store ms"
+        << std::setw(16) << "Store 10% ms" << std::setw(12) << "Speedup"
+        << std::setw(12) << "Max error" << '\n';
+
+    for (size_t count : {100'000, 250'000, 500'000, 1'000'000})
+    {
+        const std::vector<Input> inputs = makeInputs(count);
+
+        std::vector<LegacyObject> legacy(count);
+        for (LegacyObject& obj : legacy)
+        {
+            obj.mRot[0] = 0; obj.mRot[1] = 0; obj.mRot[2] = 0; obj.mRot[3] = 1;
+        }
+        TransformStore store;
+        std::vector<TransformStore::handle_t> handles(count);
+        for (auto& handle : handles)
+            handle = store.create();
+
+        // Every object moves every frame
+        const double legacyMs = measureMsPerFrame(frames, [&](int frame){
+            const float offset = frame*0.01f;
+            for (size_t i{}; i < count; ++i)
+            {
+                const Input& in = inputs[i];
+                LegacyObject& obj = legacy[i];
+                obj.pos[0] = in.pos[0]+offset; obj.pos[1] = in.pos[1]; obj.pos[2] = in.pos[2];
+                obj.rot[0] = in.rot[0]; obj.rot[1] = in.rot[1]; obj.rot[2] = in.rot[2]; obj.rot[3] = in.rot[3];
+                obj.scale[0] = in.scale[0]; obj.scale[1] = in.scale[1]; obj.scale[2] = in.scale[2];
+                obj.recalcModelMat();
+            }
+        });
+
+        const double storeMs = measureMsPerFrame(frames, [&](int frame){
+            const float offset = frame*0.01f;
+            for (size_t i{}; i < count; ++i)
+            {
+                const Input& in = inputs[i];
+                store.setPosition(handles[i], in.pos[0]+offset, in.pos[1], in.pos[2]);
+                store.setRotation(handles[i], in.rot[0], in.rot[1], in.rot[2], in.rot[3]);
+                store.setScale(handles[i], in.scale[0], in.scale[1], in.scale[2]);
+            }
+            store.update();
+        });
+
+        // Every 10th object moves
+        const double sparseMs = measureMsPerFrame(frames, [&](int frame){
+            const float offset = frame*0.01f;
+            for (size_t i{}; i < count; i += 10)
+                store.setPosition(handles[i], inputs[i].pos[0]+offset, inputs[i].pos[1], inputs[i].pos[2]);
+            store.update();
+        });
+
+        // Compare the results of the last frame of both
+        for (size_t i{}; i < count; ++i)
+        {
+            const Input& in = inputs[i];
+            store.setPosition(handles[i], legacy[i].pos[0], in.pos[1], in.pos[2]);
+        }
+        store.update();
+        float maxError{};
+        for (size_t i{}; i < count; ++i)
+        {
+            const float* matrix = store.getMatrix(handles[i]);
+            for (int j{}; j < 16; ++j)
+                maxError = std::max(maxError, std::abs(matrix[j]-legacy[i].modelMatrix.m[j]));
+        }
+
+        std::cout << std::left << std::setw(10) << count << std::right << std::fixed
+            << std::setprecision(3) << std::setw(16) << legacyMs
+            << std::setw(16) << storeMs
+            << std::setw(16) << sparseMs
+            << std::setprecision(2) << std::setw(11) << legacyMs/storeMs << 'x'
+            << std::scientific << std::setprecision(1) << std::setw(12) << maxError
+            << std::defaultfloat << '\n';
+    }
+
+    return 0;
+}
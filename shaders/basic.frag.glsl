@@ -5,9 +5,11 @@ out vec4 outColor;
 in vec2 texCoord;
 
 uniform sampler2D inTexture;
+// Set for the textures stored top-down, see `Texture::isUpsideDown()`
+uniform int isTexUpsideDown;
 
 void main()
 {
-    outColor = texture(inTexture, texCoord);
+    outColor = texture(inTexture, isTexUpsideDown != 0 ? vec2(texCoord.x, 1.0f-texCoord.y) : texCoord);
 }
 
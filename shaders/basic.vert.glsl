@@ -5,8 +5,12 @@ layout (location = 1) in vec2 inUv;
 layout (location = 2) in vec3 inNormal;
 
 uniform mat4 modelMat;
-uniform mat4 viewMat;
-uniform mat4 projMat;
+// Shared by every program, updated by `Camera::uploadMatrices()`
+layout (std140) uniform Camera
+{
+    mat4 viewMat;
+    mat4 projMat;
+};
 
 out vec2 texCoord;
 
@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUv;
+layout (location = 2) in vec3 inNormal;
+// Per-instance, takes locations 3-6
+layout (location = 3) in mat4 inModelMat;
+
+// Shared by every program, updated by `Camera::uploadMatrices()`
+layout (std140) uniform Camera
+{
+    mat4 viewMat;
+    mat4 projMat;
+};
+
+out vec2 texCoord;
+
+void main()
+{
+    gl_Position = projMat * viewMat * inModelMat * vec4(inPos, 1.0f);
+    texCoord = inUv;
+}
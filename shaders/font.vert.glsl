@@ -1,7 +1,9 @@
 #version 330 core
 
 layout (location = 0) in vec4 vertex; // Position, Texture coords
+layout (location = 1) in vec3 inColor;
 out vec2 texCoords;
+out vec3 textColor;
 
 uniform mat4 projectionMat;
 
@@ -9,5 +11,5 @@ void main()
 {
     gl_Position = projectionMat * vec4(vertex.xy, 0.0f, 1.0f);
     texCoords = vertex.zw;
+    textColor = inColor;
 }
-
@@ -1,11 +1,9 @@
 #version 330 core
 
+in vec3 lineColor;
 out vec4 outColor;
 
-uniform vec3 lineColor;
-
 void main()
 {
     outColor = vec4(lineColor.rgb, 1.0);
 }
-
@@ -1,11 +1,19 @@
 #version 330 core
 
 layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
 
-uniform mat4 viewMat;
-uniform mat4 projMat;
+// Shared by every program, updated by `Camera::uploadMatrices()`
+layout (std140) uniform Camera
+{
+    mat4 viewMat;
+    mat4 projMat;
+};
+
+out vec3 lineColor;
 
 void main()
 {
     gl_Position = projMat * viewMat * vec4(inPos, 1.0f);
+    lineColor = inColor;
 }
@@ -1,11 +1,9 @@
 #version 330 core
 
+in vec3 uiColor;
 out vec4 outColor;
 
-uniform vec3 uiColor;
-
 void main()
 {
     outColor = vec4(uiColor, 1.0f);
 }
-
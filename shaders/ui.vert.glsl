@@ -1,11 +1,13 @@
 #version 330 core
 
 layout (location = 0) in vec2 inPos;
+layout (location = 1) in vec3 inColor;
+out vec3 uiColor;
 
 uniform mat4 projectionMat;
 
 void main()
 {
     gl_Position = projectionMat * vec4(inPos.xy, 0.0f, 1.0f);
+    uiColor = inColor;
 }
-
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/common.hpp>
+
+// Axis-aligned bounding box
+struct Aabb
+{
+    glm::vec3 min{};
+    glm::vec3 max{};
+
+    inline glm::vec3 getCenter() const { return (min+max)*0.5f; }
+    inline glm::vec3 getExtents() const { return (max-min)*0.5f; }
+
+    // Half of the surface area, enough for comparing the cost of boxes
+    inline float getHalfArea() const
+    {
+        const glm::vec3 d = max-min;
+        return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+
+    inline bool contains(const Aabb& other) const
+    {
+        return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+    }
+
+    inline Aabb merged(const Aabb& other) const
+    {
+        return {glm::min(min, other.min), glm::max(max, other.max)};
+    }
+
+    inline Aabb expanded(float margin) const
+    {
+        return {min-glm::vec3{margin}, max+glm::vec3{margin}};
+    }
+
+    // Returns the box containing this box transformed by `mat`
+    inline Aabb transformed(const glm::mat4& mat) const
+    {
+        const glm::vec3 center = glm::vec3{mat*glm::vec4{getCenter(), 1.0f}};
+        const glm::vec3 extents = getExtents();
+        const glm::mat3 absMat{glm::abs(glm::vec3{mat[0]}), glm::abs(glm::vec3{mat[1]}), glm::abs(glm::vec3{mat[2]})};
+        const glm::vec3 newExtents = absMat*extents;
+        return {center-newExtents, center+newExtents};
+    }
+};
@@ -0,0 +1,243 @@
+#include "Benchmark.h"
+#include "Logger.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+namespace Benchmark
+{
+
+bool parseArgs(int argc, char** argv, Options* output)
+{
+    auto printUsage{[&](){
+        Logger::err << "Usage: " << argv[0]
+            << " [--benchmark <map> [--frames N] [--camera-path <file>] [--output <file>]]" << Logger::End;
+    }};
+
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (i+1 == argc)
+        {
+            printUsage();
+            return 1;
+        }
+        const char* value = argv[++i];
+
+        if (arg == "--benchmark")
+        {
+            output->mapPath = value;
+        }
+        else if (arg == "--frames")
+        {
+            char* end{};
+            const unsigned long count = std::strtoul(value, &end, 10);
+            if (*end || count == 0 || count > UINT32_MAX)
+            {
+                Logger::err << "Invalid frame count: " << value << Logger::End;
+                return 1;
+            }
+            output->frameCount = count;
+        }
+        else if (arg == "--camera-path")
+        {
+            output->cameraPathPath = value;
+        }
+        else if (arg == "--output")
+        {
+            output->outputPath = value;
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (output->mapPath.empty() && argc > 1)
+    {
+        Logger::err << "The benchmark options need --benchmark <map>" << Logger::End;
+        return 1;
+    }
+    return 0;
+}
+
+bool CameraPath::open(const std::string& path)
+{
+    std::ifstream file{path};
+    if (!file.is_open())
+    {
+        Logger::err << "Failed to open camera path: " << path << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+
+    m_keyframes.clear();
+    std::string line;
+    for (size_t lineI{1}; std::getline(file, line); ++lineI)
+    {
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+
+        std::istringstream fields{line};
+        Keyframe keyframe;
+        std::string rest;
+        if (!(fields >> keyframe.timeS >> keyframe.pos.x >> keyframe.pos.y >> keyframe.pos.z
+                    >> keyframe.yawDeg >> keyframe.pitchDeg)
+         || (fields >> rest))
+        {
+            Logger::err << path << ':' << lineI << ": Expected \"<time> <x> <y> <z> <yaw> <pitch>\"" << Logger::End;
+            return 1;
+        }
+        if (!m_keyframes.empty() && keyframe.timeS <= m_keyframes.back().timeS)
+        {
+            Logger::err << path << ':' << lineI << ": The keyframe times must increase" << Logger::End;
+            return 1;
+        }
+        m_keyframes.push_back(keyframe);
+    }
+
+    if (m_keyframes.empty())
+    {
+        Logger::err << "No keyframes in camera path: " << path << Logger::End;
+        return 1;
+    }
+    LOGGER_VERB << "Loaded camera path with " << m_keyframes.size() << " keyframes, "
+        << getDurationS() << "s long: " << path << Logger::End;
+    return 0;
+}
+
+CameraPath::Keyframe CameraPath::sample(float timeS) const
+{
+    if (m_keyframes.empty())
+        return {};
+
+    // The first keyframe after `timeS`
+    auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), timeS,
+            [](float time, const Keyframe& keyframe){ return time < keyframe.timeS; });
+    if (next == m_keyframes.begin())
+        return m_keyframes.front();
+    if (next == m_keyframes.end())
+        return m_keyframes.back();
+
+    const Keyframe& prev = *(next-1);
+    const float alpha = (timeS-prev.timeS)/(next->timeS-prev.timeS);
+    Keyframe output;
+    output.timeS = timeS;
+    output.pos = glm::mix(prev.pos, next->pos, alpha);
+    output.yawDeg = glm::mix(prev.yawDeg, next->yawDeg, alpha);
+    output.pitchDeg = glm::mix(prev.pitchDeg, next->pitchDeg, alpha);
+    return output;
+}
+
+static void writeJsonString(std::ostream& output, const std::string& str)
+{
+    output << '"';
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            output << '\\';
+        output << c;
+    }
+    output << '"';
+}
+
+// Writes an object with the average, the minimum, the percentiles and the maximum of the values
+static void writeDistribution(std::ostream& output, std::vector<double> values)
+{
+    if (values.empty())
+    {
+        output << "null";
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+    double sum{};
+    for (double value : values)
+        sum += value;
+    // Nearest rank
+    auto getPercentile{[&](double perc){
+        const size_t rank = std::max<size_t>(1, std::ceil(perc/100*values.size()));
+        return values[std::min(rank, values.size())-1];
+    }};
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+            "{\"avg\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+            sum/values.size(), values.front(), getPercentile(50), getPercentile(90),
+            getPercentile(95), getPercentile(99), values.back());
+    output << buffer;
+}
+
+bool Recorder::writeJson(const std::string& path, const RunInfo& info) const
+{
+    std::ofstream file{path, std::ios::trunc};
+    if (!file.is_open())
+    {
+        Logger::err << "Failed to create benchmark result: " << path << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+
+    std::vector<double> frameMs;
+    std::vector<double> drawCalls;
+    std::vector<double> drawnObjects;
+    std::vector<double> drawnVertices;
+    // Only of the frames that stepped
+    std::vector<double> physUpdateUs;
+    std::vector<double> physMoved;
+    uint64_t physSteps{};
+    for (const FrameRecord& frame : m_frames)
+    {
+        frameMs.push_back(frame.durNs/1e6);
+        drawCalls.push_back(frame.drawCalls);
+        drawnObjects.push_back(frame.drawnObjects);
+        drawnVertices.push_back(frame.drawnVertices);
+        physSteps += frame.physSteps;
+        if (frame.physSteps)
+        {
+            physUpdateUs.push_back(frame.physUpdateUs);
+            physMoved.push_back(frame.physMovedCount);
+        }
+    }
+
+    char buffer[128];
+    file << "{\n    \"map\": ";
+    writeJsonString(file, info.mapPath);
+    file << ",\n    \"cameraPath\": ";
+    writeJsonString(file, info.cameraPathPath);
+    file << ",\n    \"renderer\": ";
+    writeJsonString(file, info.renderer);
+    snprintf(buffer, sizeof(buffer), ",\n    \"frames\": %zu,\n    \"timestepMs\": %.4f", m_frames.size(), info.timestepS*1000);
+    file << buffer;
+    snprintf(buffer, sizeof(buffer), ",\n    \"wallTimeMs\": %.3f,\n    \"streamWaitMs\": %.3f", info.wallNs/1e6, info.streamWaitNs/1e6);
+    file << buffer;
+    file << ",\n    \"frameTimeMs\": ";
+    writeDistribution(file, frameMs);
+    file << ",\n    \"drawCalls\": ";
+    writeDistribution(file, drawCalls);
+    file << ",\n    \"drawnObjects\": ";
+    writeDistribution(file, drawnObjects);
+    file << ",\n    \"drawnVertices\": ";
+    writeDistribution(file, drawnVertices);
+    snprintf(buffer, sizeof(buffer), ",\n    \"physics\": {\n        \"steps\": %llu", (unsigned long long)physSteps);
+    file << buffer;
+    file << ",\n        \"updateUs\": ";
+    writeDistribution(file, physUpdateUs);
+    file << ",\n        \"bodiesMoved\": ";
+    writeDistribution(file, physMoved);
+    file << "\n    }\n}\n";
+
+    if (!file.good())
+    {
+        Logger::err << "Failed to write benchmark result: " << path << Logger::End;
+        return 1;
+    }
+    Logger::log << "Wrote the results of " << m_frames.size() << " frames to " << path << Logger::End;
+    return 0;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// The number of frames rendered when `--frames` is not given
+#define BENCHMARK_DEF_FRAME_COUNT 1000
+// Written when `--output` is not given
+#define BENCHMARK_DEF_OUTPUT_PATH "benchmark.json"
+
+/*
+ * Scripted runs of the engine for tracking the performance between commits:
+ *      engine --benchmark <map> [--frames N] [--camera-path <file>] [--output <file>]
+ *
+ * The camera follows the path while every frame advances the simulated time by
+ * a fixed step, so the same frames are rendered on every run.
+ */
+namespace Benchmark
+{
+
+struct Options
+{
+    // Empty if not benchmarking
+    std::string mapPath;
+    uint32_t frameCount{BENCHMARK_DEF_FRAME_COUNT};
+    // Empty to keep the camera at its starting position
+    std::string cameraPathPath;
+    std::string outputPath{BENCHMARK_DEF_OUTPUT_PATH};
+};
+
+/*
+ * Parses the command line arguments of the engine.
+ *
+ * Returns:
+ *      true if failed,
+ *      false otherwise
+ */
+bool parseArgs(int argc, char** argv, Options* output);
+
+/*
+ * Keyframes of the camera, linearly interpolated. The file has one keyframe per line:
+ *      <time in seconds> <x> <y> <z> <yaw in degrees> <pitch in degrees>
+ * with increasing times. Empty lines and lines starting with `#` are skipped.
+ */
+class CameraPath final
+{
+public:
+    struct Keyframe
+    {
+        float timeS{};
+        glm::vec3 pos{};
+        float yawDeg{};
+        float pitchDeg{};
+    };
+
+private:
+    std::vector<Keyframe> m_keyframes;
+
+public:
+    CameraPath() {}
+
+    // Copy ctor, copy assignment op
+    CameraPath(const CameraPath&) = delete;
+    CameraPath& operator=(const CameraPath&) = delete;
+    // Move ctor, move assignment op
+    CameraPath(CameraPath&&) = delete;
+    CameraPath& operator=(CameraPath&&) = delete;
+
+    /*
+     * Returns:
+     *      true if failed,
+     *      false otherwise
+     */
+    bool open(const std::string& path);
+
+    // The state at `timeS`, clamped to the first and the last keyframe
+    Keyframe sample(float timeS) const;
+    inline float getDurationS() const { return m_keyframes.empty() ? 0 : m_keyframes.back().timeS; }
+    inline bool isEmpty() const { return m_keyframes.empty(); }
+};
+
+/*
+ * Collects the statistics of the benchmark frames and writes them as JSON.
+ */
+class Recorder final
+{
+public:
+    struct FrameRecord
+    {
+        // Without the time spent waiting for the streamed cells and assets
+        int64_t durNs{};
+        uint32_t drawCalls{};
+        uint32_t drawnObjects{};
+        uint64_t drawnVertices{};
+        uint32_t physSteps{};
+        uint32_t physUpdateUs{};
+        uint32_t physMovedCount{};
+    };
+
+    struct RunInfo
+    {
+        std::string mapPath;
+        std::string cameraPathPath;
+        std::string renderer;
+        double timestepS{};
+        // Total over all frames
+        int64_t streamWaitNs{};
+        int64_t wallNs{};
+    };
+
+private:
+    std::vector<FrameRecord> m_frames;
+
+public:
+    Recorder() {}
+
+    // Copy ctor, copy assignment op
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+    // Move ctor, move assignment op
+    Recorder(Recorder&&) = delete;
+    Recorder& operator=(Recorder&&) = delete;
+
+    inline void reserve(size_t frameCount) { m_frames.reserve(frameCount); }
+    inline void addFrame(const FrameRecord& frame) { m_frames.push_back(frame); }
+    inline size_t getFrameCount() const { return m_frames.size(); }
+
+    /*
+     * Writes the percentiles of the frame times and the draw and physics statistics.
+     *
+     * Returns:
+     *      true if failed,
+     *      false otherwise
+     */
+    bool writeJson(const std::string& path, const RunInfo& info) const;
+};
+
+} // namespace Benchmark
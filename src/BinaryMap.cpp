@@ -0,0 +1,127 @@
+#include "BinaryMap.h"
+#include "Logger.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+namespace BinaryMap
+{
+
+StringRef StringTableBuilder::add(std::string_view str)
+{
+    auto it = m_refs.find(std::string{str});
+    if (it != m_refs.end())
+        return it->second;
+
+    const StringRef ref{(uint32_t)m_data.size(), (uint32_t)str.size()};
+    m_data.append(str);
+    m_data.push_back(0);
+    m_refs.emplace(str, ref);
+    return ref;
+}
+
+std::string getBakedPath(const std::string& jsonPath)
+{
+    return std::filesystem::path{jsonPath}.replace_extension(".emap").string();
+}
+
+static bool isRefValid(StringRef ref, size_t stringsSize)
+{
+    // The terminator must be inside too
+    return (uint64_t)ref.offset+ref.length < stringsSize;
+}
+
+// Like the JSON loader, which rejects negative masses and shape sizes
+static bool isNumValid(float val)
+{
+    return std::isfinite(val) && val >= 0;
+}
+
+int parse(std::string_view file, View* output)
+{
+    assert((uintptr_t)file.data() % alignof(FileHeader) == 0);
+
+    if (file.size() < sizeof(FileHeader) || std::memcmp(file.data(), fileMagic, sizeof(fileMagic)) != 0)
+    {
+        Logger::err << "Not a binary map file" << Logger::End;
+        return 1;
+    }
+    const FileHeader* header = (const FileHeader*)file.data();
+    if (header->version != fileVersion)
+    {
+        Logger::err << "Unsupported binary map version: " << header->version
+            << " (expected " << fileVersion << ')' << Logger::End;
+        return 1;
+    }
+
+    if (header->objectsOffset % alignof(ObjectRecord) != 0
+     || (uint64_t)header->objectsOffset+(uint64_t)header->objectCount*sizeof(ObjectRecord) > file.size()
+     || (uint64_t)header->stringsOffset+header->stringsSize > file.size())
+    {
+        Logger::err << "Binary map file is truncated" << Logger::End;
+        return 1;
+    }
+
+    output->header = header;
+    output->objects = (const ObjectRecord*)(file.data()+header->objectsOffset);
+    output->strings = file.substr(header->stringsOffset, header->stringsSize);
+
+    const size_t stringsSize = output->strings.size();
+    bool areRefsValid = isRefValid(header->name, stringsSize)
+        && isRefValid(header->descr, stringsSize)
+        && isRefValid(header->author, stringsSize);
+    for (uint32_t i{}; i < header->objectCount && areRefsValid; ++i)
+    {
+        const ObjectRecord& obj = output->objects[i];
+        areRefsValid = isRefValid(obj.name, stringsSize)
+            && isRefValid(obj.modelName, stringsSize)
+            && isRefValid(obj.textureName, stringsSize)
+            && isRefValid(obj.collMeshPath, stringsSize)
+            && obj.collShapeType <= CollShapeType::Mesh
+            && isNumValid(obj.mass)
+            && isNumValid(obj.collShapeParams[0])
+            && isNumValid(obj.collShapeParams[1])
+            && isNumValid(obj.collShapeParams[2]);
+    }
+    if (!areRefsValid)
+    {
+        Logger::err << "Binary map file is corrupted" << Logger::End;
+        return 1;
+    }
+
+    return 0;
+}
+
+int write(
+        const std::string& path,
+        FileHeader header,
+        const std::vector<ObjectRecord>& objects,
+        const StringTableBuilder& strings)
+{
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = fileVersion;
+    header.objectCount = objects.size();
+    header.objectsOffset = sizeof(FileHeader);
+    header.stringsOffset = header.objectsOffset+objects.size()*sizeof(ObjectRecord);
+    header.stringsSize = strings.getData().size();
+
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file)
+    {
+        Logger::err << "Failed to create binary map file: " << path << Logger::End;
+        return 1;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)objects.data(), objects.size()*sizeof(ObjectRecord));
+    file.write(strings.getData().data(), strings.getData().size());
+    if (!file)
+    {
+        Logger::err << "Failed to write binary map file: " << path << Logger::End;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace BinaryMap
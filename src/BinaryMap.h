@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <bit>
+
+/*
+ * Binary map files (.emap), converted from the JSON maps by `mapconv`.
+ *
+ * The file is mapped and read in place, there is nothing to parse:
+ * the header points to an array of fixed size object records, and every
+ * string is an offset and a length into the string table at the end of
+ * the file. Identical strings are stored once.
+ *
+ * File layout (little-endian):
+ *  * `FileHeader`
+ *  * `objectCount` `ObjectRecord`s
+ *  * string table: the strings, each followed by a null terminator
+ */
+namespace BinaryMap
+{
+
+static_assert(std::endian::native == std::endian::little, "The records are read in place");
+
+static constexpr char fileMagic[4] = {'E', 'M', 'A', 'P'};
+// Increment when the layout of the file changes
+static constexpr uint32_t fileVersion = 1;
+
+struct StringRef
+{
+    uint32_t    offset; // In the string table
+    uint32_t    length; // Without the null terminator
+};
+
+enum class CollShapeType : uint32_t
+{
+    None,
+    Sphere,     // params: radius
+    Box,        // params: half extents
+    Cylinder,   // params: radius, height
+    Mesh,       // `ObjectRecord::collMeshPath` is the path of the mesh
+};
+
+struct FileHeader
+{
+    char        magic[4];
+    uint32_t    version;
+
+    uint32_t    mapFormatMajor;
+    uint32_t    mapFormatMinor;
+    StringRef   name;
+    StringRef   descr;
+    StringRef   author;
+
+    uint32_t    objectCount;
+    uint32_t    objectsOffset;
+    uint32_t    stringsOffset;
+    uint32_t    stringsSize;
+};
+static_assert(sizeof(FileHeader) % 4 == 0);
+
+struct ObjectRecord
+{
+    StringRef   name;
+    StringRef   modelName;
+    StringRef   textureName;
+    uint32_t    flags;
+
+    float       pos[3];
+    float       scale[3];
+    float       modelRotDeg[3];
+
+    float       mass;
+    CollShapeType collShapeType;
+    float       collShapeParams[3];
+    StringRef   collMeshPath;
+};
+static_assert(sizeof(ObjectRecord) % 4 == 0);
+
+/*
+ * Collects the strings of a file, storing each distinct string once.
+ */
+class StringTableBuilder final
+{
+private:
+    std::string m_data;
+    std::unordered_map<std::string, StringRef> m_refs;
+
+public:
+    StringRef add(std::string_view str);
+    inline const std::string& getData() const { return m_data; }
+};
+
+/*
+ * A parsed file, pointing into the buffer passed to `parse()`.
+ */
+struct View
+{
+    const FileHeader* header{};
+    const ObjectRecord* objects{};
+    std::string_view strings;
+
+    // The references are checked by `parse()`
+    inline std::string_view getString(StringRef ref) const { return strings.substr(ref.offset, ref.length); }
+};
+
+/*
+ * Returns the path the binary version of the JSON map at `jsonPath` is stored at.
+ */
+std::string getBakedPath(const std::string& jsonPath);
+
+/*
+ * Checks the header and that every reference is inside the file.
+ * The buffer must be at least 4-byte aligned, like a mapped file.
+ *
+ * Returns:
+ *      1 if the file is invalid,
+ *      0 otherwise
+ */
+int parse(std::string_view file, View* output);
+
+/*
+ * Writes a file. The offsets and sizes of `header` are filled in.
+ *
+ * Returns:
+ *      1 if failed,
+ *      0 otherwise
+ */
+int write(
+        const std::string& path,
+        FileHeader header,
+        const std::vector<ObjectRecord>& objects,
+        const StringTableBuilder& strings);
+
+} // namespace BinaryMap
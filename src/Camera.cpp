@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "ShaderProgram.h"
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/ext/matrix_transform.hpp>
@@ -10,6 +11,12 @@ Camera::Camera(const glm::vec3& position, float windowAspectRatio)
 {
     setWindowAspectRatio(windowAspectRatio);
     recalculateFrontVector();
+
+    glGenBuffers(1, &m_uboIndex);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_uboIndex);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(m_uploadedMats), m_uploadedMats, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_BINDING_CAMERA, m_uboIndex);
 }
 
 void Camera::recalculateFrontVector()
@@ -21,13 +28,18 @@ void Camera::recalculateFrontVector()
     m_frontVector = glm::normalize(cameraDir);
 }
 
-void Camera::updateShaderUniforms(uint shaderId)
+void Camera::uploadMatrices()
 {
     recalculateFrontVector();
-    auto viewMatrix = glm::lookAt(m_position, m_position+m_frontVector, m_upVector);
-    glUniformMatrix4fv(glGetUniformLocation(shaderId, "viewMat"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    // Same layout as the std140 `Camera` block: view matrix, projection matrix
+    const glm::mat4 mats[2] = {getViewMatrix(), m_projectionMatrix};
+    if (memcmp(mats, m_uploadedMats, sizeof(mats)) == 0)
+        return;
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderId, "projMat"), 1, GL_FALSE, glm::value_ptr(m_projectionMatrix));
+    memcpy(m_uploadedMats, mats, sizeof(mats));
+    glBindBuffer(GL_UNIFORM_BUFFER, m_uboIndex);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mats), mats);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 btVector3 Camera::getPositionBt() const
@@ -45,3 +57,8 @@ btVector3 Camera::getFrontVecBt() const
 {
     return {m_frontVector.x, m_frontVector.y, m_frontVector.z};
 }
+
+Camera::~Camera()
+{
+    glDeleteBuffers(1, &m_uboIndex);
+}
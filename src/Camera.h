@@ -4,6 +4,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <bullet/LinearMath/btVector3.h>
+#include "Frustum.h"
+#include "types.h"
 
 class Camera
 {
@@ -17,9 +19,21 @@ private:
     glm::vec3 m_upVector{0.0f, 1.0f, 0.0f};
     float m_windowAspectRatio{};
 
+    // The buffer backing the `Camera` uniform block of the shaders
+    uint m_uboIndex{};
+    // The matrices in the buffer, to skip redundant uploads
+    glm::mat4 m_uploadedMats[2]{};
+
 public:
     Camera(const glm::vec3& position, float windowAspectRatio);
 
+    // Copy ctor, copy assignment op
+    Camera(const Camera&) = delete;
+    Camera& operator=(const Camera&) = delete;
+    // Move ctor, move assignment op
+    Camera(Camera&&) = delete;
+    Camera& operator=(Camera&&) = delete;
+
     inline void setFovDeg(float valueDeg) { m_fovDeg = valueDeg; setWindowAspectRatio(m_windowAspectRatio); }
     inline float getFovDeg() const { return m_fovDeg; }
 
@@ -35,7 +49,16 @@ public:
         m_projectionMatrix = glm::perspective(glm::radians(m_fovDeg), m_windowAspectRatio, 0.01f, 1000.0f);
     }
 
-    void updateShaderUniforms(uint shaderId);
+    /*
+     * Updates the view and projection matrices in the `Camera` uniform block,
+     * which is shared by every shader program. Call it once per frame.
+     */
+    void uploadMatrices();
+
+    inline glm::mat4 getViewMatrix() const { return glm::lookAt(m_position, m_position+m_frontVector, m_upVector); }
+    inline const glm::mat4& getProjectionMatrix() const { return m_projectionMatrix; }
+    // The frustum planes in world space, as of the last `recalculateFrontVector()`
+    inline Frustum getFrustum() const { return Frustum::fromMatrix(m_projectionMatrix*getViewMatrix()); }
 
     inline void setYawDeg(float val) { m_yawDeg = val; }
     inline float getYawDeg() { return m_yawDeg; }
@@ -50,9 +73,12 @@ public:
     }
     inline float getPitchDeg() { return m_pitchDeg; }
 
+    inline void setPosition(const glm::vec3& pos) { m_position = pos; }
     inline const glm::vec3& getPosition() const { return m_position; }
     btVector3 getPositionBt() const;
     btVector3 getFrontPosBt(float frontVecLen=1.0f) const;
     btVector3 getFrontVecBt() const;
+
+    ~Camera();
 };
 
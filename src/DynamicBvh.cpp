@@ -0,0 +1,271 @@
+#include "DynamicBvh.h"
+#include <algorithm>
+#include <cassert>
+
+int DynamicBvh::allocateNode()
+{
+    if (m_freeList == nullNode)
+    {
+        m_nodes.emplace_back();
+        m_nodes.back().height = 0;
+        return m_nodes.size()-1;
+    }
+
+    const int nodeI = m_freeList;
+    m_freeList = m_nodes[nodeI].parent;
+    m_nodes[nodeI] = Node{};
+    m_nodes[nodeI].height = 0;
+    return nodeI;
+}
+
+void DynamicBvh::freeNode(int nodeI)
+{
+    assert(nodeI >= 0 && (size_t)nodeI < m_nodes.size());
+    m_nodes[nodeI].parent = m_freeList;
+    m_nodes[nodeI].height = -1;
+    m_freeList = nodeI;
+}
+
+int DynamicBvh::createProxy(const Aabb& aabb, void* userData)
+{
+    const int proxyId = allocateNode();
+    m_nodes[proxyId].aabb = aabb.expanded(DYNAMIC_BVH_AABB_MARGIN);
+    m_nodes[proxyId].userData = userData;
+    insertLeaf(proxyId);
+    ++m_proxyCount;
+    return proxyId;
+}
+
+void DynamicBvh::destroyProxy(int proxyId)
+{
+    assert(proxyId >= 0 && (size_t)proxyId < m_nodes.size());
+    assert(m_nodes[proxyId].isLeaf());
+    removeLeaf(proxyId);
+    freeNode(proxyId);
+    --m_proxyCount;
+}
+
+bool DynamicBvh::moveProxy(int proxyId, const Aabb& aabb)
+{
+    assert(proxyId >= 0 && (size_t)proxyId < m_nodes.size());
+    assert(m_nodes[proxyId].isLeaf());
+
+    if (m_nodes[proxyId].aabb.contains(aabb))
+        return false;
+
+    removeLeaf(proxyId);
+    m_nodes[proxyId].aabb = aabb.expanded(DYNAMIC_BVH_AABB_MARGIN);
+    insertLeaf(proxyId);
+    return true;
+}
+
+void DynamicBvh::insertLeaf(int leafI)
+{
+    if (m_root == nullNode)
+    {
+        m_root = leafI;
+        m_nodes[leafI].parent = nullNode;
+        return;
+    }
+
+    // Descend to the sibling where the leaf adds the least surface area
+    const Aabb leafAabb = m_nodes[leafI].aabb;
+    int nodeI = m_root;
+    while (!m_nodes[nodeI].isLeaf())
+    {
+        const Node& node = m_nodes[nodeI];
+        const float area = node.aabb.getHalfArea();
+        const float combinedArea = node.aabb.merged(leafAabb).getHalfArea();
+
+        // Cost of making a new parent for this node and the leaf
+        const float cost = 2.0f*combinedArea;
+        // Minimum cost of pushing the leaf further down the tree
+        const float inheritanceCost = 2.0f*(combinedArea-area);
+
+        auto getChildCost{[&](int childI){
+            const Aabb& childAabb = m_nodes[childI].aabb;
+            const float newArea = childAabb.merged(leafAabb).getHalfArea();
+            if (m_nodes[childI].isLeaf())
+                return newArea+inheritanceCost;
+            return newArea-childAabb.getHalfArea()+inheritanceCost;
+        }};
+        const float cost1 = getChildCost(node.child1);
+        const float cost2 = getChildCost(node.child2);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+        nodeI = (cost1 < cost2 ? node.child1 : node.child2);
+    }
+    const int siblingI = nodeI;
+
+    const int oldParentI = m_nodes[siblingI].parent;
+    const int newParentI = allocateNode(); // May reallocate `m_nodes`
+    Node& newParent = m_nodes[newParentI];
+    newParent.parent = oldParentI;
+    newParent.aabb = m_nodes[siblingI].aabb.merged(leafAabb);
+    newParent.height = m_nodes[siblingI].height+1;
+    newParent.child1 = siblingI;
+    newParent.child2 = leafI;
+    m_nodes[siblingI].parent = newParentI;
+    m_nodes[leafI].parent = newParentI;
+
+    if (oldParentI == nullNode)
+    {
+        m_root = newParentI;
+    }
+    else
+    {
+        if (m_nodes[oldParentI].child1 == siblingI)
+            m_nodes[oldParentI].child1 = newParentI;
+        else
+            m_nodes[oldParentI].child2 = newParentI;
+    }
+
+    refitUpwards(m_nodes[leafI].parent);
+}
+
+void DynamicBvh::removeLeaf(int leafI)
+{
+    if (leafI == m_root)
+    {
+        m_root = nullNode;
+        return;
+    }
+
+    const int parentI = m_nodes[leafI].parent;
+    const int grandParentI = m_nodes[parentI].parent;
+    const int siblingI = (m_nodes[parentI].child1 == leafI ? m_nodes[parentI].child2 : m_nodes[parentI].child1);
+
+    // Replace the parent with the sibling
+    if (grandParentI == nullNode)
+    {
+        m_root = siblingI;
+        m_nodes[siblingI].parent = nullNode;
+        freeNode(parentI);
+    }
+    else
+    {
+        if (m_nodes[grandParentI].child1 == parentI)
+            m_nodes[grandParentI].child1 = siblingI;
+        else
+            m_nodes[grandParentI].child2 = siblingI;
+        m_nodes[siblingI].parent = grandParentI;
+        freeNode(parentI);
+
+        refitUpwards(grandParentI);
+    }
+}
+
+void DynamicBvh::refitUpwards(int nodeI)
+{
+    while (nodeI != nullNode)
+    {
+        nodeI = balance(nodeI);
+
+        Node& node = m_nodes[nodeI];
+        const Node& child1 = m_nodes[node.child1];
+        const Node& child2 = m_nodes[node.child2];
+        node.height = 1+std::max(child1.height, child2.height);
+        node.aabb = child1.aabb.merged(child2.aabb);
+
+        nodeI = node.parent;
+    }
+}
+
+int DynamicBvh::balance(int iA)
+{
+    assert(iA != nullNode);
+
+    Node* a = &m_nodes[iA];
+    if (a->isLeaf() || a->height < 2)
+        return iA;
+
+    const int iB = a->child1;
+    const int iC = a->child2;
+    Node* b = &m_nodes[iB];
+    Node* c = &m_nodes[iC];
+
+    // Replaces A with `newI` in A's parent
+    auto replaceInParent{[&](int newI){
+        if (m_nodes[newI].parent == nullNode)
+            m_root = newI;
+        else if (m_nodes[m_nodes[newI].parent].child1 == iA)
+            m_nodes[m_nodes[newI].parent].child1 = newI;
+        else
+            m_nodes[m_nodes[newI].parent].child2 = newI;
+    }};
+
+    const int balanceFactor = c->height-b->height;
+    if (balanceFactor > 1) // Rotate C up
+    {
+        const int iF = c->child1;
+        const int iG = c->child2;
+        Node* f = &m_nodes[iF];
+        Node* g = &m_nodes[iG];
+
+        c->child1 = iA;
+        c->parent = a->parent;
+        a->parent = iC;
+        replaceInParent(iC);
+
+        // Keep the higher grandchild under C
+        if (f->height > g->height)
+        {
+            c->child2 = iF;
+            a->child2 = iG;
+            g->parent = iA;
+            a->aabb = b->aabb.merged(g->aabb);
+            c->aabb = a->aabb.merged(f->aabb);
+            a->height = 1+std::max(b->height, g->height);
+            c->height = 1+std::max(a->height, f->height);
+        }
+        else
+        {
+            c->child2 = iG;
+            a->child2 = iF;
+            f->parent = iA;
+            a->aabb = b->aabb.merged(f->aabb);
+            c->aabb = a->aabb.merged(g->aabb);
+            a->height = 1+std::max(b->height, f->height);
+            c->height = 1+std::max(a->height, g->height);
+        }
+        return iC;
+    }
+
+    if (balanceFactor < -1) // Rotate B up
+    {
+        const int iD = b->child1;
+        const int iE = b->child2;
+        Node* d = &m_nodes[iD];
+        Node* e = &m_nodes[iE];
+
+        b->child1 = iA;
+        b->parent = a->parent;
+        a->parent = iB;
+        replaceInParent(iB);
+
+        if (d->height > e->height)
+        {
+            b->child2 = iD;
+            a->child1 = iE;
+            e->parent = iA;
+            a->aabb = c->aabb.merged(e->aabb);
+            b->aabb = a->aabb.merged(d->aabb);
+            a->height = 1+std::max(c->height, e->height);
+            b->height = 1+std::max(a->height, d->height);
+        }
+        else
+        {
+            b->child2 = iE;
+            a->child1 = iD;
+            d->parent = iA;
+            a->aabb = c->aabb.merged(d->aabb);
+            b->aabb = a->aabb.merged(e->aabb);
+            a->height = 1+std::max(c->height, d->height);
+            b->height = 1+std::max(a->height, e->height);
+        }
+        return iB;
+    }
+
+    return iA;
+}
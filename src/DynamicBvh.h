@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Aabb.h"
+#include "Frustum.h"
+#include <vector>
+#include <cstddef>
+
+// The boxes in the tree are this much bigger than the objects, so small movements don't need a reinsert
+#define DYNAMIC_BVH_AABB_MARGIN 0.1f
+
+/*
+ * A bounding volume hierarchy that supports adding, removing and moving
+ * objects at any time. The leaves are inserted next to the sibling that
+ * increases the surface area the least, and the tree is kept balanced
+ * with rotations.
+ */
+class DynamicBvh final
+{
+public:
+    static constexpr int nullNode = -1;
+
+private:
+    struct Node
+    {
+        Aabb aabb;
+        void* userData{};
+        // The next free node if the node is in the free list
+        int parent{nullNode};
+        int child1{nullNode};
+        int child2{nullNode};
+        // Leaves have 0, free nodes -1
+        int height{-1};
+
+        inline bool isLeaf() const { return child1 == nullNode; }
+    };
+
+    std::vector<Node> m_nodes;
+    int m_root{nullNode};
+    int m_freeList{nullNode};
+    size_t m_proxyCount{};
+
+    int allocateNode();
+    void freeNode(int nodeI);
+    void insertLeaf(int leafI);
+    void removeLeaf(int leafI);
+    // Performs a left or right rotation if the node is imbalanced. Returns the new root of the subtree.
+    int balance(int nodeI);
+    // Refits the boxes and the heights from the node to the root
+    void refitUpwards(int nodeI);
+
+public:
+    DynamicBvh() {}
+
+    /*
+     * Adds an object to the tree.
+     *
+     * Returns: The ID of the proxy, used to move and remove it
+     */
+    int createProxy(const Aabb& aabb, void* userData);
+    void destroyProxy(int proxyId);
+    /*
+     * Updates the box of a proxy. The tree is only changed if the
+     * box is no longer inside the enlarged one in the tree.
+     *
+     * Returns: true if the proxy was reinserted
+     */
+    bool moveProxy(int proxyId, const Aabb& aabb);
+
+    inline void* getUserData(int proxyId) const { return m_nodes[proxyId].userData; }
+    inline size_t getProxyCount() const { return m_proxyCount; }
+    inline int getHeight() const { return m_root == nullNode ? 0 : m_nodes[m_root].height; }
+
+    /*
+     * Calls `callback(userData)` for every proxy whose box is in the frustum.
+     * The subtrees fully inside the frustum are not tested further.
+     */
+    template <typename F>
+    void queryFrustum(const Frustum& frustum, F&& callback) const
+    {
+        if (m_root == nullNode)
+            return;
+
+        struct StackEntry { int nodeI; bool isInside; };
+        std::vector<StackEntry> stack;
+        stack.reserve(64);
+        stack.push_back({m_root, false});
+        while (!stack.empty())
+        {
+            const StackEntry entry = stack.back();
+            stack.pop_back();
+            const Node& node = m_nodes[entry.nodeI];
+
+            bool isInside = entry.isInside;
+            if (!isInside)
+            {
+                const Frustum::Intersection result = frustum.test(node.aabb);
+                if (result == Frustum::Intersection::Outside)
+                    continue;
+                isInside = (result == Frustum::Intersection::Inside);
+            }
+
+            if (node.isLeaf())
+            {
+                callback(node.userData);
+            }
+            else
+            {
+                stack.push_back({node.child1, isInside});
+                stack.push_back({node.child2, isInside});
+            }
+        }
+    }
+};
@@ -3,14 +3,30 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
+#include <future>
+#include <chrono>
 #include <cassert>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
 #include "Logger.h"
+#include "ThreadPool.h"
+
+// The default memory budget of a cache, see `FileCache::trim()`
+#define FILE_CACHE_DEFAULT_MEMORY_BUDGET (256*1024*1024ull)
 
 /*
  * Prevents files from being opened multiple times.
  *
+ * The cache tracks the memory used by each file (VRAM and CPU). When the total
+ * exceeds the budget, `trim()` evicts the least recently used files that are
+ * only referenced by the cache. A later `open()` of an evicted file loads it again.
+ *
  * Template params:
- *      T: The container that contains a file object
+ *      T: The container that contains a file object.
+ *         Must have `open()`, `getMemSize()`, and `load()` + `upload()` for asynchronous loading.
+ *         `reloadAsync()` also needs move assignment and `isBusy()`.
  *      rootFolder: The folder that is used to load the files
  *      placeholderFilename: If given, this file is opened in the constructor
  *                       and it is returned when a requested file can't be opened.
@@ -19,23 +35,129 @@
 template <typename T, const auto& rootFolder, const std::string_view& placeholderFilename>
 class FileCache
 {
+public:
+    struct Stats
+    {
+        size_t hits{};
+        size_t misses{};
+        size_t evictions{};
+    };
+
 private:
     using sharedPtr_t = std::shared_ptr<T>;
-    //       Filename     File object
-    std::map<std::string, sharedPtr_t> m_files;
+
+    struct Entry
+    {
+        sharedPtr_t file;
+        // The memory cost of the file as of the last update, 0 while loading
+        size_t bytes{};
+        // The value of `m_useCounter` when the file was last opened
+        uint64_t lastUse{};
+        bool isPending{};
+    };
+    //       Filename     File
+    std::map<std::string, Entry> m_files;
+
+    size_t m_memoryBudget{};
+    size_t m_residentBytes{};
+    uint64_t m_useCounter{};
+    Stats m_stats;
+
+    ThreadPool* m_loaderPool{};
+    // Called instead of `T::upload()` for asynchronously loaded files, if set
+    std::function<int(sharedPtr_t)> m_uploader;
+
+    struct PendingFile
+    {
+        std::string filename;
+        sharedPtr_t file;
+        std::future<int> loadResult;
+    };
+    // Files being loaded on the worker threads
+    std::vector<PendingFile> m_pendingFiles;
+
+    struct PendingReload
+    {
+        std::string filename;
+        // The cached object, its contents are replaced by `newFile` when ready
+        sharedPtr_t file;
+        sharedPtr_t newFile;
+        std::future<int> loadResult;
+        // Set when the file changed again before this reload finished
+        bool isSuperseded{};
+    };
+    // New versions of changed files being loaded on the worker threads
+    std::vector<PendingReload> m_pendingReloads;
+
+    inline std::string getPath(const std::string& filename) const
+    {
+        return std::string(rootFolder)+"/"+std::string(filename);
+    }
+
+    inline bool isPlaceholder(const sharedPtr_t& file) const
+    {
+        if constexpr (placeholderFilename != "")
+            return file == m_files.find("")->second.file;
+        else
+            return false;
+    }
+
+    // Updates the cost of a loaded file
+    void setEntryBytes(Entry* entry, size_t bytes)
+    {
+        m_residentBytes = m_residentBytes-entry->bytes+bytes;
+        entry->bytes = bytes;
+    }
+
+    Entry* addEntry(const std::string& filename, sharedPtr_t file, bool isPending)
+    {
+        Entry& entry = m_files[filename];
+        entry.file = std::move(file);
+        entry.lastUse = ++m_useCounter;
+        entry.isPending = isPending;
+        if (!isPending)
+            setEntryBytes(&entry, entry.file->getMemSize());
+        return &entry;
+    }
+
+    /*
+     * Replaces a file that failed to load with the placeholder for later `open()`s.
+     * Without a placeholder, this is fatal.
+     */
+    void handleFailedFile(const std::string& filename)
+    {
+        if constexpr (placeholderFilename != "") // If we have placeholder file, use it
+        {
+            Entry& entry = m_files[filename];
+            setEntryBytes(&entry, 0); // Counted with the placeholder
+            entry.file = m_files.find("")->second.file;
+            entry.isPending = false;
+            Logger::warn << "Using placeholder file" << Logger::End;
+        }
+        else // No placeholder texture, so failing to open a file is fatal
+        {
+            (void)filename;
+            abort();
+        }
+    }
 
 public:
-    FileCache()
+    /*
+     * loaderPool: The thread pool used by `openAsync()`. May be null if only `open()` is used.
+     * memoryBudget: `trim()` evicts unused files above this many bytes
+     */
+    FileCache(ThreadPool* loaderPool=nullptr, size_t memoryBudget=FILE_CACHE_DEFAULT_MEMORY_BUDGET)
+        : m_memoryBudget{memoryBudget}, m_loaderPool{loaderPool}
     {
         if constexpr (placeholderFilename != "")
         {
             auto placeholderFile = std::make_shared<T>();
-            if (placeholderFile->open(std::string(rootFolder)+"/"+std::string(placeholderFilename))) // Try to open placeholder file
+            if (placeholderFile->open(getPath(std::string(placeholderFilename)))) // Try to open placeholder file
             {
                 Logger::err << "Failed to open placeholder file" << Logger::End;
                 abort();
             }
-            m_files.emplace("", placeholderFile);
+            addEntry("", placeholderFile, false);
         }
     }
 
@@ -47,32 +169,261 @@ public:
         if (it == m_files.end()) // If the file is not in the cache
         {
             Logger::log << "File \"" << filename << "\" is NOT in the cache, loading (folder: \"" << rootFolder << "\")" << Logger::End;
+            ++m_stats.misses;
             file = std::make_shared<T>();
-            if (file->open(std::string(rootFolder)+"/"+std::string(filename))) // Try to open file
+            if (file->open(getPath(filename))) // Try to open file
             {
-                if constexpr (placeholderFilename != "") // If we have placeholder file, use it
-                {
-                    file = m_files.find("")->second;
-                    Logger::warn << "Using placeholder file" << Logger::End;
-                }
-                else // No placeholder texture, so failing to open a file is fatal
-                {
-                    abort();
-                }
+                handleFailedFile(filename);
+                file = m_files.find("")->second.file;
             }
             else
             {
-                m_files.emplace(filename, file);
+                addEntry(filename, file, false);
             }
 
         }
         else // If the file is in the cache
         {
-            Logger::verb << "File \"" << filename << "\" is in the cache" << Logger::End;
-            file = it->second;
+            LOGGER_VERB << "File \"" << filename << "\" is in the cache" << Logger::End;
+            ++m_stats.hits;
+            it->second.lastUse = ++m_useCounter;
+            file = it->second.file;
         }
 
         assert(file);
         return file;
     }
+
+    /*
+     * Starts loading the file on the loader pool and returns its handle immediately.
+     * The object is usable (`getState()` returns `Ok`) after a later
+     * `finishPendingUploads()` call uploaded it. If loading fails, the handle stays
+     * in a failed state and later `open()`s return the placeholder.
+     */
+    sharedPtr_t openAsync(const std::string& filename)
+    {
+        assert(m_loaderPool);
+
+        auto it = m_files.find(filename);
+        if (it != m_files.end()) // If the file is in the cache (maybe still loading)
+        {
+            LOGGER_VERB << "File \"" << filename << "\" is in the cache" << Logger::End;
+            ++m_stats.hits;
+            it->second.lastUse = ++m_useCounter;
+            return it->second.file;
+        }
+
+        Logger::log << "File \"" << filename << "\" is NOT in the cache, loading asynchronously (folder: \"" << rootFolder << "\")" << Logger::End;
+        ++m_stats.misses;
+        sharedPtr_t file = std::make_shared<T>();
+        addEntry(filename, file, true);
+        m_pendingFiles.push_back({filename, file,
+                m_loaderPool->submit([file, path=getPath(filename)](){ return file->load(path); })});
+        return file;
+    }
+
+    /*
+     * Uploads the files that finished loading on the worker threads.
+     * Call it on the render thread, once per frame.
+     *
+     * maxUploads: Upper limit of files to upload in this call, to limit frame spikes.
+     *
+     * Returns: The number of files still pending
+     */
+    size_t finishPendingUploads(size_t maxUploads=SIZE_MAX)
+    {
+        size_t uploaded{};
+        for (auto it = m_pendingFiles.begin(); it != m_pendingFiles.end() && uploaded < maxUploads;)
+        {
+            if (it->loadResult.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->loadResult.get() || (m_uploader ? m_uploader(it->file) : it->file->upload()))
+            {
+                handleFailedFile(it->filename);
+            }
+            else
+            {
+                Entry& entry = m_files.find(it->filename)->second;
+                entry.isPending = false;
+                setEntryBytes(&entry, it->file->getMemSize());
+            }
+            ++uploaded;
+            it = m_pendingFiles.erase(it);
+        }
+        finishPendingReloads();
+        trim();
+        return m_pendingFiles.size();
+    }
+
+    /*
+     * Loads the cached files for which `isAffected(filename)` returns true again
+     * on the loader pool. When a new version is loaded, `finishPendingUploads()`
+     * moves it into the existing object, so the handles given out see the new version.
+     * If loading fails, the old version is kept.
+     * Files that failed before (and use the placeholder) are dropped from the cache instead,
+     * so the next `open()` tries them again.
+     *
+     * Returns: The number of files being reloaded
+     */
+    size_t reloadAsync(const std::function<bool(const std::string&)>& isAffected)
+    {
+        assert(m_loaderPool);
+
+        size_t reloaded{};
+        for (auto it = m_files.begin(); it != m_files.end();)
+        {
+            const std::string& filename = it->first;
+            Entry& entry = it->second;
+            // Skip the placeholder and the files whose first load has not finished
+            if (filename.empty() || entry.isPending || !isAffected(filename))
+            {
+                ++it;
+                continue;
+            }
+
+            if (isPlaceholder(entry.file))
+            {
+                Logger::log << "File \"" << filename << "\" changed, dropping its failed version" << Logger::End;
+                it = m_files.erase(it);
+                continue;
+            }
+
+            Logger::log << "File \"" << filename << "\" changed, reloading (folder: \"" << rootFolder << "\")" << Logger::End;
+            for (PendingReload& reload : m_pendingReloads)
+            {
+                if (reload.filename == filename)
+                    reload.isSuperseded = true;
+            }
+            sharedPtr_t newFile = std::make_shared<T>();
+            m_pendingReloads.push_back({filename, entry.file, newFile,
+                    m_loaderPool->submit([newFile, path=getPath(filename)](){ return newFile->load(path); })});
+            ++reloaded;
+            ++it;
+        }
+        return reloaded;
+    }
+
+    /*
+     * Replaces the cached files whose new version finished loading.
+     * A file that is still being uploaded or streamed is replaced in a later call.
+     * Called by `finishPendingUploads()`.
+     */
+    void finishPendingReloads()
+    {
+        for (auto it = m_pendingReloads.begin(); it != m_pendingReloads.end();)
+        {
+            if (it->loadResult.wait_for(std::chrono::seconds{0}) != std::future_status::ready
+             || (!it->isSuperseded && it->file->isBusy()))
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->isSuperseded)
+            {
+                it->loadResult.get();
+                it = m_pendingReloads.erase(it);
+                continue;
+            }
+
+            // New versions are uploaded at once, not through `m_uploader`
+            if (it->loadResult.get() || it->newFile->upload())
+            {
+                Logger::warn << "Failed to reload file \"" << it->filename << "\", keeping the old version" << Logger::End;
+            }
+            else
+            {
+                *it->file = std::move(*it->newFile);
+                // The entry may have been evicted in the meantime
+                auto entryIt = m_files.find(it->filename);
+                if (entryIt != m_files.end() && entryIt->second.file == it->file)
+                    setEntryBytes(&entryIt->second, it->file->getMemSize());
+                Logger::log << "Reloaded file \"" << it->filename << '"' << Logger::End;
+            }
+            it = m_pendingReloads.erase(it);
+        }
+    }
+
+    /*
+     * If the files use more memory than the budget, evicts the least recently
+     * used ones that are not referenced outside the cache, until it fits.
+     * Called by `finishPendingUploads()`.
+     *
+     * Returns: The number of evicted files
+     */
+    size_t trim()
+    {
+        if (m_residentBytes <= m_memoryBudget)
+            return 0;
+
+        // The costs only shrink after loading (e.g. a streamed texture frees its pixels), refresh them
+        using iterator_t = typename std::map<std::string, Entry>::iterator;
+        std::vector<iterator_t> candidates;
+        for (auto it = m_files.begin(); it != m_files.end(); ++it)
+        {
+            Entry& entry = it->second;
+            if (entry.isPending || isPlaceholder(entry.file))
+                continue;
+            setEntryBytes(&entry, entry.file->getMemSize());
+            if (entry.file.use_count() == 1)
+                candidates.push_back(it);
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](iterator_t a, iterator_t b){
+                return a->second.lastUse < b->second.lastUse; });
+        size_t evicted{};
+        for (iterator_t it : candidates)
+        {
+            if (m_residentBytes <= m_memoryBudget)
+                break;
+            LOGGER_VERB << "Evicting file \"" << it->first << "\" (" << it->second.bytes/1024 << " KiB)" << Logger::End;
+            setEntryBytes(&it->second, 0);
+            m_files.erase(it);
+            ++evicted;
+        }
+        m_stats.evictions += evicted;
+        return evicted;
+    }
+
+    // Blocks until every pending file is loaded and uploaded
+    void waitForPendingUploads()
+    {
+        for (auto& pending : m_pendingFiles)
+            pending.loadResult.wait();
+        for (auto& reload : m_pendingReloads)
+            reload.loadResult.wait();
+        finishPendingUploads();
+    }
+
+    inline size_t getPendingCount() const { return m_pendingFiles.size(); }
+    inline size_t getPendingReloadCount() const { return m_pendingReloads.size(); }
+    inline size_t getFileCount() const { return m_files.size(); }
+
+    inline const Stats& getStats() const { return m_stats; }
+    // The memory used by the files in the cache, including the ones referenced elsewhere
+    inline size_t getResidentBytes() const { return m_residentBytes; }
+    inline size_t getMemoryBudget() const { return m_memoryBudget; }
+    inline void setMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+
+    /*
+     * Replaces the `upload()` call of the files loaded by `openAsync()`,
+     * e.g. to queue them for a streamer instead of uploading them at once.
+     * The uploader returns 1 if failed, 0 otherwise.
+     */
+    inline void setUploader(std::function<int(sharedPtr_t)> uploader) { m_uploader = std::move(uploader); }
+
+    /*
+     * Returns: The placeholder file, or null if there is no placeholder
+     */
+    sharedPtr_t getPlaceholder() const
+    {
+        if constexpr (placeholderFilename != "")
+            return m_files.find("")->second.file;
+        else
+            return nullptr;
+    }
 };
@@ -0,0 +1,160 @@
+#include "FileWatcher.h"
+#include "Logger.h"
+#include "os.h"
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <utility>
+#ifdef OS_LINUX
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#error "TODO: Unimplemented"
+#endif
+
+FileWatcher::FileWatcher(std::vector<std::string> roots)
+    : m_roots{std::move(roots)}
+{
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotifyFd == -1 || m_stopFd == -1)
+    {
+        Logger::err << "Failed to initialize the file watcher: " << strerror(errno) << Logger::End;
+        return;
+    }
+
+    for (size_t i{}; i < m_roots.size(); ++i)
+        addWatchRecursive(i, "");
+
+    m_thread = std::thread{&FileWatcher::threadLoop, this};
+    LOGGER_VERB << "Watching " << m_watches.size() << " directories for changes" << Logger::End;
+}
+
+void FileWatcher::addWatchRecursive(size_t rootI, const std::string& dir)
+{
+    const std::filesystem::path path = std::filesystem::path{m_roots[rootI]}/dir;
+    const int wd = inotify_add_watch(m_inotifyFd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd == -1)
+    {
+        Logger::warn << "Failed to watch directory: " << path.string() << ": " << strerror(errno) << Logger::End;
+        return;
+    }
+    m_watches[wd] = {rootI, dir};
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator{path, ec})
+    {
+        if (entry.is_directory(ec))
+            addWatchRecursive(rootI, (std::filesystem::path{dir}/entry.path().filename()).string());
+    }
+}
+
+void FileWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[sizeof(inotify_event)+NAME_MAX+1];
+    while (true)
+    {
+        const ssize_t len = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0) // EAGAIN, everything is read
+            return;
+
+        for (ssize_t offset{}; offset < len;)
+        {
+            const inotify_event* event = (const inotify_event*)(buffer+offset);
+            offset += sizeof(inotify_event)+event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                Logger::warn << "File watcher queue overflowed, changes were missed" << Logger::End;
+                continue;
+            }
+            auto watchIt = m_watches.find(event->wd);
+            if (watchIt == m_watches.end())
+                continue;
+            if (event->mask & IN_IGNORED) // The directory was removed
+            {
+                m_watches.erase(watchIt);
+                continue;
+            }
+            if (event->len == 0)
+                continue;
+
+            // Copied, adding a watch may rehash the map
+            const Watch watch = watchIt->second;
+            const std::string path = (std::filesystem::path{watch.dir}/event->name).string();
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    addWatchRecursive(watch.rootI, path);
+            }
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            {
+                m_debouncedChanges[{watch.rootI, path}]
+                    = clock_t::now()+std::chrono::milliseconds{FILE_WATCHER_DEBOUNCE_MS};
+            }
+        }
+    }
+}
+
+void FileWatcher::threadLoop()
+{
+    while (true)
+    {
+        // Sleep until an event arrives or the earliest debounced change is due
+        int timeoutMs = -1;
+        if (!m_debouncedChanges.empty())
+        {
+            clock_t::time_point earliest = clock_t::time_point::max();
+            for (const auto& [key, dueTime] : m_debouncedChanges)
+                earliest = std::min(earliest, dueTime);
+            timeoutMs = std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(earliest-clock_t::now()).count());
+        }
+
+        pollfd fds[2] = {{m_inotifyFd, POLLIN, 0}, {m_stopFd, POLLIN, 0}};
+        if (poll(fds, 2, timeoutMs) == -1 && errno != EINTR)
+        {
+            Logger::err << "File watcher failed: " << strerror(errno) << Logger::End;
+            return;
+        }
+        if (fds[1].revents & POLLIN)
+            return;
+        if (fds[0].revents & POLLIN)
+            readEvents();
+
+        const clock_t::time_point now = clock_t::now();
+        std::lock_guard<std::mutex> lock{m_changesMutex};
+        for (auto it = m_debouncedChanges.begin(); it != m_debouncedChanges.end();)
+        {
+            if (it->second > now)
+            {
+                ++it;
+                continue;
+            }
+            m_readyChanges.push_back({m_roots[it->first.first], it->first.second});
+            it = m_debouncedChanges.erase(it);
+        }
+    }
+}
+
+std::vector<FileWatcher::Change> FileWatcher::pollChanges()
+{
+    std::lock_guard<std::mutex> lock{m_changesMutex};
+    return std::exchange(m_readyChanges, {});
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_thread.joinable())
+    {
+        const uint64_t value = 1;
+        [[maybe_unused]] const ssize_t written = write(m_stopFd, &value, sizeof(value));
+        m_thread.join();
+    }
+    if (m_inotifyFd != -1)
+        close(m_inotifyFd);
+    if (m_stopFd != -1)
+        close(m_stopFd);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+// A file is reported when it was not written for this long, editors often write in several steps
+#define FILE_WATCHER_DEBOUNCE_MS 150
+
+/*
+ * Watches directory trees for files that were written or moved in,
+ * using inotify on a background thread.
+ */
+class FileWatcher final
+{
+public:
+    struct Change
+    {
+        // The watched directory, as given to the constructor
+        std::string root;
+        // The path of the file relative to `root`
+        std::string path;
+    };
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    std::vector<std::string> m_roots;
+    int m_inotifyFd{-1};
+    // Written to wake up and stop the thread
+    int m_stopFd{-1};
+    std::thread m_thread;
+
+    struct Watch
+    {
+        size_t rootI;
+        std::string dir; // Relative to the root, empty for the root itself
+    };
+    // Only used by the thread after the constructor
+    std::unordered_map<int, Watch> m_watches;
+    //       Root index, path                  When to report it
+    std::map<std::pair<size_t, std::string>, clock_t::time_point> m_debouncedChanges;
+
+    std::mutex m_changesMutex;
+    // The debounced changes not polled yet
+    std::vector<Change> m_readyChanges;
+
+    // Watches the directory and its subdirectories
+    void addWatchRecursive(size_t rootI, const std::string& dir);
+    void threadLoop();
+    // Reads the pending events and adds them to `m_debouncedChanges`
+    void readEvents();
+
+public:
+    /*
+     * Starts watching the directories and their subdirectories.
+     * Directories that don't exist are skipped with a warning.
+     */
+    FileWatcher(std::vector<std::string> roots);
+
+    // Copy ctor, copy assignment op
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    // Move ctor, move assignment op
+    FileWatcher(FileWatcher&&) = delete;
+    FileWatcher& operator=(FileWatcher&&) = delete;
+
+    // Stops the thread
+    ~FileWatcher();
+
+    inline bool isRunning() const { return m_thread.joinable(); }
+
+    /*
+     * Returns: The files that changed since the last call, each once
+     */
+    std::vector<Change> pollChanges();
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Aabb.h"
+#include <glm/glm.hpp>
+
+/*
+ * The view frustum of a camera as six planes, with the normals pointing inwards.
+ */
+struct Frustum
+{
+    enum class Intersection
+    {
+        Outside,
+        Intersects,
+        Inside,
+    };
+
+    // Left, right, bottom, top, near, far
+    glm::vec4 planes[6]{};
+
+    // Extracts the planes from a projection * view matrix
+    static inline Frustum fromMatrix(const glm::mat4& viewProj)
+    {
+        const glm::mat4 m = glm::transpose(viewProj); // The rows as columns
+        Frustum frustum;
+        frustum.planes[0] = m[3]+m[0];
+        frustum.planes[1] = m[3]-m[0];
+        frustum.planes[2] = m[3]+m[1];
+        frustum.planes[3] = m[3]-m[1];
+        frustum.planes[4] = m[3]+m[2];
+        frustum.planes[5] = m[3]-m[2];
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3{plane});
+        return frustum;
+    }
+
+    inline Intersection test(const Aabb& box) const
+    {
+        const glm::vec3 center = box.getCenter();
+        const glm::vec3 extents = box.getExtents();
+        Intersection result = Intersection::Inside;
+        for (const glm::vec4& plane : planes)
+        {
+            const glm::vec3 normal{plane};
+            const float distance = glm::dot(normal, center)+plane.w;
+            // The extent of the box projected on the normal
+            const float radius = glm::dot(extents, glm::abs(normal));
+            if (distance < -radius)
+                return Intersection::Outside;
+            if (distance < radius)
+                result = Intersection::Intersects;
+        }
+        return result;
+    }
+};
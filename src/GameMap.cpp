@@ -1,12 +1,24 @@
 #include "GameMap.h"
 #include "Logger.h"
 #include "assets.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
 #include <cjson/cJSON.h>
 #include <fstream>
+#include <filesystem>
 #include <sstream>
 #include <ctype.h>
 #include <cstring>
 #include <type_traits>
+#include <algorithm>
+#include <string_view>
+
+using steadyClock_t = std::chrono::steady_clock;
+
+static double msBetween(steadyClock_t::time_point start, steadyClock_t::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end-start).count();
+}
 
 #define MAP_KEY_NAME                "name"
 #define MAP_KEY_DESCR               "descr"
@@ -171,48 +183,78 @@ static T createVec3(const cJSON* item, bool allowNegative=true)
     return {x, y, z};
 }
 
-static btCollisionShape* createTriangleMeshCollShape(const std::vector<float>& points)
+static btCollisionShape* createTriangleMeshCollShape(const MeshCache::MeshView& mesh)
 {
     btCollisionShape* shape = new btConvexHullShape{};
 
-    for (size_t i{}; i < points.size()/3; ++i)
-        dynamic_cast<btConvexHullShape*>(shape)->addPoint({points[i*3+0], points[i*3+1], points[i*3+2]}, false);
+    const float* vd = mesh.vertData;
+    static constexpr size_t stride = ObjParser::Mesh::floatsPerVertex;
+    for (size_t i{}; i < mesh.vertCount; ++i)
+        dynamic_cast<btConvexHullShape*>(shape)->addPoint({vd[i*stride+0], vd[i*stride+1], vd[i*stride+2]}, false);
     dynamic_cast<btConvexHullShape*>(shape)->recalcLocalAabb();
 
     return shape;
 }
 
-static btCollisionShape* createCollShape(const cJSON* item)
+static std::shared_ptr<btCollisionShape> createCollMeshShape(const std::string& path)
 {
-    const cJSON* typeJson = cJSON_GetObjectItem(item, "type");
-    checkItemType<JsonType::String>(typeJson);
-    char* typeStr = cJSON_GetStringValue(typeJson);
-    assert(*typeStr != 0);
+    MeshCache::Entry mesh;
+    const MeshCache::Status stat = MeshCache::open(std::string(ASSET_DIR_COLL_MESHES)+"/"+path, &mesh);
+    if (stat != MeshCache::Status::Ok)
+        throw std::runtime_error{"Failed to load collision mesh: \""+path+'"'};
+    return std::shared_ptr<btCollisionShape>{createTriangleMeshCollShape(mesh.view())};
+}
+
+// Sphere, box or cylinder
+static btCollisionShape* createPrimitiveCollShape(const GameMap::ObjectDescr& descr)
+{
+    const glm::vec3& params = descr.collShapeParams;
+    switch (descr.collShapeType)
     {
-        char* c = typeStr;
-        while (*c != 0)
-            *c++ = tolower(*c);
+    case BinaryMap::CollShapeType::Sphere:
+        return new btSphereShape{params.x};
+    case BinaryMap::CollShapeType::Box:
+        return new btBoxShape{{params.x, params.y, params.z}};
+    case BinaryMap::CollShapeType::Cylinder:
+        return new btCylinderShape{{params.x, params.y, params.x}};
+    case BinaryMap::CollShapeType::None:
+    case BinaryMap::CollShapeType::Mesh:
+        break;
     }
+    assert(false);
+    return nullptr;
+}
 
-    btCollisionShape* collShape{};
+// The shapes are only described here, they are built by `GameMap::createCollShape()`
+static void parseCollShape(const cJSON* item, GameMap::ObjectDescr* descr)
+{
+    const cJSON* typeJson = cJSON_GetObjectItem(item, "type");
+    checkItemType<JsonType::String>(typeJson);
+    // Not lowercased in place, the items are shared between the loader threads
+    std::string typeStr = cJSON_GetStringValue(typeJson);
+    assert(!typeStr.empty());
+    for (char& c : typeStr)
+        c = tolower(c);
 
-    if (std::strcmp(typeStr, "sphere") == 0)
+    if (typeStr == "sphere")
     {
         const cJSON* radJson = cJSON_GetObjectItem(item, "radius");
         checkItemType<JsonType::Number>(radJson);
         const double rad = cJSON_GetNumberValue(radJson);
         checkNumNonNeg(rad);
 
-        collShape = new btSphereShape{(btScalar)rad};
+        descr->collShapeType = BinaryMap::CollShapeType::Sphere;
+        descr->collShapeParams = {(float)rad, 0.0f, 0.0f};
     }
-    else if (std::strcmp(typeStr, "box") == 0)
+    else if (typeStr == "box")
     {
         const cJSON* sizeJson = cJSON_GetObjectItem(item, "size");
         checkItemType<JsonType::Object>(sizeJson);
 
-        collShape = new btBoxShape{createVec3<btVector3>(sizeJson, false)};
+        descr->collShapeType = BinaryMap::CollShapeType::Box;
+        descr->collShapeParams = createVec3<glm::vec3>(sizeJson, false);
     }
-    else if (std::strcmp(typeStr, "cylinder") == 0)
+    else if (typeStr == "cylinder")
     {
         const cJSON* radJson = cJSON_GetObjectItem(item, "radius");
         checkItemType<JsonType::Number>(radJson);
@@ -224,30 +266,20 @@ static btCollisionShape* createCollShape(const cJSON* item)
         const double height = cJSON_GetNumberValue(heightJson);
         checkNumNonNeg(height);
 
-        collShape = new btCylinderShape{{rad, height, rad}};
+        descr->collShapeType = BinaryMap::CollShapeType::Cylinder;
+        descr->collShapeParams = {(float)rad, (float)height, 0.0f};
     }
-    else if (std::strcmp(typeStr, "mesh") == 0)
+    else if (typeStr == "mesh")
     {
         const cJSON* pathJson = cJSON_GetObjectItem(item, "path");
         checkItemType<JsonType::String>(pathJson);
-
-        // TODO: Use file cache
-
-        std::vector<float> verts, uvs, norms;
-        auto model = Model{};
-        const int stat = model.parseObjFile(
-                std::string(ASSET_DIR_COLL_MESHES)+"/"+cJSON_GetStringValue(pathJson),
-                &verts, &uvs, &norms);
-        assert(stat == 0);
-        collShape = createTriangleMeshCollShape(verts);
+        descr->collShapeType = BinaryMap::CollShapeType::Mesh;
+        descr->collMeshPath = cJSON_GetStringValue(pathJson);
     }
     else
     {
-        throw std::runtime_error{std::string("Invalid collision shape: \"")+typeStr+'"'};
+        throw std::runtime_error{"Invalid collision shape: \""+typeStr+'"'};
     }
-
-    free(typeStr);
-    return collShape;
 }
 
 static GameObject::flag_t createFlag(const cJSON* item)
@@ -256,6 +288,71 @@ static GameObject::flag_t createFlag(const cJSON* item)
     return GameObject::defaultFlags; // TODO
 }
 
+static std::unique_ptr<GameMap::ObjectDescr> createObjectDescr(const cJSON* obj)
+{
+    checkItemType<JsonType::Object>(obj);
+
+    auto newObj = std::make_unique<GameMap::ObjectDescr>();
+
+    if (const cJSON* nameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_NAME))
+    {
+        checkItemType<JsonType::String>(nameJson);
+        newObj->objName = cJSON_GetStringValue(nameJson);
+    }
+
+    {
+        const cJSON* modelNameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MODEL_NAME);
+        checkItemType<JsonType::String>(modelNameJson);
+        newObj->modelName = cJSON_GetStringValue(modelNameJson);
+    }
+
+    {
+        const cJSON* texNameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_TEX_NAME);
+        checkItemType<JsonType::String>(texNameJson);
+        newObj->textureName = cJSON_GetStringValue(texNameJson);
+    }
+
+    if (const cJSON* flagsJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_FLAGS))
+    {
+        checkItemType<JsonType::String>(flagsJson);
+        newObj->flags = createFlag(flagsJson);
+    }
+
+    {
+        const cJSON* posJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_POS);
+        checkItemType<JsonType::Object>(posJson);
+        newObj->pos = createVec3<glm::vec3>(posJson);
+    }
+
+    if (const cJSON* scaleJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_SCALE))
+    {
+        checkItemType<JsonType::Object>(scaleJson);
+        newObj->scale = createVec3<glm::vec3>(scaleJson, false);
+    }
+
+    if (const cJSON* modelRotJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MODEL_ROT))
+    {
+        checkItemType<JsonType::Object>(modelRotJson);
+        newObj->modelRotDeg = createVec3<glm::vec3>(modelRotJson, false);
+    }
+
+    if (const cJSON* collShapeJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_COLL_SHAPE))
+    {
+        checkItemType<JsonType::Object>(collShapeJson);
+        parseCollShape(collShapeJson, newObj.get());
+    }
+
+    if (const cJSON* massJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MASS))
+    {
+        checkItemType<JsonType::Number>(massJson);
+        // TODO: Support constant: STATIC
+        newObj->mass = cJSON_GetNumberValue(massJson);
+        checkNumNonNeg(newObj->mass);
+    }
+
+    return newObj;
+}
+
 static std::string readFile(const std::string& path)
 {
     std::fstream file;
@@ -297,12 +394,81 @@ static std::string mapFormatVerToStr(const GameMap::MapFormatVer& val)
     return std::to_string(val.major) + '.' + std::to_string(val.minor);
 }
 
-GameMap::GameMap(const std::string& path)
+template <typename F>
+void GameMap::forEachChunk(size_t count, F&& func)
+{
+    const size_t chunkCount = (m_pool ? m_pool->getThreadCount()*MAP_LOAD_CHUNKS_PER_THREAD : 1);
+    const size_t chunkSize = std::max<size_t>(MAP_LOAD_MIN_CHUNK_SIZE, (count+chunkCount-1)/chunkCount);
+
+    std::vector<std::future<void>> chunks;
+    for (size_t first{}; first < count; first += chunkSize)
+    {
+        const size_t end = std::min(first+chunkSize, count);
+        if (m_pool)
+            chunks.push_back(m_pool->submit([&func, first, end](){ func(first, end); }));
+        else
+            func(first, end);
+    }
+    // The chunks reference the caller's data, let all of them finish before rethrowing an error
+    for (auto& chunk : chunks)
+        chunk.wait();
+    for (auto& chunk : chunks)
+        chunk.get();
+}
+
+GameMap::GameMap(const std::string& path, ThreadPool* pool/*=nullptr*/, bool preferBaked/*=true*/)
+    : m_pool{pool}
 {
     Logger::log << "Loading map: \"" << path << '"' << Logger::End;
 
+    if (std::filesystem::path{path}.extension() == ".emap")
+    {
+        loadBinary(path);
+    }
+    else
+    {
+        // Prefer the version converted by `mapconv`
+        const std::string bakedPath = BinaryMap::getBakedPath(path);
+        std::error_code ec;
+        if (preferBaked
+         && std::filesystem::exists(bakedPath, ec)
+         && std::filesystem::last_write_time(bakedPath, ec) >= std::filesystem::last_write_time(path, ec)
+         && !ec)
+        {
+            try
+            {
+                loadBinary(bakedPath);
+            }
+            catch (const std::runtime_error& e)
+            {
+                Logger::warn << e.what() << ", falling back to the JSON map" << Logger::End;
+                m_objects.clear();
+                loadJson(path);
+            }
+        }
+        else
+        {
+            loadJson(path);
+        }
+    }
+
+    Logger::log << "Loaded map" << Logger::End;
+    LOGGER_VERB << "----- Map info -----" << '\n';
+    LOGGER_VERB << '\n' << "Name: " << m_name;
+    LOGGER_VERB << '\n' << "Description: " << m_descr;
+    LOGGER_VERB << '\n' << "Author: " << m_author;
+    LOGGER_VERB << '\n' << "Map format version: " << mapFormatVerToStr(m_mapFormatVer);
+    LOGGER_VERB << '\n' << "Number of objects: " << m_objects.size();
+    LOGGER_VERB << Logger::End;
+}
+
+void GameMap::loadJson(const std::string& path)
+{
+    const auto readStart = steadyClock_t::now();
     const std::string fileContent = readFile(path);
     const char* fileContentPtr = fileContent.c_str();
+    const auto readEnd = steadyClock_t::now();
+    m_timings.readMs = msBetween(readStart, readEnd);
 
     cJSON* json = cJSON_Parse(fileContentPtr);
     if (!json)
@@ -310,6 +476,8 @@ GameMap::GameMap(const std::string& path)
         printParseErr(fileContent, cJSON_GetErrorPtr()-fileContentPtr);
         throw std::runtime_error{"Error in map file"};
     }
+    const auto parseEnd = steadyClock_t::now();
+    m_timings.parseMs = msBetween(readEnd, parseEnd);
 
     if (!cJSON_IsObject(json))
     {
@@ -343,81 +511,111 @@ GameMap::GameMap(const std::string& path)
 
     const cJSON* objs = cJSON_GetObjectItem(json, MAP_KEY_OBJS);
     checkItemType<JsonType::Array>(objs);
-    Logger::verb << "\"" MAP_KEY_OBJS "\" array length: "+std::to_string(cJSON_GetArraySize(objs)) << Logger::End;
+    LOGGER_VERB << "\"" MAP_KEY_OBJS "\" array length: "+std::to_string(cJSON_GetArraySize(objs)) << Logger::End;
+    std::vector<const cJSON*> objItems;
+    objItems.reserve(cJSON_GetArraySize(objs));
     const cJSON* obj{};
     cJSON_ArrayForEach(obj, objs)
-    {
-        checkItemType<JsonType::Object>(obj);
-
-        ObjectDescr* newObj = new ObjectDescr{}; // Do not free, it will be moved to a smart ptr
-
-        if (const cJSON* nameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_NAME))
-        {
-            checkItemType<JsonType::String>(nameJson);
-            newObj->objName = cJSON_GetStringValue(nameJson);
-        }
-
-        {
-            const cJSON* modelNameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MODEL_NAME);
-            checkItemType<JsonType::String>(modelNameJson);
-            newObj->modelName = cJSON_GetStringValue(modelNameJson);
-        }
+        objItems.push_back(obj);
 
-        {
-            const cJSON* texNameJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_TEX_NAME);
-            checkItemType<JsonType::String>(texNameJson);
-            newObj->textureName = cJSON_GetStringValue(texNameJson);
-        }
+    m_objects.resize(objItems.size());
+    forEachChunk(objItems.size(), [this, &objItems](size_t first, size_t end){
+        for (size_t i = first; i < end; ++i)
+            m_objects[i] = createObjectDescr(objItems[i]);
+    });
+    m_timings.objectsMs = msBetween(parseEnd, steadyClock_t::now());
 
-        if (const cJSON* flagsJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_FLAGS))
-        {
-            checkItemType<JsonType::String>(flagsJson);
-            newObj->flags = createFlag(flagsJson);
-        }
-
-        {
-            const cJSON* posJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_POS);
-            checkItemType<JsonType::Object>(posJson);
-            newObj->pos = createVec3<glm::vec3>(posJson);
-        }
-
-        if (const cJSON* scaleJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_SCALE))
-        {
-            checkItemType<JsonType::Object>(scaleJson);
-            newObj->scale = createVec3<glm::vec3>(scaleJson, false);
-        }
-
-        if (const cJSON* modelRotJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MODEL_ROT))
-        {
-            checkItemType<JsonType::Object>(modelRotJson);
-            newObj->modelRotDeg = createVec3<glm::vec3>(modelRotJson, false);
-        }
+    cJSON_Delete(json);
+}
 
-        if (const cJSON* collShapeJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_COLL_SHAPE))
+void GameMap::loadBinary(const std::string& path)
+{
+    const auto readStart = steadyClock_t::now();
+    MappedFile file;
+    if (file.open(path))
+        throw std::runtime_error{"Failed to open binary map: \""+path+'"'};
+    const auto readEnd = steadyClock_t::now();
+    m_timings.readMs = msBetween(readStart, readEnd);
+
+    BinaryMap::View view;
+    if (BinaryMap::parse(file.view(), &view))
+        throw std::runtime_error{"Invalid binary map: \""+path+'"'};
+    const auto parseEnd = steadyClock_t::now();
+    m_timings.parseMs = msBetween(readEnd, parseEnd);
+
+    const BinaryMap::FileHeader& header = *view.header;
+    m_name = view.getString(header.name);
+    m_descr = view.getString(header.descr);
+    m_author = view.getString(header.author);
+    m_mapFormatVer = {.major = header.mapFormatMajor, .minor = header.mapFormatMinor};
+
+    m_objects.resize(header.objectCount);
+    forEachChunk(header.objectCount, [this, &view](size_t first, size_t end){
+        for (size_t i = first; i < end; ++i)
         {
-            checkItemType<JsonType::Object>(collShapeJson);
-            newObj->collShape.reset(createCollShape(collShapeJson));
+            const BinaryMap::ObjectRecord& record = view.objects[i];
+            auto descr = std::make_unique<ObjectDescr>();
+            descr->objName = view.getString(record.name);
+            descr->modelName = view.getString(record.modelName);
+            descr->textureName = view.getString(record.textureName);
+            descr->flags = record.flags;
+            descr->pos = {record.pos[0], record.pos[1], record.pos[2]};
+            descr->scale = {record.scale[0], record.scale[1], record.scale[2]};
+            descr->modelRotDeg = {record.modelRotDeg[0], record.modelRotDeg[1], record.modelRotDeg[2]};
+            descr->collShapeType = record.collShapeType;
+            descr->collShapeParams = {record.collShapeParams[0], record.collShapeParams[1], record.collShapeParams[2]};
+            descr->collMeshPath = view.getString(record.collMeshPath);
+            descr->mass = record.mass;
+            m_objects[i] = std::move(descr);
         }
+    });
+    m_timings.objectsMs = msBetween(parseEnd, steadyClock_t::now());
+}
 
-        if (const cJSON* massJson = cJSON_GetObjectItem(obj, MAP_KEY_OBJ_MASS))
+int GameMap::writeBinary(const std::string& path) const
+{
+    BinaryMap::StringTableBuilder strings;
+    BinaryMap::FileHeader header{};
+    header.mapFormatMajor = m_mapFormatVer.major;
+    header.mapFormatMinor = m_mapFormatVer.minor;
+    header.name = strings.add(m_name);
+    header.descr = strings.add(m_descr);
+    header.author = strings.add(m_author);
+
+    std::vector<BinaryMap::ObjectRecord> records;
+    records.reserve(m_objects.size());
+    for (const auto& descr : m_objects)
+    {
+        BinaryMap::ObjectRecord record{};
+        record.name = strings.add(descr->objName);
+        record.modelName = strings.add(descr->modelName);
+        record.textureName = strings.add(descr->textureName);
+        record.flags = descr->flags;
+        for (int i{}; i < 3; ++i)
         {
-            checkItemType<JsonType::Number>(massJson);
-            // TODO: Support constant: STATIC
-            newObj->mass = cJSON_GetNumberValue(massJson);
-            checkNumNonNeg(newObj->mass);
+            record.pos[i] = descr->pos[i];
+            record.scale[i] = descr->scale[i];
+            record.modelRotDeg[i] = descr->modelRotDeg[i];
+            record.collShapeParams[i] = descr->collShapeParams[i];
         }
-
-        m_objects.emplace_back(newObj);
+        record.mass = descr->mass;
+        record.collShapeType = descr->collShapeType;
+        record.collMeshPath = strings.add(descr->collMeshPath);
+        records.push_back(record);
     }
 
-    cJSON_free(json);
+    return BinaryMap::write(path, header, records, strings);
+}
 
-    Logger::log << "Loaded map" << Logger::End;
-    Logger::verb << "----- Map info -----" << '\n';
-    Logger::verb << '\n' << "Name: " << m_name;
-    Logger::verb << '\n' << "Description: " << m_descr;
-    Logger::verb << '\n' << "Author: " << m_author;
-    Logger::verb << '\n' << "Map format version: " << mapFormatVerToStr(m_mapFormatVer);
-    Logger::verb << '\n' << "Number of objects: " << m_objects.size();
-    Logger::verb << Logger::End;
+std::shared_ptr<btCollisionShape> GameMap::createCollShape(const ObjectDescr& descr)
+{
+    switch (descr.collShapeType)
+    {
+    case BinaryMap::CollShapeType::None:
+        return nullptr;
+    case BinaryMap::CollShapeType::Mesh:
+        return createCollMeshShape(descr.collMeshPath);
+    default:
+        return std::shared_ptr<btCollisionShape>{createPrimitiveCollShape(descr)};
+    }
 }
@@ -3,9 +3,18 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <future>
+#include <chrono>
 #include <glm/vec3.hpp>
 #include <bullet/BulletCollision/btBulletCollisionCommon.h>
 #include "GameObject.h"
+#include "ThreadPool.h"
+#include "BinaryMap.h"
+
+// Objects are parsed in chunks of at least this many objects
+#define MAP_LOAD_MIN_CHUNK_SIZE 256
+// The objects are split into this many chunks per worker thread, to even out the load
+#define MAP_LOAD_CHUNKS_PER_THREAD 4
 
 class GameMap final
 {
@@ -27,11 +36,22 @@ public:
         glm::vec3               scale{1.0f, 1.0f, 1.0f};
         glm::vec3               modelRotDeg{0.0f, 0.0f, 0.0f};
 
-        std::unique_ptr<btCollisionShape> collShape;
+        BinaryMap::CollShapeType collShapeType = BinaryMap::CollShapeType::None;
+        glm::vec3               collShapeParams{}; // See `BinaryMap::CollShapeType`
+        std::string             collMeshPath; // If the shape is a mesh
         btScalar                mass = 0.0f;
     };
     using objectList_t = std::vector<std::unique_ptr<ObjectDescr>>;
 
+    // Durations of the stages of the loading, in milliseconds
+    struct LoadTimings
+    {
+        double readMs{};
+        double parseMs{};
+        // Converting the JSON objects to descriptors, in parallel
+        double objectsMs{};
+    };
+
 private:
     std::string m_name; // Required
     std::string m_descr = "N/A";
@@ -41,8 +61,56 @@ private:
 
     objectList_t m_objects; // Required
 
+    ThreadPool* m_pool{};
+
+    LoadTimings m_timings;
+
+    // Calls `func(first, end)` for ranges of `[0, count)` on the pool and waits for them
+    template <typename F>
+    void forEachChunk(size_t count, F&& func);
+    void loadJson(const std::string& path);
+    // Reads the records of the mapped file into the descriptors
+    void loadBinary(const std::string& path);
+
 public:
-    GameMap(const std::string& path);
+    /*
+     * Loads a JSON (.json) or a binary (.emap) map. The objects are read on the pool.
+     *
+     * pool: The threads to load on. If null, everything is done on the calling thread.
+     * preferBaked: For JSON maps, load the binary map converted from it instead,
+     *              if it is up to date.
+     *
+     * Throws `std::runtime_error` if the map is invalid.
+     */
+    GameMap(const std::string& path, ThreadPool* pool=nullptr, bool preferBaked=true);
+
+    // Copy ctor, copy assignment op
+    GameMap(const GameMap&) = delete;
+    GameMap& operator=(const GameMap&) = delete;
+    // Move ctor, move assignment op
+    GameMap(GameMap&&) = delete;
+    GameMap& operator=(GameMap&&) = delete;
 
     inline const objectList_t& getObjects() const { return m_objects; }
+
+    /*
+     * Writes the map in the binary format.
+     *
+     * Returns:
+     *      1 if failed,
+     *      0 otherwise
+     */
+    int writeBinary(const std::string& path) const;
+
+    inline const LoadTimings& getTimings() const { return m_timings; }
+
+    /*
+     * Builds the collision shape of a single object, loading its mesh if it has one.
+     * Does not touch the map, so it can be called from any thread.
+     *
+     * Returns: The shape, or null if the object has none
+     *
+     * Throws `std::runtime_error` if the mesh failed to load.
+     */
+    static std::shared_ptr<btCollisionShape> createCollShape(const ObjectDescr& descr);
 };
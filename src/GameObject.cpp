@@ -3,11 +3,14 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+std::shared_ptr<Texture> GameObject::s_placeholderTexture;
+TransformStore GameObject::s_transforms;
+
 GameObject::GameObject(
         std::shared_ptr<Model> model,
         const glm::vec3& modelRotRad,
         std::shared_ptr<Texture> texture,
-        std::unique_ptr<btCollisionShape> collShape,
+        std::shared_ptr<btCollisionShape> collShape,
         btScalar mass,
         const std::string& objectName/*="Object"*/,
         flag_t flags/*=defaultFlags*/
@@ -19,56 +22,73 @@ GameObject::GameObject(
     , m_mass{mass}
     , m_name{objectName}
     , m_flags{flags}
-    , m_pos{}
     , m_rot{1.0f, 0.0f, 0.0f, 0.0f}
-    , m_scale{1.0f, 1.0f, 1.0f}
-    , m_modelMatrix{glm::translate(glm::mat4{1.0f}, m_pos)}
+    , m_transform{s_transforms.create()}
 {
     m_mRot = glm::rotate(m_mRot, modelRotRad.x, {1.0f, 0.0f, 0.0f});
     m_mRot = glm::rotate(m_mRot, modelRotRad.y, {0.0f, 1.0f, 0.0f});
     m_mRot = glm::rotate(m_mRot, modelRotRad.z, {0.0f, 0.0f, 1.0f});
-    Logger::verb << "Created an GameObject (addr=" << this << ", name=" << m_name << ")" << Logger::End;
+    LOGGER_VERB << "Created an GameObject (addr=" << this << ", name=" << m_name << ")" << Logger::End;
+
+    updateRotation();
+}
+
+void GameObject::updateRotation()
+{
+    const glm::quat rot = m_rot * m_mRot;
+    s_transforms.setRotation(m_transform, rot.x, rot.y, rot.z, rot.w);
+    m_isBvhProxyDirty = true;
+}
 
-    recalcModelMat();
+glm::vec3 GameObject::getPos() const
+{
+    glm::vec3 pos;
+    s_transforms.getPosition(m_transform, &pos.x, &pos.y, &pos.z);
+    return pos;
 }
 
-void GameObject::recalcModelMat()
+glm::vec3 GameObject::getScale() const
 {
-    const glm::mat4 trans = glm::translate(glm::mat4{1.0}, m_pos);
-    const glm::mat4 rot = glm::mat4_cast(m_rot);
-    const glm::mat4 mrot = glm::mat4_cast(m_mRot);
-    const glm::mat4 scale = glm::scale(glm::mat4(1.0), m_scale);
-    m_modelMatrix = trans * rot * mrot * scale;
+    glm::vec3 scale;
+    s_transforms.getScale(m_transform, &scale.x, &scale.y, &scale.z);
+    return scale;
 }
 
 void GameObject::translate(const glm::vec3& vec)
 {
-    m_pos += vec;
-    recalcModelMat();
+    setPos(getPos()+vec);
 }
 
 void GameObject::rotate(float angleRad, const glm::vec3& axis)
 {
     m_rot = glm::rotate(m_rot, angleRad, axis);
-    recalcModelMat();
+    updateRotation();
 }
 
 void GameObject::scale(const glm::vec3& scale)
 {
-    m_scale *= scale;
-    recalcModelMat();
+    const glm::vec3 newScale = getScale()*scale;
+    s_transforms.setScale(m_transform, newScale.x, newScale.y, newScale.z);
+    m_isBvhProxyDirty = true;
 }
 
 void GameObject::setPos(const glm::vec3& pos)
 {
-    m_pos = pos;
-    recalcModelMat();
+    s_transforms.setPosition(m_transform, pos.x, pos.y, pos.z);
+    m_isBvhProxyDirty = true;
 }
 
 void GameObject::setRotationQuat(const glm::quat& quat)
 {
     m_rot = quat;
-    recalcModelMat();
+    updateRotation();
+}
+
+void GameObject::setPosAndRotation(const glm::vec3& pos, const glm::quat& quat)
+{
+    m_rot = quat;
+    updateRotation();
+    s_transforms.setPosition(m_transform, pos.x, pos.y, pos.z);
 }
 
 void GameObject::setTextureWrapMode(int horizontalWrapMode, int verticalWrapMode)
@@ -76,15 +96,73 @@ void GameObject::setTextureWrapMode(int horizontalWrapMode, int verticalWrapMode
     m_texture->setWrapMode(horizontalWrapMode, verticalWrapMode);
 }
 
-size_t GameObject::draw(unsigned int shaderId)
+void GameObject::updateBvhProxy(DynamicBvh* bvh)
+{
+    if (!m_isBvhProxyDirty && m_bvhProxy != DynamicBvh::nullNode
+     && m_bvhModelGeneration == m_model->getGeneration())
+        return;
+    if (m_model->getState() != Model::State::Ok) // Still loading
+        return;
+
+    if (m_bvhProxy == DynamicBvh::nullNode)
+        m_bvhProxy = bvh->createProxy(getWorldAabb(), this);
+    else
+        bvh->moveProxy(m_bvhProxy, getWorldAabb());
+    m_isBvhProxyDirty = false;
+    m_bvhModelGeneration = m_model->getGeneration();
+}
+
+void GameObject::removeBvhProxy(DynamicBvh* bvh)
+{
+    if (m_bvhProxy == DynamicBvh::nullNode)
+        return;
+    bvh->destroyProxy(m_bvhProxy);
+    m_bvhProxy = DynamicBvh::nullNode;
+    m_isBvhProxyDirty = true;
+}
+
+size_t GameObject::draw(ShaderProgram* shader, ShaderProgram::UniformHandle<glm::mat4> modelMatUniform,
+        ShaderProgram::UniformHandle<int> isTexUpsideDownUniform)
 {
     if ((m_flags & FLAG_VISIBLE) == 0)
         return 0;
+    if (m_model->getState() != Model::State::Ok) // Still loading
+        return 0;
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderId, "modelMat"), 1, GL_FALSE, glm::value_ptr(m_modelMatrix));
+    shader->setUniform(modelMatUniform, getModelMatrix());
 
-    m_texture->bind();
+    Texture* texture = (m_texture->getState() == Texture::State::Ok ? m_texture.get() : s_placeholderTexture.get());
+    if (texture)
+    {
+        texture->bind();
+        shader->setUniform(isTexUpsideDownUniform, (int)texture->isUpsideDown());
+    }
     m_model->draw();
 
-    return m_model->getVertCount();
+    return m_model->getDrawnVertCount();
+}
+
+size_t GameObject::enqueueDraw(RenderQueue* queue, ShaderProgram* shader,
+        ShaderProgram::UniformHandle<int> isTexUpsideDownUniform)
+{
+    if ((m_flags & FLAG_VISIBLE) == 0)
+        return 0;
+    if (m_model->getState() != Model::State::Ok) // Still loading
+        return 0;
+
+    Texture* texture = m_texture.get();
+    if (texture->getState() != Texture::State::Ok)
+    {
+        if (!s_placeholderTexture)
+            return 0;
+        texture = s_placeholderTexture.get();
+    }
+    queue->submit(shader, isTexUpsideDownUniform, m_model.get(), texture, getModelMatrix());
+
+    return m_model->getDrawnVertCount();
+}
+
+GameObject::~GameObject()
+{
+    s_transforms.destroy(m_transform);
 }
@@ -8,9 +8,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <bullet/BulletCollision/btBulletCollisionCommon.h>
 #include "Model.h"
 #include "Texture.h"
+#include "ShaderProgram.h"
+#include "RenderQueue.h"
+#include "DynamicBvh.h"
+#include "TransformStore.h"
+
+class btRigidBody;
 
 class GameObject
 {
@@ -26,18 +33,33 @@ protected:
     glm::quat m_mRot; // Model rotation
     std::shared_ptr<Texture> m_texture;
 
-    std::unique_ptr<btCollisionShape> m_collShape{};
+    std::shared_ptr<btCollisionShape> m_collShape{};
     btScalar m_mass{};
 
     std::string m_name;
     flag_t m_flags{};
 
-    glm::vec3 m_pos;
     glm::quat m_rot;
-    glm::vec3 m_scale;
-    glm::mat4 m_modelMatrix;
+    // Position, rotation (`m_rot` * `m_mRot`), scale and model matrix in `s_transforms`
+    TransformStore::handle_t m_transform;
+
+    // The body of the object, owned by the `PhysicsWorld` it was added to
+    btRigidBody* m_body{};
+
+    // The proxy of the object in the culling BVH, `DynamicBvh::nullNode` if not added yet
+    int m_bvhProxy{DynamicBvh::nullNode};
+    // Set when the object moved since the last `updateBvhProxy()`
+    bool m_isBvhProxyDirty{true};
+    // `Model::getGeneration()` at the last `updateBvhProxy()`, the bounds change when the model is reloaded
+    uint32_t m_bvhModelGeneration{};
 
-    void recalcModelMat();
+    // Pushes the rotation to the transform store
+    void updateRotation();
+
+    // Drawn in place of textures that are still loading
+    static std::shared_ptr<Texture> s_placeholderTexture;
+    // The transforms of every object, the model matrices are recomputed in `updateTransforms()`
+    static TransformStore s_transforms;
 
     friend class PhysicsWorld;
 
@@ -46,7 +68,7 @@ public:
             std::shared_ptr<Model> model,
             const glm::vec3& modelRotRad,
             std::shared_ptr<Texture> texture,
-            std::unique_ptr<btCollisionShape> collShape,
+            std::shared_ptr<btCollisionShape> collShape,
             btScalar mass,
             const std::string& objectName="<Object>",
             flag_t flags=defaultFlags);
@@ -56,6 +78,7 @@ public:
     // Move ctor, move assignment op
     GameObject(GameObject&&) = delete;
     GameObject& operator=(GameObject&&) = delete;
+    ~GameObject();
 
     inline flag_t getFlags() const { return m_flags; }
     inline flag_t& getFlags() { return m_flags; }
@@ -67,10 +90,57 @@ public:
 
     void setPos(const glm::vec3& pos);
     void setRotationQuat(const glm::quat& quat);
+    // Sets both at once, the physics writes back through this
+    void setPosAndRotation(const glm::vec3& pos, const glm::quat& quat);
+
+    glm::vec3 getPos() const;
+    glm::vec3 getScale() const;
+    // The model matrix as of the last `updateTransforms()`
+    inline glm::mat4 getModelMatrix() const { return glm::make_mat4(s_transforms.getMatrix(m_transform)); }
 
     void setTextureWrapMode(int horizontalWrapMode, int verticalWrapMode);
 
-    // Returns: The number of vertices drawn
-    size_t draw(unsigned int shaderId);
+    // The bounding box of the object in world space. The model must be at least loading.
+    inline Aabb getWorldAabb() const { return m_model->getLocalAabb().transformed(getModelMatrix()); }
+    /*
+     * Adds the object to the BVH when its model finished loading,
+     * and updates its box if the object moved since the last call.
+     */
+    void updateBvhProxy(DynamicBvh* bvh);
+    // Removes the object from the BVH, if it was added
+    void removeBvhProxy(DynamicBvh* bvh);
+
+    static inline void setPlaceholderTexture(std::shared_ptr<Texture> texture) { s_placeholderTexture = texture; }
+
+    /*
+     * Recomputes the model matrices of the objects that moved since the last call.
+     * Call once per frame, before the matrices are used.
+     *
+     * Returns: The number of updated matrices
+     */
+    static inline size_t updateTransforms() { return s_transforms.update(); }
+
+    /*
+     * Draws the object. Objects with a model that is not loaded yet are skipped,
+     * textures that are not loaded yet are replaced with the placeholder texture.
+     *
+     * modelMatUniform: The `modelMat` uniform of the shader, which must be in use
+     * isTexUpsideDownUniform: The `isTexUpsideDown` uniform of the shader
+     *
+     * Returns: The number of vertices drawn
+     */
+    size_t draw(ShaderProgram* shader, ShaderProgram::UniformHandle<glm::mat4> modelMatUniform,
+            ShaderProgram::UniformHandle<int> isTexUpsideDownUniform);
+
+    /*
+     * Queues the object to be drawn instanced, together with the
+     * objects that share its model and texture. Skips the same objects as `draw()`.
+     *
+     * isTexUpsideDownUniform: The `isTexUpsideDown` uniform of the shader
+     *
+     * Returns: The number of vertices that will be drawn
+     */
+    size_t enqueueDraw(RenderQueue* queue, ShaderProgram* shader,
+            ShaderProgram::UniformHandle<int> isTexUpsideDownUniform);
 };
 
@@ -1,4 +1,10 @@
 #include "Logger.h"
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <cstdint>
 
 namespace Logger
 {
@@ -8,4 +14,234 @@ Logger log{Logger::Type::Log};
 Logger warn{Logger::Type::Warning};
 Logger err{Logger::Type::Error};
 
+static constexpr size_t typeCount = 4;
+
+// Appends the formatted values to a string
+class LineBuffer final : public std::streambuf
+{
+public:
+    std::string text;
+
+protected:
+    virtual int_type overflow(int_type ch)
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+            text.push_back(traits_type::to_char_type(ch));
+        return traits_type::not_eof(ch);
+    }
+
+    virtual std::streamsize xsputn(const char* str, std::streamsize count)
+    {
+        text.append(str, count);
+        return count;
+    }
+};
+
+// The lines a thread is writing, one per logger type
+struct ThreadLines
+{
+    struct Line
+    {
+        LineBuffer buffer;
+        std::ostream stream{&buffer};
+    };
+    Line lines[typeCount];
+};
+static thread_local ThreadLines t_lines;
+
+struct QueuedLine
+{
+    Logger::Type type{};
+    std::string text;
+    QueuedLine* next{};
+};
+
+static void appendLine(Logger::Type type, const std::string& text, std::string* output)
+{
+    // An empty line is written without the "initial"
+    if (!text.empty())
+    {
+        switch (type)
+        {
+#if LOGGER_USE_COLORS
+        case Logger::Type::Verbose: *output += LOGGER_COLOR_VERB "[VERBOSE]: " LOGGER_COLOR_RESET; break;
+        case Logger::Type::Log:     *output += LOGGER_COLOR_LOG "[INFO]: " LOGGER_COLOR_RESET; break;
+        case Logger::Type::Warning: *output += LOGGER_COLOR_WARN "[WARN]: " LOGGER_COLOR_RESET; break;
+        case Logger::Type::Error:   *output += LOGGER_COLOR_ERR "[ERR]: " LOGGER_COLOR_RESET; break;
+#else
+        case Logger::Type::Verbose: *output += "[VERBOSE]: "; break;
+        case Logger::Type::Log:     *output += "[INFO]: "; break;
+        case Logger::Type::Warning: *output += "[WARN]: "; break;
+        case Logger::Type::Error:   *output += "[ERR]: "; break;
+#endif
+        }
+    }
+    *output += text;
+    *output += '\n';
+}
+
+/*
+ * Writes the queued lines on a background thread.
+ *
+ * The lines are pushed to a lock-free list (newest first). The thread takes
+ * the whole list at once, reverses it and writes it with one call.
+ */
+class LineWriter final
+{
+private:
+    std::atomic<QueuedLine*> m_head{};
+    // Lines pushed and written so far, for `flush()`
+    std::atomic<uint64_t> m_pushedCount{};
+    std::atomic<uint64_t> m_writtenCount{};
+    // Pushed by the destructor to stop the thread after the lines before it
+    QueuedLine m_stopMarker;
+    std::thread m_thread;
+
+    void threadLoop()
+    {
+        std::string output;
+        while (true)
+        {
+            QueuedLine* line = m_head.exchange(nullptr, std::memory_order_acquire);
+            if (!line)
+            {
+                m_head.wait(nullptr, std::memory_order_acquire);
+                continue;
+            }
+
+            // Oldest first
+            QueuedLine* oldest{};
+            while (line)
+            {
+                QueuedLine* next = line->next;
+                line->next = oldest;
+                oldest = line;
+                line = next;
+            }
+
+            bool shouldStop = false;
+            uint64_t lineCount{};
+            output.clear();
+            for (line = oldest; line;)
+            {
+                QueuedLine* next = line->next;
+                if (line == &m_stopMarker)
+                {
+                    shouldStop = true;
+                }
+                else
+                {
+                    appendLine(line->type, line->text, &output);
+                    ++lineCount;
+                    delete line;
+                }
+                line = next;
+            }
+            std::cout.write(output.data(), output.size());
+            std::cout.flush();
+
+            m_writtenCount.fetch_add(lineCount, std::memory_order_release);
+            m_writtenCount.notify_all();
+            if (shouldStop)
+                return;
+        }
+    }
+
+    void pushLine(QueuedLine* line)
+    {
+        // The line belongs to the thread once it is in the list, don't touch it after
+        QueuedLine* head = m_head.load(std::memory_order_relaxed);
+        do
+            line->next = head;
+        while (!m_head.compare_exchange_weak(head, line, std::memory_order_release, std::memory_order_relaxed));
+        // The thread only waits when the list is empty
+        if (!head)
+            m_head.notify_one();
+    }
+
+public:
+    LineWriter()
+        : m_thread{&LineWriter::threadLoop, this}
+    {
+    }
+
+    // Copy ctor, copy assignment op
+    LineWriter(const LineWriter&) = delete;
+    LineWriter& operator=(const LineWriter&) = delete;
+    // Move ctor, move assignment op
+    LineWriter(LineWriter&&) = delete;
+    LineWriter& operator=(LineWriter&&) = delete;
+
+    void push(Logger::Type type, std::string text)
+    {
+        // Counted before it is visible to the thread, so `flush()` never returns early
+        m_pushedCount.fetch_add(1, std::memory_order_relaxed);
+        pushLine(new QueuedLine{type, std::move(text)});
+    }
+
+    void flush()
+    {
+        const uint64_t target = m_pushedCount.load(std::memory_order_relaxed);
+        uint64_t written;
+        while ((written = m_writtenCount.load(std::memory_order_acquire)) < target)
+            m_writtenCount.wait(written, std::memory_order_acquire);
+    }
+
+    // Writes the queued lines and stops the thread
+    ~LineWriter()
+    {
+        pushLine(&m_stopMarker);
+        m_thread.join();
+    }
+};
+
+// Set when the writer is destroyed at exit, the later lines are written directly
+static std::atomic<bool> s_isWriterDestroyed{};
+static std::mutex s_directWriteMutex;
+
+static LineWriter* getWriter()
+{
+    struct WriterHolder
+    {
+        LineWriter writer;
+        ~WriterHolder() { s_isWriterDestroyed = true; }
+    };
+    // Created on first use, so the loggers work during static initialization
+    static WriterHolder holder;
+    return s_isWriterDestroyed ? nullptr : &holder.writer;
+}
+
+std::ostream& Logger::_getLineStream(Type type)
+{
+    return t_lines.lines[(size_t)type].stream;
+}
+
+void Logger::_endLine(Type type)
+{
+    std::string& text = t_lines.lines[(size_t)type].buffer.text;
+    LineWriter* writer = getWriter();
+    if (writer)
+    {
+        writer->push(type, std::move(text));
+        // Make sure the error is visible even if the program aborts right after it
+        if (type == Type::Error)
+            writer->flush();
+    }
+    else
+    {
+        std::string output;
+        appendLine(type, text, &output);
+        std::lock_guard<std::mutex> lock{s_directWriteMutex};
+        std::cout.write(output.data(), output.size());
+        std::cout.flush();
+    }
+    text.clear();
+}
+
+void Logger::flush()
+{
+    if (LineWriter* writer = getWriter())
+        writer->flush();
+}
+
 } // End of namespace Logger
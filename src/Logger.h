@@ -1,6 +1,7 @@
 #pragma once
 
-#include <iostream>
+#include <ostream>
+#include <atomic>
 
 #define LOGGER_USE_COLORS 1
 #define LOGGER_ALLOW_VERBOSE 1
@@ -22,6 +23,14 @@ enum Control
     End, // Can be used to mark the end of the line
 };
 
+/*
+ * Writes the lines to the standard output.
+ *
+ * The values are formatted into a buffer of the calling thread. `End` queues the
+ * finished line for a background thread, which writes the queued lines in batches.
+ * It is safe to use from any thread. Errors are written before `End` returns,
+ * so they are not lost if the program aborts after logging them.
+ */
 class Logger final
 {
 public:
@@ -37,17 +46,40 @@ public:
     };
 
 private:
-    // Whether this is the beginning of the line
-    bool m_isBeginning{true};
     // The logger type: info, error, etc.
     Type m_type{};
 
+    // Lines of a lower type are dropped before formatting
+#if LOGGER_ALLOW_VERBOSE
+    static inline std::atomic<Type> s_minLevel{Type::Verbose};
+#else
+    static inline std::atomic<Type> s_minLevel{Type::Log};
+#endif
+
+    // Returns the stream of the line the calling thread is writing with the logger type
+    static std::ostream& _getLineStream(Type type);
+    // Queues the line of the calling thread for the writer thread
+    static void _endLine(Type type);
+
 public:
     Logger(Type type)
         : m_type{type}
     {
     }
 
+    // Whether the lines of this logger are written, see `setMinLevel()`
+    inline bool isEnabled() const { return m_type >= s_minLevel.load(std::memory_order_relaxed); }
+
+    /*
+     * Drops the lines of the loggers below `level`. Disabled loggers don't format their values.
+     * Changing it while a thread is in the middle of a line may drop or cut that line.
+     */
+    static inline void setMinLevel(Type level) { s_minLevel.store(level, std::memory_order_relaxed); }
+    static inline Type getMinLevel() { return s_minLevel.load(std::memory_order_relaxed); }
+
+    // Blocks until the lines queued so far are written
+    static void flush();
+
     template <typename T>
     Logger& operator<<(const T &value)
     {
@@ -55,49 +87,10 @@ public:
         if (m_type == Type::Verbose)
             return *this;
 #endif
-        // If this is the beginning of the line, print the "initial"
-        // depending on the logger type
-        if (m_isBeginning)
-        {
-            switch (m_type)
-            {
-            case Type::Verbose:
-#if LOGGER_USE_COLORS
-                std::cout << LOGGER_COLOR_VERB << "[VERBOSE]: " << LOGGER_COLOR_RESET;
-#else
-                std::cout << "[VERBOSE]: ";
-#endif
-                break;
-
-            case Type::Log:
-#if LOGGER_USE_COLORS
-                std::cout << LOGGER_COLOR_LOG << "[INFO]: " << LOGGER_COLOR_RESET;
-#else
-                std::cout << "[INFO]: ";
-#endif
-                break;
-
-            case Type::Warning:
-#if LOGGER_USE_COLORS
-                std::cout << LOGGER_COLOR_WARN << "[WARN]: " << LOGGER_COLOR_RESET;
-#else
-                std::cout << "[WARN]: ";
-#endif
-                break;
-
-            case Type::Error:
-#if LOGGER_USE_COLORS
-                std::cout << LOGGER_COLOR_ERR << "[ERR]: " << LOGGER_COLOR_RESET;
-#else
-                std::cout << "[ERR]: ";
-#endif
-                break;
-            }
+        if (!isEnabled())
+            return *this;
 
-            // This is not the beginning of the line anymore
-            m_isBeginning = false;
-        }
-        std::cout << value;
+        _getLineStream(m_type) << value;
 
         // Make the operator chainable
         return *this;
@@ -109,19 +102,23 @@ public:
         if (m_type == Type::Verbose)
             return *this;
 #endif
+        if (!isEnabled())
+            return *this;
 
         if (ctrl == End)
-        {
-            std::cout << "\n";
-            // We printed the \n, to this is the beginning of the new line
-            m_isBeginning = true;
-        }
+            _endLine(m_type);
 
         // Make the operator chainable
         return *this;
     }
 };
 
+// Makes the result of a logger chain void, for `LOGGER_LINE()`. `&` binds looser than `<<`.
+struct LineDiscarder
+{
+    inline void operator&(const Logger&) {}
+};
+
 /*
  * Logger object instances with different types
  */
@@ -132,3 +129,18 @@ extern Logger err;
 
 } // End of namespace Logger
 
+
+/*
+ * Front end of the loggers that drops disabled lines with their arguments:
+ *      LOGGER_VERB << "Objects: " << std::to_string(count) << Logger::End;
+ * The arguments are not evaluated while the level is disabled by `Logger::setMinLevel()`.
+ * A level disabled at compile time (see `LOGGER_ALLOW_VERBOSE`) is a constant false
+ * condition, the optimizer removes the whole line.
+ * It is an expression, so it can be the body of an `if` without braces.
+ */
+#define LOGGER_LINE(logger, isCompiledIn) \
+    !((isCompiledIn) && (logger).isEnabled()) ? (void)0 : ::Logger::LineDiscarder{} & (logger)
+#define LOGGER_VERB LOGGER_LINE(::Logger::verb, LOGGER_ALLOW_VERBOSE)
+#define LOGGER_LOG  LOGGER_LINE(::Logger::log, true)
+#define LOGGER_WARN LOGGER_LINE(::Logger::warn, true)
+#define LOGGER_ERR  LOGGER_LINE(::Logger::err, true)
@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+#include "Logger.h"
+#include "os.h"
+#include <cstring>
+#include <cerrno>
+#ifdef OS_LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filePath)
+{
+    open(filePath);
+}
+
+MappedFile::MappedFile(MappedFile&& another)
+{
+    m_data = another.m_data;
+    another.m_data = nullptr;
+
+    m_size = another.m_size;
+    another.m_size = 0;
+
+    m_isOpen = another.m_isOpen;
+    another.m_isOpen = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& another)
+{
+    if (this != &another)
+    {
+        close();
+
+        m_data = another.m_data;
+        another.m_data = nullptr;
+
+        m_size = another.m_size;
+        another.m_size = 0;
+
+        m_isOpen = another.m_isOpen;
+        another.m_isOpen = false;
+    }
+
+    return *this;
+}
+
+int MappedFile::open(const std::string& filePath)
+{
+    close();
+
+#ifdef OS_LINUX
+    const int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        Logger::err << "Failed to open file: " << filePath << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+
+    struct stat fileStat{};
+    if (fstat(fd, &fileStat) == -1)
+    {
+        Logger::err << "Failed to stat file: " << filePath << ": " << strerror(errno) << Logger::End;
+        ::close(fd);
+        return 1;
+    }
+
+    // `mmap()` refuses zero-length mappings, an empty file is simply an empty view
+    if (fileStat.st_size > 0)
+    {
+        void* addr = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            Logger::err << "Failed to map file: " << filePath << ": " << strerror(errno) << Logger::End;
+            ::close(fd);
+            return 1;
+        }
+        // We read the file front to back
+        madvise(addr, fileStat.st_size, MADV_SEQUENTIAL);
+
+        m_data = (const char*)addr;
+        m_size = fileStat.st_size;
+    }
+    ::close(fd); // The mapping keeps the file referenced
+#else
+#error "TODO: Unimplemented"
+#endif
+
+    m_isOpen = true;
+    return 0;
+}
+
+void MappedFile::close()
+{
+#ifdef OS_LINUX
+    if (m_data)
+        munmap((void*)m_data, m_size);
+#else
+#error "TODO: Unimplemented"
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+/*
+ * A read-only view of a whole file, mapped into memory.
+ * The contents stay valid until the object is closed or destroyed.
+ */
+class MappedFile final
+{
+private:
+    const char* m_data{};
+    size_t m_size{};
+    bool m_isOpen{};
+
+public:
+    MappedFile() {}
+    MappedFile(const std::string& filePath);
+
+    // Copy ctor, copy assignment op
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    // Move ctor, move assignment op
+    MappedFile(MappedFile&& another);
+    MappedFile& operator=(MappedFile&& another);
+
+    /*
+     * Maps the file into memory. An already mapped file is closed first.
+     *
+     * Returns:
+     *      1 if failed,
+     *      0 otherwise
+     */
+    int open(const std::string& filePath);
+    void close();
+
+    inline bool isOpen() const { return m_isOpen; }
+    inline const char* data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+    inline std::string_view view() const { return {m_data, m_size}; }
+
+    ~MappedFile();
+};
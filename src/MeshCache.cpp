@@ -0,0 +1,227 @@
+#include "MeshCache.h"
+#include "Logger.h"
+#include "assets.h"
+#include "hash.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cassert>
+#include <cstddef>
+
+namespace MeshCache
+{
+
+struct SourceInfo
+{
+    uint64_t size{};
+    int64_t mtime{};
+};
+
+static bool getSourceInfo(const std::string& sourcePath, SourceInfo* output)
+{
+    std::error_code ec;
+    output->size = std::filesystem::file_size(sourcePath, ec);
+    if (ec)
+        return 1;
+    output->mtime = std::filesystem::last_write_time(sourcePath, ec).time_since_epoch().count();
+    return (bool)ec;
+}
+
+std::string getCachePath(const std::string& sourcePath)
+{
+    const std::filesystem::path path = std::filesystem::path{sourcePath}.lexically_normal();
+    char hashStr[17]{};
+    snprintf(hashStr, sizeof(hashStr), "%016llx", (unsigned long long)Hash::fnv1a64(path.string()));
+    return std::string(ASSET_DIR_MESH_CACHE)+"/"+path.stem().string()+"-"+hashStr+".mesh";
+}
+
+/*
+ * Checks the header and the size of a mapped cache file.
+ * If the source file was modified but its content is the same, the cache is still accepted.
+ */
+static bool isCacheValid(const MappedFile& cacheFile, const SourceInfo& sourceInfo, const std::string& sourcePath)
+{
+    if (cacheFile.size() < sizeof(FileHeader))
+        return false;
+
+    const FileHeader* header = (const FileHeader*)cacheFile.data();
+    if (memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0
+     || header->version != fileVersion
+     || header->floatsPerVertex != ObjParser::Mesh::floatsPerVertex
+     || (header->indexSize != sizeof(uint16_t) && header->indexSize != sizeof(uint32_t)))
+    {
+        LOGGER_VERB << "Mesh cache has an unknown format" << Logger::End;
+        return false;
+    }
+
+    const size_t expectedSize = sizeof(FileHeader)
+        + (size_t)header->vertCount*header->floatsPerVertex*sizeof(float)
+        + (size_t)header->indexCount*header->indexSize;
+    if (cacheFile.size() != expectedSize)
+    {
+        Logger::warn << "Mesh cache is truncated" << Logger::End;
+        return false;
+    }
+
+    if (header->sourceSize != sourceInfo.size)
+        return false;
+    if (header->sourceMtime == sourceInfo.mtime)
+        return true;
+
+    // The file was touched, only rebuild if the content changed
+    MappedFile sourceFile;
+    if (sourceFile.open(sourcePath))
+        return false;
+    return Hash::fnv1a64(sourceFile.data(), sourceFile.size()) == header->sourceHash;
+}
+
+/*
+ * Stores the new modification time of an unchanged source file,
+ * so the next load does not have to hash it again.
+ */
+static void updateSourceMtime(const std::string& cachePath, int64_t mtime)
+{
+    std::fstream file{cachePath, std::ios::binary | std::ios::in | std::ios::out};
+    if (!file.is_open())
+        return;
+    file.seekp(offsetof(FileHeader, sourceMtime));
+    file.write((const char*)&mtime, sizeof(mtime));
+}
+
+/*
+ * Writes the cache file. A temporary file is renamed over the old one,
+ * so a concurrent reader never sees a half written cache.
+ *
+ * Returns:
+ *      true if failed,
+ *      false otherwise
+ */
+static bool writeCache(
+        const std::string& cachePath, const FileHeader& header,
+        const float* vertData, const void* indexData)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path{cachePath}.parent_path(), ec);
+    if (ec)
+    {
+        Logger::warn << "Failed to create mesh cache directory: " << ec.message() << Logger::End;
+        return 1;
+    }
+
+    // Unique per thread, the same mesh may be compiled by a loader thread and the map loader
+    const std::string tmpPath = cachePath+".tmp"+std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+        if (!file.is_open())
+        {
+            Logger::warn << "Failed to create mesh cache file: " << tmpPath << ": " << strerror(errno) << Logger::End;
+            return 1;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)vertData, (size_t)header.vertCount*header.floatsPerVertex*sizeof(float));
+        file.write((const char*)indexData, (size_t)header.indexCount*header.indexSize);
+        if (!file.good())
+        {
+            Logger::warn << "Failed to write mesh cache file: " << tmpPath << Logger::End;
+            file.close();
+            std::filesystem::remove(tmpPath, ec);
+            return 1;
+        }
+    }
+
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        Logger::warn << "Failed to move mesh cache file in place: " << ec.message() << Logger::End;
+        std::filesystem::remove(tmpPath, ec);
+        return 1;
+    }
+    return 0;
+}
+
+Status open(const std::string& sourcePath, Entry* output)
+{
+    assert(output);
+
+    SourceInfo sourceInfo;
+    if (getSourceInfo(sourcePath, &sourceInfo))
+    {
+        Logger::err << "Failed to open file: " << sourcePath << Logger::End;
+        return Status::OpenFailed;
+    }
+
+    const std::string cachePath = getCachePath(sourcePath);
+    MappedFile cacheFile;
+    if (std::filesystem::exists(cachePath) && cacheFile.open(cachePath) == 0
+            && isCacheValid(cacheFile, sourceInfo, sourcePath))
+    {
+        LOGGER_VERB << "Using compiled mesh: " << cachePath << Logger::End;
+
+        const FileHeader* header = (const FileHeader*)cacheFile.data();
+        if (header->sourceMtime != sourceInfo.mtime)
+            updateSourceMtime(cachePath, sourceInfo.mtime);
+        MeshView& view = output->m_view;
+        view.vertData = (const float*)(cacheFile.data()+sizeof(FileHeader));
+        view.vertCount = header->vertCount;
+        view.indexData = view.vertData+(size_t)header->vertCount*header->floatsPerVertex;
+        view.indexCount = header->indexCount;
+        view.indexSize = header->indexSize;
+        memcpy(view.boundsMin, header->boundsMin, sizeof(view.boundsMin));
+        memcpy(view.boundsMax, header->boundsMax, sizeof(view.boundsMax));
+        output->m_file = std::move(cacheFile);
+        return Status::Ok;
+    }
+    cacheFile.close();
+
+    Logger::log << "Compiling mesh: " << sourcePath << Logger::End;
+
+    MappedFile sourceFile;
+    if (sourceFile.open(sourcePath))
+        return Status::OpenFailed;
+
+    ObjParser::Mesh& mesh = output->m_mesh;
+    if (ObjParser::parse(sourceFile.view(), &mesh) != ObjParser::Status::Ok)
+        return Status::ParseFailed;
+
+    MeshView& view = output->m_view;
+    view.vertData = mesh.vertData.data();
+    view.vertCount = mesh.getVertCount();
+    view.indexCount = mesh.getIndexCount();
+    memcpy(view.boundsMin, mesh.boundsMin, sizeof(view.boundsMin));
+    memcpy(view.boundsMax, mesh.boundsMax, sizeof(view.boundsMax));
+    // Use 16-bit indices when every vertex can be addressed with them
+    if (view.vertCount <= UINT16_MAX+1)
+    {
+        output->m_shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+        view.indexData = output->m_shortIndices.data();
+        view.indexSize = sizeof(uint16_t);
+    }
+    else
+    {
+        view.indexData = mesh.indices.data();
+        view.indexSize = sizeof(uint32_t);
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = fileVersion;
+    header.sourceSize = sourceInfo.size;
+    header.sourceMtime = sourceInfo.mtime;
+    header.sourceHash = Hash::fnv1a64(sourceFile.data(), sourceFile.size());
+    header.floatsPerVertex = ObjParser::Mesh::floatsPerVertex;
+    header.vertCount = view.vertCount;
+    header.indexCount = view.indexCount;
+    header.indexSize = view.indexSize;
+    memcpy(header.boundsMin, view.boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, view.boundsMax, sizeof(header.boundsMax));
+
+    // Not fatal, we just parse again next time
+    if (writeCache(cachePath, header, view.vertData, view.indexData) == 0)
+        LOGGER_VERB << "Wrote compiled mesh: " << cachePath << Logger::End;
+
+    return Status::Ok;
+}
+
+} // namespace MeshCache
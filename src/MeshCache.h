@@ -0,0 +1,100 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Compiled mesh cache.
+ *
+ * The first time an OBJ file is loaded, the parsed and indexed mesh is written
+ * to `ASSET_DIR_MESH_CACHE` in a binary format that can be mapped and handed to
+ * the GPU as is. Later loads map the cache file instead of parsing the OBJ.
+ * A cache file is rebuilt when the source file changes.
+ *
+ * File layout (native endianness, little-endian on every platform we support):
+ *  * `FileHeader`
+ *  * vertex data: `vertCount*floatsPerVertex` floats (see `ObjParser::Mesh`)
+ *  * index data: `indexCount` indices of `indexSize` bytes each
+ */
+namespace MeshCache
+{
+
+static constexpr char fileMagic[4] = {'E', 'M', 'S', 'H'};
+// Increment when the layout of the file or the vertex data changes
+static constexpr uint32_t fileVersion = 1;
+
+struct FileHeader
+{
+    char        magic[4];
+    uint32_t    version;
+    // Source file identity, checked before the cache is used
+    uint64_t    sourceSize;
+    int64_t     sourceMtime;
+    uint64_t    sourceHash; // FNV-1a of the source file contents
+
+    uint32_t    floatsPerVertex;
+    uint32_t    vertCount;
+    uint32_t    indexCount;
+    uint32_t    indexSize; // 2 or 4 bytes
+
+    float       boundsMin[3];
+    float       boundsMax[3];
+};
+static_assert(sizeof(FileHeader) % 8 == 0);
+
+enum class Status
+{
+    Ok,
+    OpenFailed,
+    ParseFailed,
+};
+
+/*
+ * A view of a mesh in the GPU upload layout.
+ */
+struct MeshView
+{
+    const float*    vertData{};
+    size_t          vertCount{};
+    const void*     indexData{};
+    size_t          indexCount{};
+    size_t          indexSize{};
+    float           boundsMin[3]{};
+    float           boundsMax[3]{};
+};
+
+/*
+ * A loaded mesh: either a mapped cache file or, when the cache could not be
+ * written, the freshly parsed data.
+ */
+class Entry final
+{
+private:
+    MappedFile m_file;
+    ObjParser::Mesh m_mesh;
+    std::vector<uint16_t> m_shortIndices;
+    MeshView m_view;
+
+    friend Status open(const std::string& sourcePath, Entry* output);
+
+public:
+    inline const MeshView& view() const { return m_view; }
+    inline bool isFromCache() const { return m_file.isOpen(); }
+};
+
+/*
+ * Returns the path of the cache file belonging to `sourcePath`.
+ */
+std::string getCachePath(const std::string& sourcePath);
+
+/*
+ * Loads the mesh from the cache, or parses the OBJ file and (re)builds the cache
+ * if the cache is missing or stale.
+ */
+Status open(const std::string& sourcePath, Entry* output);
+
+} // namespace MeshCache
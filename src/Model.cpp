@@ -1,43 +1,14 @@
 #include "Model.h"
 #include "Logger.h"
+#include "MappedFile.h"
+#include "ObjParser.h"
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <cstring>
-#include <fstream>
-#include <sstream>
-#include <cctype>
+#include <cassert>
 
 #define MODEL_FILE_PARSER_VERBOSE 0
 
-static bool readFileContents(const std::string& filePath, std::string* output)
-{
-    Logger::verb << "Reading model file: " << filePath << Logger::End;
-
-    std::ifstream fileObject;
-    try
-    {
-        fileObject.open(filePath);
-        if (!fileObject.is_open())
-        {
-            Logger::err << "Failed to open file: " << filePath << ": " << strerror(errno) << Logger::End;
-            return 1;
-        }
-        std::stringstream sstream;
-        sstream << fileObject.rdbuf();
-        *output = sstream.str();
-    }
-    catch (std::exception& e)
-    {
-        Logger::err << "Failed to read file: " << filePath << ": " << e.what() << Logger::End;
-        fileObject.close();
-        return 1;
-    }
-
-    fileObject.close();
-    return 0;
-}
-
-
 Model::Model(const std::string& path)
 {
     open(path);
@@ -45,364 +16,285 @@ Model::Model(const std::string& path)
 
 Model::Model(Model&& another)
 {
-    m_state = another.m_state;
+    m_state = another.m_state.load();
+
+    m_pendingMesh = std::move(another.m_pendingMesh);
+    m_localAabb = another.m_localAabb;
 
     m_numOfVertices = another.m_numOfVertices;
     another.m_numOfVertices = 0;
 
-    m_vboData = another.m_vboData;
-    another.m_vboData = nullptr;
+    m_numOfIndices = another.m_numOfIndices;
+    another.m_numOfIndices = 0;
+
+    m_indexType = another.m_indexType;
 
     m_vaoIndex = another.m_vaoIndex;
     another.m_vaoIndex = 0;
 
     m_vboIndex = another.m_vboIndex;
     another.m_vboIndex = 0;
+
+    m_eboIndex = another.m_eboIndex;
+    another.m_eboIndex = 0;
 }
 
 Model& Model::operator=(Model&& another)
 {
     if (this != &another)
     {
-        m_state = another.m_state;
+        m_state = another.m_state.load();
+
+        m_pendingMesh = std::move(another.m_pendingMesh);
+        m_localAabb = another.m_localAabb;
+        ++m_generation;
 
         m_numOfVertices = another.m_numOfVertices;
         another.m_numOfVertices = 0;
 
-        m_vboData = another.m_vboData;
-        another.m_vboData = nullptr;
+        m_numOfIndices = another.m_numOfIndices;
+        another.m_numOfIndices = 0;
+
+        m_indexType = another.m_indexType;
+
+        glDeleteVertexArrays(1, &m_vaoIndex);
+        glDeleteBuffers(1, &m_vboIndex);
+        glDeleteBuffers(1, &m_eboIndex);
 
         m_vaoIndex = another.m_vaoIndex;
         another.m_vaoIndex = 0;
 
         m_vboIndex = another.m_vboIndex;
         another.m_vboIndex = 0;
+
+        m_eboIndex = another.m_eboIndex;
+        another.m_eboIndex = 0;
     }
 
     return *this;
 }
 
-int Model::parseObjFile(
-        const std::string& filePath,
-        std::vector<float>* outVerts,
-        std::vector<float>* outUvs,
-        std::vector<float>* outNorms
-        )
+int Model::parseObjFile(const std::string& filePath, ObjParser::Mesh* outMesh)
 {
-    assert(outVerts);
-    assert(outUvs);
-    assert(outNorms);
+    assert(outMesh);
+
+    LOGGER_VERB << "Reading model file: " << filePath << Logger::End;
 
-    std::string fileContents;
-    if (readFileContents(filePath, &fileContents))
+    MappedFile file;
+    if (file.open(filePath))
     {
         m_state = State::OpenFailed;
         return 1;
     }
 
-    std::vector<float> verticesTmp;
-    std::vector<float> uvCoordsTmp;
-    std::vector<float> normalsTmp;
-
-    for (size_t i{}; i < fileContents.size();)
+    if (ObjParser::parse(file.view(), outMesh) != ObjParser::Status::Ok)
     {
-        std::string token;
-
-        // Skip comments
-        if (fileContents[i] == '#')
-        {
-            while (i < fileContents.size() && fileContents[i] != '\n')
-                ++i;
-        }
-
-        auto getToken{
-            [&](){
-                token.clear();
-
-                // Get token
-                while (i < fileContents.size() && !std::isspace((unsigned char)fileContents[i]))
-                    token += fileContents[i++];
-    
-                // Skip whitespace
-                while (i < fileContents.size() && (fileContents[i] == ' ' || fileContents[i] == '\t'))
-                    ++i;
-            }
-        };
-
-        auto tokenToFloat{
-            [&](){
-                try
-                {
-                    return std::stof(token.c_str(), nullptr);
-                }
-                catch (...)
-                {
-                    return 0.0f;
-                }
-            }
-        };
-
-        getToken();
-
-        if (token.compare("v") == 0)
-        {
-            getToken();
-            float vertexX = tokenToFloat();
-            getToken();
-            float vertexY = tokenToFloat();
-            getToken();
-            float vertexZ = tokenToFloat();
-
-#if MODEL_FILE_PARSER_VERBOSE
-            Logger::verb << "Vertex(" << vertexX << ", " << vertexY << ", " << vertexZ << ")" << Logger::End;
-#endif
-
-            verticesTmp.push_back(vertexX);
-            verticesTmp.push_back(vertexY);
-            verticesTmp.push_back(vertexZ);
-        }
-        else if (token.compare("vt") == 0)
-        {
-            getToken();
-            float textureX = tokenToFloat();
-            getToken();
-            float textureY = tokenToFloat();
-
-#if MODEL_FILE_PARSER_VERBOSE
-            Logger::verb << "TexCoord(" << textureX << ", " << textureY << ")" << Logger::End;
-#endif
-
-            uvCoordsTmp.push_back(textureX);
-            uvCoordsTmp.push_back(textureY);
-        }
-        else if (token.compare("vn") == 0)
-        {
-            getToken();
-            float normalX = tokenToFloat();
-            getToken();
-            float normalY = tokenToFloat();
-            getToken();
-            float normalZ = tokenToFloat();
-
-#if MODEL_FILE_PARSER_VERBOSE
-            Logger::verb << "Normal(" << normalX << ", " << normalY << ", " << normalZ << ")" << Logger::End;
-#endif
-
-            normalsTmp.push_back(normalX);
-            normalsTmp.push_back(normalY);
-            normalsTmp.push_back(normalZ);
-        }
-        else if (token.compare("f") == 0)
-        {
-            for (int i{}; i < 3; ++i)
-            {
-                getToken();
-                std::string originalToken = token;
-                size_t vertexI, uvCoordI, normalI;
-                size_t numOfProcessed;
-
-                vertexI = std::stoul(token.c_str(), &numOfProcessed);
-
-                try
-                {
-                    token = token.substr(numOfProcessed+1);
-                    uvCoordI = std::stoul(token.c_str(), &numOfProcessed);
-                }
-                catch (...)
-                {
-                    Logger::verb << token << Logger::End;
-                    Logger::err << "Invalid face specifier (UV coordinates missing? Make sure to export model with UV coordinates included)" << Logger::End;
-                    m_state = State::ParseFailed;
-                    return 1;
-                }
-
-                try
-                {
-                    token = token.substr(numOfProcessed+1);
-                    normalI = std::stoul(token.c_str(), &numOfProcessed);
-                }
-                catch (...)
-                {
-                    Logger::err << "Invalid face specifier (Normals missing? Make sure to export model with normals included)" << Logger::End;
-                    m_state = State::ParseFailed;
-                    return 1;
-                }
-
-                if (vertexI  < 1 || vertexI  > verticesTmp.size()
-                 || uvCoordI < 1 || uvCoordI > uvCoordsTmp.size()
-                 || normalI  < 1 || normalI  > normalsTmp.size())
-                {
-                    Logger::err << "Invalid face vertex: " << originalToken
-                        << ": FaceVertex(" << vertexI << ", " << uvCoordI << ", " << normalI << ")"  << Logger::End;
-                    Logger::log << verticesTmp.size() << ", " << uvCoordsTmp.size() << ", " << normalsTmp.size() << Logger::End;
-                    m_state = State::ParseFailed;
-                    return 1;
-                }
-
-#if MODEL_FILE_PARSER_VERBOSE
-                Logger::verb << "FaceVertex(" << vertexI << ", " << uvCoordI << ", " << normalI << ")" << Logger::End;
-#endif
-
-                outVerts->push_back(verticesTmp[(vertexI-1)*3+0]);
-                outVerts->push_back(verticesTmp[(vertexI-1)*3+1]);
-                outVerts->push_back(verticesTmp[(vertexI-1)*3+2]);
-                outUvs->push_back(uvCoordsTmp[(uvCoordI-1)*2+0]);
-                outUvs->push_back(uvCoordsTmp[(uvCoordI-1)*2+1]);
-                outNorms->push_back(normalsTmp[(normalI-1)*3+0]);
-                outNorms->push_back(normalsTmp[(normalI-1)*3+1]);
-                outNorms->push_back(normalsTmp[(normalI-1)*3+2]);
-            }
-            getToken();
-            if (token.size())
-            {
-                Logger::err << "Face element with 3+ values. Re-export model with \"Triangulate faces\" option" << Logger::End;
-                m_state = State::ParseFailed;
-                return 1;
-            }
-        }
-        else
-        {
-#if MODEL_FILE_PARSER_VERBOSE
-            Logger::verb << "Skipping unsupported keyword: " << token << Logger::End;
-#endif
-        }
-
-        // Skip the remaining characters in the line
-        while (i < fileContents.size() && fileContents[i] != '\n')
-            ++i;
-        ++i;
+        m_state = State::ParseFailed;
+        return 1;
     }
 
-    Logger::verb << "Parsed a model with "
-        << outVerts->size()/3 << " vertices, "
-        << outUvs->size()/2 << " UV coordinates and "
-        << outNorms->size()/3 << " normals"
+    LOGGER_VERB << "Parsed a model with "
+        << outMesh->getIndexCount()/3 << " triangles and "
+        << outMesh->getVertCount() << " unique vertices"
         << Logger::End;
 
-#if MODEL_FILE_PARSER_VERBOSE
-    Logger::verb << "Vertices: ";
-    for (float v : vertices)
-        Logger::verb << v << ", ";
-    Logger::verb << Logger::End;
-
-    Logger::verb << "UVs: ";
-    for (float v : uvCoords)
-        Logger::verb << v << ", ";
-    Logger::verb << Logger::End;
-
-    Logger::verb << "Normals: ";
-    for (float v : normals)
-        Logger::verb << v << ", ";
-    Logger::verb << Logger::End;
-#endif
-
-    m_numOfVertices = outVerts->size()/3;
     return 0;
 }
 
-void Model::_copyVertData(
-        const std::vector<float>& verts,
-        const std::vector<float>& uvs,
-        const std::vector<float>& normals
-        )
+static size_t getIndexSize(uint indexType)
 {
-    m_vboData = new float[m_numOfVertices*8];
-    for (size_t i{}; i < verts.size()/3; ++i)
+    switch (indexType)
     {
-        /*
-         * Vertex data layout:
-         *  * vertex (3 values)
-         *  * UV coordinates (2 values)
-         *  * normals (3 values)
-         */
-
-        const size_t arrayI = i*8;
-        m_vboData[arrayI+0] = verts[i*3+0];
-        m_vboData[arrayI+1] = verts[i*3+1];
-        m_vboData[arrayI+2] = verts[i*3+2];
-        m_vboData[arrayI+3] = uvs[i*2+0];
-        m_vboData[arrayI+4] = uvs[i*2+1];
-        m_vboData[arrayI+5] = normals[i+0];
-        m_vboData[arrayI+6] = normals[i+1];
-        m_vboData[arrayI+7] = normals[i+2];
+    case GL_UNSIGNED_SHORT: return sizeof(uint16_t);
+    case GL_UNSIGNED_INT:   return sizeof(uint32_t);
+    default:                return 0;
     }
 }
 
-static void configureVertexData(uint* vaoIndexPtr, uint* vboIndexPtr, size_t numOfVertices, float* vboData)
+static void configureVertexData(uint* vaoIndexPtr, uint* vboIndexPtr, size_t numOfVertices, const float* vboData)
 {
     assert(vaoIndexPtr);
     assert(vboIndexPtr);
     assert(vboData);
 
 #if MODEL_FILE_PARSER_VERBOSE
-    Logger::verb << "VBO data: ";
-    for (size_t i{}; i < numOfVertices*8; ++i)
-        Logger::verb << vboData[i] << ", ";
-    Logger::verb << Logger::End;
+    LOGGER_VERB << "VBO data: ";
+    for (size_t i{}; i < numOfVertices*ObjParser::Mesh::floatsPerVertex; ++i)
+        LOGGER_VERB << vboData[i] << ", ";
+    LOGGER_VERB << Logger::End;
 #endif
 
-    Logger::verb << "Copying and configuring vertex data" << Logger::End;
+    LOGGER_VERB << "Copying and configuring vertex data" << Logger::End;
+
+    static constexpr size_t stride = ObjParser::Mesh::floatsPerVertex*sizeof(float);
 
     glGenVertexArrays(1, vaoIndexPtr);
     glBindVertexArray(*vaoIndexPtr);
 
     glGenBuffers(1, vboIndexPtr);
     glBindBuffer(GL_ARRAY_BUFFER, *vboIndexPtr);
-    glBufferData(GL_ARRAY_BUFFER, numOfVertices*sizeof(float)*8, vboData, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, numOfVertices*stride, vboData, GL_STATIC_DRAW);
 
     // Vertex coordinate attribute
-    glVertexAttribPointer(VERTEX_ATTR_I_VERTEX, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)0);
+    glVertexAttribPointer(VERTEX_ATTR_I_VERTEX, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
     glEnableVertexAttribArray(VERTEX_ATTR_I_VERTEX);
 
     // Texture coordinate attribute
-    glVertexAttribPointer(VERTEX_ATTR_I_UV, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(3*sizeof(float)));
+    glVertexAttribPointer(VERTEX_ATTR_I_UV, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3*sizeof(float)));
     glEnableVertexAttribArray(VERTEX_ATTR_I_UV);
 
     // Normal attribute
-    glVertexAttribPointer(VERTEX_ATTR_I_NORMAL, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*)(5*sizeof(float)));
+    glVertexAttribPointer(VERTEX_ATTR_I_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5*sizeof(float)));
     glEnableVertexAttribArray(VERTEX_ATTR_I_NORMAL);
+}
+
+void Model::_uploadMesh(const MeshCache::MeshView& mesh)
+{
+    assert(mesh.indexSize == sizeof(uint16_t) || mesh.indexSize == sizeof(uint32_t));
+
+    m_numOfVertices = mesh.vertCount;
+    m_numOfIndices = mesh.indexCount;
+    m_indexType = (mesh.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+
+    configureVertexData(&m_vaoIndex, &m_vboIndex, m_numOfVertices, mesh.vertData);
+
+    glGenBuffers(1, &m_eboIndex);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_eboIndex);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_numOfIndices*mesh.indexSize, mesh.indexData, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
+
+    // What the model would take if every face corner had its own vertex
+    const size_t flatSize = m_numOfIndices*ObjParser::Mesh::floatsPerVertex*sizeof(float);
+    const size_t indexedSize = getGpuMemSize();
+    Logger::log << "Indexed " << m_numOfIndices << " corners into " << m_numOfVertices << " vertices ("
+        << mesh.indexSize*8 << "-bit indices): "
+        << indexedSize/1024 << " KiB instead of " << flatSize/1024 << " KiB, saved "
+        << (flatSize > indexedSize ? (flatSize-indexedSize)/1024 : 0) << " KiB" << Logger::End;
 }
 
-int Model::open(const std::string& filePath)
+size_t Model::getGpuMemSize() const
+{
+    return m_numOfVertices*ObjParser::Mesh::floatsPerVertex*sizeof(float)
+        + m_numOfIndices*getIndexSize(m_indexType);
+}
+
+size_t Model::getMemSize() const
 {
-    std::vector<float> verts, uvs, norms;
-    if (parseObjFile(filePath, &verts, &uvs, &norms))
+    size_t size = sizeof(Model)+getGpuMemSize();
+    if (m_pendingMesh)
+    {
+        const MeshCache::MeshView& mesh = m_pendingMesh->view();
+        size += mesh.vertCount*ObjParser::Mesh::floatsPerVertex*sizeof(float)+mesh.indexCount*mesh.indexSize;
+    }
+    return size;
+}
+
+int Model::load(const std::string& filePath)
+{
+    LOGGER_VERB << "Opening model: " << filePath << Logger::End;
+
+    auto mesh = std::make_unique<MeshCache::Entry>();
+    switch (MeshCache::open(filePath, mesh.get()))
+    {
+    case MeshCache::Status::Ok:
+        break;
+
+    case MeshCache::Status::OpenFailed:
+        m_state = State::OpenFailed;
+        return 1;
+
+    case MeshCache::Status::ParseFailed:
+        m_state = State::ParseFailed;
         return 1;
+    }
+
+    const MeshCache::MeshView view = mesh->view();
+    m_localAabb = {
+        {view.boundsMin[0], view.boundsMin[1], view.boundsMin[2]},
+        {view.boundsMax[0], view.boundsMax[1], view.boundsMax[2]}};
 
-    _copyVertData(verts, uvs, norms);
-    configureVertexData(&m_vaoIndex, &m_vboIndex, m_numOfVertices, m_vboData);
+    m_pendingMesh = std::move(mesh);
+    m_state = State::Loading;
+    return 0;
+}
+
+int Model::upload()
+{
+    assert(m_state == State::Loading);
+    assert(m_pendingMesh);
+
+    _uploadMesh(m_pendingMesh->view());
+    m_pendingMesh.reset(); // Unmaps or frees the CPU side copy
 
     m_state = State::Ok;
-    Logger::verb << "Model loaded successfully" << Logger::End;
+    LOGGER_VERB << "Model loaded successfully" << Logger::End;
     return 0;
 }
 
+int Model::open(const std::string& filePath)
+{
+    if (load(filePath))
+        return 1;
+    return upload();
+}
+
 int Model::fromData(float* values, size_t numOfVertices)
 {
-    m_vboData = new float[numOfVertices*8];
-    memcpy(m_vboData, values, numOfVertices*8);
     m_numOfVertices = numOfVertices;
+    m_numOfIndices = 0;
 
-    configureVertexData(&m_vaoIndex, &m_vboIndex, m_numOfVertices, m_vboData);
+    m_localAabb = {};
+    for (size_t i{}; i < numOfVertices; ++i)
+    {
+        const float* pos = values+i*ObjParser::Mesh::floatsPerVertex;
+        const glm::vec3 vert{pos[0], pos[1], pos[2]};
+        m_localAabb.min = (i == 0 ? vert : glm::min(m_localAabb.min, vert));
+        m_localAabb.max = (i == 0 ? vert : glm::max(m_localAabb.max, vert));
+    }
+
+    configureVertexData(&m_vaoIndex, &m_vboIndex, m_numOfVertices, values);
+    glBindVertexArray(0);
 
     m_state = State::Ok;
-    Logger::verb << "Model loaded successfully" << Logger::End;
+    LOGGER_VERB << "Model loaded successfully" << Logger::End;
     return 0;
 }
 
 void Model::draw()
 {
     glBindVertexArray(m_vaoIndex);
-    glDrawArrays(GL_TRIANGLES, 0, m_numOfVertices);
+    if (m_numOfIndices)
+        glDrawElements(GL_TRIANGLES, m_numOfIndices, m_indexType, (void*)0);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, m_numOfVertices);
+}
+
+void Model::drawInstanced(uint instanceBuffer, size_t byteOffset, size_t instanceCount)
+{
+    glBindVertexArray(m_vaoIndex);
+
+    // Point the per-instance attribute at this batch, one location per matrix column
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    static constexpr size_t stride = 16*sizeof(float);
+    for (uint i{}; i < 4; ++i)
+    {
+        const uint location = VERTEX_ATTR_I_INSTANCE_MAT+i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(byteOffset+i*4*sizeof(float)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+
+    if (m_numOfIndices)
+        glDrawElementsInstanced(GL_TRIANGLES, m_numOfIndices, m_indexType, (void*)0, instanceCount);
+    else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, m_numOfVertices, instanceCount);
 }
 
 Model::~Model()
 {
     glDeleteVertexArrays(1, &m_vaoIndex);
     glDeleteBuffers(1, &m_vboIndex);
-    delete[] m_vboData;
-    Logger::verb << "Deleted a model (" << this << ')' << Logger::End;
+    glDeleteBuffers(1, &m_eboIndex);
+    LOGGER_VERB << "Deleted a model (" << this << ')' << Logger::End;
 }
-
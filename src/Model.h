@@ -1,14 +1,21 @@
 #pragma once
 
 #include "ui/OverlayRenderer.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
+#include "Aabb.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <cstdint>
 
 #define VERTEX_ATTR_I_VERTEX 0
 #define VERTEX_ATTR_I_UV 1
 #define VERTEX_ATTR_I_NORMAL 2
+// A per-instance mat4, takes 4 locations
+#define VERTEX_ATTR_I_INSTANCE_MAT 3
 
 class Model final
 {
@@ -16,23 +23,32 @@ public:
     enum class State
     {
         Uninitialized,
+        Loading, // Loaded by `load()`, waiting for `upload()`
         Ok,
         OpenFailed,
         ParseFailed,
     };
 
 private:
-    State m_state{State::Uninitialized};
+    // Atomic, so the render thread can poll it while a worker thread loads the model
+    std::atomic<State> m_state{State::Uninitialized};
+    // The mesh read by `load()`, released by `upload()`
+    std::unique_ptr<MeshCache::Entry> m_pendingMesh;
+    // Number of unique vertices in the VBO
     size_t m_numOfVertices{};
-    float* m_vboData{};
+    // Number of indices in the EBO, 0 if the model is not indexed
+    size_t m_numOfIndices{};
+    // `GL_UNSIGNED_SHORT` or `GL_UNSIGNED_INT`
+    uint m_indexType{};
     uint m_vaoIndex{};
     uint m_vboIndex{};
+    uint m_eboIndex{};
+    // The bounding box in model space, valid from the `Loading` state
+    Aabb m_localAabb;
+    // Incremented when the model is replaced by another one, e.g. by a hot-reload
+    uint32_t m_generation{};
 
-    void _copyVertData(
-            const std::vector<float>& verts,
-            const std::vector<float>& uvs,
-            const std::vector<float>& normals
-            );
+    void _uploadMesh(const MeshCache::MeshView& mesh);
 
     friend class GameObject;
     friend class UI::OverlayRenderer;
@@ -48,21 +64,46 @@ public:
     Model(Model&& another);
     Model& operator=(Model&& another);
 
-    int parseObjFile(
-            const std::string& filePath,
-            std::vector<float>* outVerts,
-            std::vector<float>* outUvs,
-            std::vector<float>* outNorms
-            );
+    int parseObjFile(const std::string& filePath, ObjParser::Mesh* outMesh);
 
+    /*
+     * Loads the model through the compiled mesh cache (see `MeshCache`),
+     * the OBJ file is only parsed if the cache is missing or stale.
+     * Does not use OpenGL, so it can be called from any thread.
+     * The model becomes usable after `upload()`.
+     */
+    int load(const std::string& filePath);
+    // Creates the GPU buffers from the data read by `load()`. Render thread only.
+    int upload();
+    // `load()` and `upload()` in one step
     int open(const std::string& filePath);
+    /*
+     * Creates a non-indexed model.
+     * `values` contains `numOfVertices` vertices in the layout of `ObjParser::Mesh`.
+     */
     int fromData(float* values, size_t numOfVertices);
 
     inline State getState() const { return m_state; }
+    // Whether it is waiting for `upload()`, so it must not be replaced
+    inline bool isBusy() const { return m_state == State::Loading; }
+    inline const Aabb& getLocalAabb() const { return m_localAabb; }
+    // Changes when the mesh and its bounding box were replaced
+    inline uint32_t getGeneration() const { return m_generation; }
     inline size_t getVertCount() const { return m_numOfVertices; }
+    inline size_t getIndexCount() const { return m_numOfIndices; }
+    // The number of vertices a draw call processes
+    inline size_t getDrawnVertCount() const { return m_numOfIndices ? m_numOfIndices : m_numOfVertices; }
+    // The size of the vertex and index buffers in bytes
+    size_t getGpuMemSize() const;
+    // The GPU buffers plus the mesh waiting for `upload()`, in bytes. Not while `load()` runs.
+    size_t getMemSize() const;
 
     void draw();
+    /*
+     * Draws `instanceCount` instances. The model matrices are read from
+     * `instanceBuffer`, starting at `byteOffset`, one mat4 per instance.
+     */
+    void drawInstanced(uint instanceBuffer, size_t byteOffset, size_t instanceCount);
 
     ~Model();
 };
-
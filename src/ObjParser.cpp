@@ -0,0 +1,350 @@
+#include "ObjParser.h"
+#include "Logger.h"
+#include <charconv>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#define OBJ_PARSER_VERBOSE 0
+
+namespace ObjParser
+{
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/*
+ * Splits a single line into whitespace separated tokens.
+ */
+class LineTokenizer
+{
+private:
+    const char* m_it;
+    const char* m_end;
+
+public:
+    LineTokenizer(std::string_view line)
+        : m_it{line.data()}, m_end{line.data()+line.size()}
+    {
+    }
+
+    // Returns an empty view at the end of the line
+    inline std::string_view next()
+    {
+        while (m_it != m_end && isBlank(*m_it))
+            ++m_it;
+        const char* tokenStart = m_it;
+        while (m_it != m_end && !isBlank(*m_it))
+            ++m_it;
+        return {tokenStart, size_t(m_it-tokenStart)};
+    }
+};
+
+static inline float tokenToFloat(std::string_view token)
+{
+    float value{};
+    // Invalid numbers are read as 0, like `std::stof()` failures were handled before
+    if (!token.empty() && token[0] == '+') // `from_chars()` does not accept a plus sign
+        token.remove_prefix(1);
+    std::from_chars(token.data(), token.data()+token.size(), value);
+    return value;
+}
+
+/*
+ * Reads an index from the start of `token` and removes the processed characters.
+ *
+ * Returns:
+ *      true if failed,
+ *      false otherwise
+ */
+static inline bool takeIndex(std::string_view* token, size_t* output)
+{
+    const auto [ptr, ec] = std::from_chars(token->data(), token->data()+token->size(), *output);
+    if (ec != std::errc{})
+        return 1;
+    token->remove_prefix(ptr-token->data());
+    return 0;
+}
+
+// Removes the '/' separator from the start of `token`, returns true if it was not there
+static inline bool takeSeparator(std::string_view* token)
+{
+    if (token->empty() || token->front() != '/')
+        return 1;
+    token->remove_prefix(1);
+    return 0;
+}
+
+struct ElementCounts
+{
+    size_t verts{};
+    size_t uvs{};
+    size_t norms{};
+    size_t faces{};
+};
+
+/*
+ * Counts the elements of each kind with a quick scan over the line starts,
+ * so the output arrays can be allocated once.
+ */
+static ElementCounts countElements(std::string_view data)
+{
+    ElementCounts counts{};
+    const char* it = data.data();
+    const char* const end = data.data()+data.size();
+    while (it < end)
+    {
+        if (end-it >= 2)
+        {
+            if (it[0] == 'v')
+            {
+                if (isBlank(it[1]))      ++counts.verts;
+                else if (it[1] == 't')   ++counts.uvs;
+                else if (it[1] == 'n')   ++counts.norms;
+            }
+            else if (it[0] == 'f' && isBlank(it[1]))
+            {
+                ++counts.faces;
+            }
+        }
+
+        const char* lineEnd = (const char*)memchr(it, '\n', end-it);
+        if (!lineEnd)
+            break;
+        it = lineEnd+1;
+    }
+    return counts;
+}
+
+static void computeBounds(Mesh* mesh)
+{
+    const std::vector<float>& vd = mesh->vertData;
+    for (int j{}; j < 3; ++j)
+    {
+        mesh->boundsMin[j] = (vd.empty() ? 0.0f : vd[j]);
+        mesh->boundsMax[j] = mesh->boundsMin[j];
+    }
+
+    for (size_t i{}; i < vd.size(); i += Mesh::floatsPerVertex)
+    {
+        for (int j{}; j < 3; ++j)
+        {
+            mesh->boundsMin[j] = std::min(mesh->boundsMin[j], vd[i+j]);
+            mesh->boundsMax[j] = std::max(mesh->boundsMax[j], vd[i+j]);
+        }
+    }
+}
+
+/*
+ * Open addressing hash table mapping (vertex, UV, normal) index triples
+ * to the index of the output vertex.
+ */
+class CornerTable
+{
+private:
+    struct Slot
+    {
+        uint32_t vertexI;
+        uint32_t uvCoordI;
+        uint32_t normalI;
+        uint32_t outIndex; // `emptySlot` if unused
+    };
+    static constexpr uint32_t emptySlot = UINT32_MAX;
+
+    std::vector<Slot> m_slots;
+    size_t m_mask{};
+
+    static inline size_t hash(uint32_t v, uint32_t vt, uint32_t vn)
+    {
+        uint64_t h = v*0x9E3779B97F4A7C15ull;
+        h ^= vt*0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+        h ^= vn*0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+        return h ^ (h >> 29);
+    }
+
+public:
+    CornerTable(size_t maxEntries)
+    {
+        // Keep the load factor below 0.5
+        size_t capacity = 16;
+        while (capacity < maxEntries*2)
+            capacity *= 2;
+        m_slots.resize(capacity, Slot{0, 0, 0, emptySlot});
+        m_mask = capacity-1;
+    }
+
+    /*
+     * Looks up the triple, inserts `newIndex` for it if it is not in the table yet.
+     *
+     * Returns: The output index of the triple
+     */
+    inline uint32_t findOrInsert(uint32_t v, uint32_t vt, uint32_t vn, uint32_t newIndex)
+    {
+        for (size_t i = hash(v, vt, vn) & m_mask;; i = (i+1) & m_mask)
+        {
+            Slot& slot = m_slots[i];
+            if (slot.outIndex == emptySlot)
+            {
+                slot = {v, vt, vn, newIndex};
+                return newIndex;
+            }
+            if (slot.vertexI == v && slot.uvCoordI == vt && slot.normalI == vn)
+                return slot.outIndex;
+        }
+    }
+};
+
+Status parse(std::string_view data, Mesh* outMesh)
+{
+    assert(outMesh);
+
+    const ElementCounts counts = countElements(data);
+    CornerTable cornerTable{counts.faces*3};
+
+    std::vector<float> verticesTmp;
+    std::vector<float> uvCoordsTmp;
+    std::vector<float> normalsTmp;
+    verticesTmp.reserve(counts.verts*3);
+    uvCoordsTmp.reserve(counts.uvs*2);
+    normalsTmp.reserve(counts.norms*3);
+
+    outMesh->vertData.clear();
+    outMesh->indices.clear();
+    // Smooth meshes share most corners, so this is an upper bound
+    outMesh->vertData.reserve(std::max(counts.verts, counts.norms)*Mesh::floatsPerVertex);
+    outMesh->indices.reserve(counts.faces*3);
+
+    const char* it = data.data();
+    const char* const end = data.data()+data.size();
+    while (it < end)
+    {
+        const char* lineEnd = (const char*)memchr(it, '\n', end-it);
+        if (!lineEnd)
+            lineEnd = end;
+        LineTokenizer tokenizer{{it, size_t(lineEnd-it)}};
+        it = lineEnd+1;
+
+        const std::string_view keyword = tokenizer.next();
+        if (keyword.empty() || keyword[0] == '#') // Skip empty lines and comments
+            continue;
+
+        if (keyword == "v")
+        {
+            const float vertexX = tokenToFloat(tokenizer.next());
+            const float vertexY = tokenToFloat(tokenizer.next());
+            const float vertexZ = tokenToFloat(tokenizer.next());
+
+#if OBJ_PARSER_VERBOSE
+            LOGGER_VERB << "Vertex(" << vertexX << ", " << vertexY << ", " << vertexZ << ")" << Logger::End;
+#endif
+
+            verticesTmp.push_back(vertexX);
+            verticesTmp.push_back(vertexY);
+            verticesTmp.push_back(vertexZ);
+        }
+        else if (keyword == "vt")
+        {
+            const float textureX = tokenToFloat(tokenizer.next());
+            const float textureY = tokenToFloat(tokenizer.next());
+
+#if OBJ_PARSER_VERBOSE
+            LOGGER_VERB << "TexCoord(" << textureX << ", " << textureY << ")" << Logger::End;
+#endif
+
+            uvCoordsTmp.push_back(textureX);
+            uvCoordsTmp.push_back(textureY);
+        }
+        else if (keyword == "vn")
+        {
+            const float normalX = tokenToFloat(tokenizer.next());
+            const float normalY = tokenToFloat(tokenizer.next());
+            const float normalZ = tokenToFloat(tokenizer.next());
+
+#if OBJ_PARSER_VERBOSE
+            LOGGER_VERB << "Normal(" << normalX << ", " << normalY << ", " << normalZ << ")" << Logger::End;
+#endif
+
+            normalsTmp.push_back(normalX);
+            normalsTmp.push_back(normalY);
+            normalsTmp.push_back(normalZ);
+        }
+        else if (keyword == "f")
+        {
+            for (int i{}; i < 3; ++i)
+            {
+                const std::string_view originalToken = tokenizer.next();
+                std::string_view token = originalToken;
+                size_t vertexI{}, uvCoordI{}, normalI{};
+
+                if (takeIndex(&token, &vertexI))
+                {
+                    Logger::err << "Invalid face specifier: \"" << originalToken << '"' << Logger::End;
+                    return Status::ParseFailed;
+                }
+
+                if (takeSeparator(&token) || takeIndex(&token, &uvCoordI))
+                {
+                    LOGGER_VERB << originalToken << Logger::End;
+                    Logger::err << "Invalid face specifier (UV coordinates missing? Make sure to export model with UV coordinates included)" << Logger::End;
+                    return Status::ParseFailed;
+                }
+
+                if (takeSeparator(&token) || takeIndex(&token, &normalI))
+                {
+                    Logger::err << "Invalid face specifier (Normals missing? Make sure to export model with normals included)" << Logger::End;
+                    return Status::ParseFailed;
+                }
+
+                if (vertexI  < 1 || vertexI  > verticesTmp.size()/3
+                 || uvCoordI < 1 || uvCoordI > uvCoordsTmp.size()/2
+                 || normalI  < 1 || normalI  > normalsTmp.size()/3)
+                {
+                    Logger::err << "Invalid face vertex: " << originalToken
+                        << ": FaceVertex(" << vertexI << ", " << uvCoordI << ", " << normalI << ")"  << Logger::End;
+                    Logger::log << verticesTmp.size()/3 << ", " << uvCoordsTmp.size()/2 << ", " << normalsTmp.size()/3 << Logger::End;
+                    return Status::ParseFailed;
+                }
+
+#if OBJ_PARSER_VERBOSE
+                LOGGER_VERB << "FaceVertex(" << vertexI << ", " << uvCoordI << ", " << normalI << ")" << Logger::End;
+#endif
+
+                const uint32_t newIndex = outMesh->getVertCount();
+                const uint32_t index = cornerTable.findOrInsert(vertexI, uvCoordI, normalI, newIndex);
+                if (index == newIndex) // First time we see this corner, emit a new vertex
+                {
+                    std::vector<float>& vd = outMesh->vertData;
+                    vd.push_back(verticesTmp[(vertexI-1)*3+0]);
+                    vd.push_back(verticesTmp[(vertexI-1)*3+1]);
+                    vd.push_back(verticesTmp[(vertexI-1)*3+2]);
+                    vd.push_back(uvCoordsTmp[(uvCoordI-1)*2+0]);
+                    vd.push_back(uvCoordsTmp[(uvCoordI-1)*2+1]);
+                    vd.push_back(normalsTmp[(normalI-1)*3+0]);
+                    vd.push_back(normalsTmp[(normalI-1)*3+1]);
+                    vd.push_back(normalsTmp[(normalI-1)*3+2]);
+                }
+                outMesh->indices.push_back(index);
+            }
+
+            if (!tokenizer.next().empty())
+            {
+                Logger::err << "Face element with 3+ values. Re-export model with \"Triangulate faces\" option" << Logger::End;
+                return Status::ParseFailed;
+            }
+        }
+        else
+        {
+#if OBJ_PARSER_VERBOSE
+            LOGGER_VERB << "Skipping unsupported keyword: " << keyword << Logger::End;
+#endif
+        }
+    }
+
+    computeBounds(outMesh);
+    return Status::Ok;
+}
+
+} // namespace ObjParser
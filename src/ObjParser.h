@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Wavefront OBJ parser working directly on an in-memory buffer
+ * (usually a `MappedFile`). Tokens are `std::string_view`s into the buffer
+ * and numbers are converted with `std::from_chars`, so no per-token
+ * allocation happens.
+ *
+ * Only triangulated faces with vertex, UV and normal indices are supported.
+ * Face corners referencing the same (vertex, UV, normal) triple share a vertex,
+ * so the output is an indexed mesh.
+ */
+namespace ObjParser
+{
+
+enum class Status
+{
+    Ok,
+    ParseFailed,
+};
+
+struct Mesh
+{
+    /*
+     * Vertex data layout:
+     *  * vertex (3 values)
+     *  * UV coordinates (2 values)
+     *  * normals (3 values)
+     */
+    static constexpr size_t floatsPerVertex = 8;
+
+    std::vector<float> vertData;
+    // 3 indices per triangle
+    std::vector<uint32_t> indices;
+    // Axis aligned bounding box of the vertices in model space
+    float boundsMin[3]{};
+    float boundsMax[3]{};
+
+    inline size_t getVertCount() const { return vertData.size()/floatsPerVertex; }
+    inline size_t getIndexCount() const { return indices.size(); }
+};
+
+/*
+ * Parses `data` into `outMesh`, deduplicating the face corners.
+ * Errors are logged.
+ */
+Status parse(std::string_view data, Mesh* outMesh);
+
+} // namespace ObjParser
@@ -0,0 +1,69 @@
+#include "PhysicsDebugDraw.h"
+#include <bit>
+#include <cstddef>
+
+PhysicsDebugDraw::PhysicsDebugDraw()
+{
+    m_lineShader.open("../shaders/line.vert.glsl", "../shaders/line.frag.glsl");
+
+    glGenVertexArrays(1, &m_lineVAO);
+    glBindVertexArray(m_lineVAO);
+
+    glGenBuffers(1, &m_lineVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(LineVertex), (void*)offsetof(LineVertex, pos));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(LineVertex), (void*)offsetof(LineVertex, color));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void PhysicsDebugDraw::drawContactPoint(
+        const btVector3& pointOnB,
+        const btVector3& normalOnB,
+        btScalar distance,
+        int lifeTime,
+        const btVector3& color)
+{
+    (void)distance;
+    (void)lifeTime;
+
+    drawLine(pointOnB, pointOnB+normalOnB*PHYS_DBG_CONTACT_NORMAL_LEN, color);
+    for (int axis{}; axis < 3; ++axis)
+    {
+        btVector3 offset{0, 0, 0};
+        offset[axis] = PHYS_DBG_CONTACT_CROSS_SIZE;
+        drawLine(pointOnB-offset, pointOnB+offset, color);
+    }
+}
+
+void PhysicsDebugDraw::flushLines()
+{
+    m_linesLastFlush = m_lineVerts.size()/2;
+    if (m_lineVerts.empty())
+        return;
+
+    m_lineShader.use();
+    glBindVertexArray(m_lineVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
+
+    if (m_lineVerts.size() > m_lineVBOCap)
+        m_lineVBOCap = std::bit_ceil(m_lineVerts.size());
+    // Orphan the previous storage, so the driver doesn't wait for the last frame's draw
+    glBufferData(GL_ARRAY_BUFFER, m_lineVBOCap*sizeof(LineVertex), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_lineVerts.size()*sizeof(LineVertex), m_lineVerts.data());
+    glDrawArrays(GL_LINES, 0, m_lineVerts.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    m_lineVerts.clear();
+}
+
+PhysicsDebugDraw::~PhysicsDebugDraw()
+{
+    glDeleteVertexArrays(1, &m_lineVAO);
+    glDeleteBuffers(1, &m_lineVBO);
+}
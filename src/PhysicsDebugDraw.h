@@ -3,84 +3,75 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <bullet/LinearMath/btIDebugDraw.h>
+#include <vector>
 #include "Logger.h"
 #include "ShaderProgram.h"
-#include "Camera.h"
 
+// Length of the line drawn along the normal of a contact point
+#define PHYS_DBG_CONTACT_NORMAL_LEN 0.3f
+// Size of the cross drawn at a contact point
+#define PHYS_DBG_CONTACT_CROSS_SIZE 0.05f
+
+/*
+ * Collects the lines Bullet draws and draws them in one call in `flushLines()`.
+ */
 class PhysicsDebugDraw final : public btIDebugDraw
 {
 private:
+    struct LineVertex
+    {
+        float pos[3];
+        float color[3];
+    };
+
     uint            m_lineVAO{};
     uint            m_lineVBO{};
+    size_t          m_lineVBOCap{}; // In vertices
     ShaderProgram   m_lineShader;
-    float           m_lineVerts[3*2]{};
+    std::vector<LineVertex> m_lineVerts;
+    size_t          m_linesLastFlush{};
 
     DebugDrawModes  m_drawMode{};
 
-public:
-    PhysicsDebugDraw()
+    inline void addVertex(const btVector3& pos, const btVector3& color)
     {
-        m_lineShader.open("../shaders/line.vert.glsl", "../shaders/line.frag.glsl");
-
-        glGenVertexArrays(1, &m_lineVAO);
-        glBindVertexArray(m_lineVAO);
+        m_lineVerts.push_back({{pos.x(), pos.y(), pos.z()}, {color.x(), color.y(), color.z()}});
+    }
 
-        glGenBuffers(1, &m_lineVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_lineVerts), nullptr, GL_DYNAMIC_DRAW);
+public:
+    PhysicsDebugDraw();
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, (void*)0);
-        glEnableVertexAttribArray(0);
-    }
+    // Copy ctor, copy assignment op
+    PhysicsDebugDraw(const PhysicsDebugDraw&) = delete;
+    PhysicsDebugDraw& operator=(const PhysicsDebugDraw&) = delete;
+    // Move ctor, move assignment op
+    PhysicsDebugDraw(PhysicsDebugDraw&&) = delete;
+    PhysicsDebugDraw& operator=(PhysicsDebugDraw&&) = delete;
 
-    void updateUniforms(Camera& cam)
+    virtual void drawLine(const btVector3& from, const btVector3& to, const btVector3& color)
     {
-        m_lineShader.use();
-        cam.updateShaderUniforms(m_lineShader.getId());
+        addVertex(from, color);
+        addVertex(to, color);
     }
 
-    virtual void drawLine(const btVector3& from, const btVector3& to, const btVector3& color)
+    virtual void drawLine(const btVector3& from, const btVector3& to,
+            const btVector3& fromColor, const btVector3& toColor)
     {
-        static btVector3 lastLineColor{};
-        if (lastLineColor != color)
-        {
-            lastLineColor = color;
-            glUniform3f(glGetUniformLocation(m_lineShader.getId(), "lineColor"), color.x(), color.y(), color.z());
-        }
-
-        glBindVertexArray(m_lineVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-
-        m_lineVerts[0] = from.x();
-        m_lineVerts[1] = from.y();
-        m_lineVerts[2] = from.z();
-        m_lineVerts[3] = to.x();
-        m_lineVerts[4] = to.y();
-        m_lineVerts[5] = to.z();
-
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(m_lineVerts), m_lineVerts);
-        glDrawArrays(GL_LINES, 0, 2);
+        addVertex(from, fromColor);
+        addVertex(to, toColor);
     }
 
+    // Draws the normal and a small cross at the point
     virtual void drawContactPoint(
             const btVector3& pointOnB,
             const btVector3& normalOnB,
             btScalar distance,
             int lifeTime,
-            const btVector3& color)
-    {
-        // TODO
-        (void)pointOnB;
-        (void)normalOnB;
-        (void)distance;
-        (void)lifeTime;
-        (void)color;
-    }
+            const btVector3& color);
 
     virtual void reportErrorWarning(const char* warningString)
     {
-        // TODO
-        (void)warningString;
+        Logger::warn << "Bullet: " << warningString << Logger::End;
     }
 
     virtual void draw3dText(const btVector3& location, const char* textString)
@@ -100,9 +91,13 @@ public:
         return m_drawMode;
     }
 
-    ~PhysicsDebugDraw()
-    {
-        glDeleteVertexArrays(1, &m_lineVAO);
-        glDeleteBuffers(1, &m_lineVBO);
-    }
+    /*
+     * Draws the lines collected since the last call with one draw call.
+     * The camera matrices come from the shared uniform block.
+     */
+    void flushLines();
+
+    inline size_t getLinesLastFlush() const { return m_linesLastFlush; }
+
+    ~PhysicsDebugDraw();
 };
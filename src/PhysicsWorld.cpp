@@ -1,4 +1,8 @@
 #include "PhysicsWorld.h"
+#include "Logger.h"
+#include "Trace.h"
+#include <algorithm>
+#include <unordered_set>
 
 PhysicsWorld::PhysicsWorld()
     : m_collisionConfig{std::make_unique<btDefaultCollisionConfiguration>()}
@@ -15,11 +19,14 @@ PhysicsWorld::PhysicsWorld()
 
 void PhysicsWorld::setDbgMode(PhysicsDebugDraw::DebugDrawModes mode)
 {
+    // Bullet reads the mode while stepping
+    auto lock = lockWorld();
     m_dbgDrawer->setDebugMode(mode);
 }
 
 void PhysicsWorld::setDbgMode(int mode)
 {
+    auto lock = lockWorld();
     m_dbgDrawer->setDebugMode(mode);
 }
 
@@ -28,43 +35,199 @@ PhysicsDebugDraw::DebugDrawModes PhysicsWorld::getDbgMode() const
     return (PhysicsDebugDraw::DebugDrawModes)m_dbgDrawer->getDebugMode();
 }
 
-void PhysicsWorld::updateDbgDrawUniforms(Camera& cam)
+void PhysicsWorld::start()
 {
-    if (m_dbgDrawer->getDebugMode() != PhysicsDebugDraw::DebugDrawModes::DBG_NoDebug)
-    {
-        m_dbgDrawer->updateUniforms(cam);
-    }
+    assert(!isRunning());
+    const clock_t::time_point now = clock_t::now();
+    m_currSnapshot.fromTime = now;
+    m_currSnapshot.toTime = now;
+    m_shouldStop = false;
+    m_thread = std::thread{&PhysicsWorld::threadLoop, this, now};
+    LOGGER_VERB << "Started the physics thread with a step of " << PHYS_FIXED_TIMESTEP*1000 << "ms" << Logger::End;
+}
+
+void PhysicsWorld::stop()
+{
+    if (!isRunning())
+        return;
+    m_shouldStop = true;
+    m_thread.join();
+}
+
+void PhysicsWorld::startManual(clock_t::time_point startTime)
+{
+    assert(!isRunning());
+    m_currSnapshot.fromTime = startTime;
+    m_currSnapshot.toTime = startTime;
+    m_manualSimTime = startTime;
+    LOGGER_VERB << "Stepping the physics on the calling thread with a step of " << PHYS_FIXED_TIMESTEP*1000 << "ms" << Logger::End;
 }
 
-void PhysicsWorld::stepSimulation(float step)
+uint32_t PhysicsWorld::stepTo(clock_t::time_point now)
 {
-    m_dynamicsWorld->stepSimulation(step, 10);
-    m_dynamicsWorld->debugDrawWorld();
+    assert(!isRunning());
+    return update(now, &m_manualSimTime);
 }
 
-void PhysicsWorld::applyTransforms(std::vector<std::unique_ptr<GameObject>>& objs)
+uint32_t PhysicsWorld::update(clock_t::time_point now, clock_t::time_point* simTime)
 {
-    for (size_t i{}; i < getObjectCount(); ++i)
+    const auto step = std::chrono::duration_cast<clock_t::duration>(
+            std::chrono::duration<double>{PHYS_FIXED_TIMESTEP});
+
+    const clock_t::time_point updateStart = clock_t::now();
+    const clock_t::time_point fromTime = *simTime;
+    uint32_t substeps{};
     {
-        auto cobj = getObj(i);
-        assert(cobj);
-        auto cbody = btRigidBody::upcast(cobj);
-        assert(cbody);
-        if (cbody)
+        auto lock = lockWorld();
+        // The motion states fill the back snapshot while stepping
+        ++m_updateId;
+        m_backSnapshot.entries.clear();
+        while (*simTime+step <= now && substeps < PHYS_MAX_SUBSTEPS)
         {
-            auto trans = cobj->getWorldTransform();
-            objs[i]->setPos(
-                    {trans.getOrigin().getX(), trans.getOrigin().getY(), trans.getOrigin().getZ()});
-            objs[i]->setRotationQuat(
-                    {trans.getRotation().w(), trans.getRotation().x(),
-                    trans.getRotation().y(), trans.getRotation().z()});
+            // With 0 max substeps Bullet takes exactly one step of the given length
+            m_dynamicsWorld->stepSimulation(PHYS_FIXED_TIMESTEP, 0);
+            *simTime += step;
+            ++substeps;
         }
+
+        // Too far behind, catching up would only make it worse
+        if (*simTime+step <= now)
+        {
+            const auto dropped = (now-*simTime)/step;
+            *simTime += dropped*step;
+            m_droppedSteps.fetch_add(dropped, std::memory_order_relaxed);
+        }
+
+        if (substeps)
+            publishSnapshot(fromTime, *simTime);
+    }
+
+    if (substeps)
+    {
+        m_lastSubstepCount.store(substeps, std::memory_order_relaxed);
+        const int64_t updateDurUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    clock_t::now()-updateStart).count();
+        m_lastUpdateDurUs.store(updateDurUs, std::memory_order_relaxed);
+        LOGGER_TRACE("Physics update: {} substeps, {} bodies moved, {}us",
+                substeps, m_lastMovedCount.load(std::memory_order_relaxed), updateDurUs);
+    }
+    return substeps;
+}
+
+void PhysicsWorld::threadLoop(clock_t::time_point simTime)
+{
+    const auto step = std::chrono::duration_cast<clock_t::duration>(
+            std::chrono::duration<double>{PHYS_FIXED_TIMESTEP});
+
+    while (!m_shouldStop)
+    {
+        update(clock_t::now(), &simTime);
+        std::this_thread::sleep_until(simTime+step);
+    }
+}
+
+void PhysicsWorld::MotionState::setWorldTransform(const btTransform& worldTrans)
+{
+    // Active bodies are reported even if they are resting
+    if (worldTrans == transform)
+        return;
+
+    Snapshot& snapshot = world->m_backSnapshot;
+    if (updateId != world->m_updateId)
+    {
+        // First step of the update that moved the body
+        updateId = world->m_updateId;
+        entryI = snapshot.entries.size();
+        snapshot.entries.push_back({this, {transform.getOrigin(), transform.getRotation()}, {}, true});
+    }
+    snapshot.entries[entryI].to = {worldTrans.getOrigin(), worldTrans.getRotation()};
+    transform = worldTrans;
+}
+
+void PhysicsWorld::publishSnapshot(clock_t::time_point fromTime, clock_t::time_point toTime)
+{
+    const size_t movedCount = m_backSnapshot.entries.size();
+    m_lastMovedCount.store(movedCount, std::memory_order_relaxed);
+
+    bool isCurrSeen;
+    {
+        std::lock_guard<std::mutex> lock{m_snapshotMutex};
+        isCurrSeen = m_isCurrSeen;
+    }
+
+    // Bodies that moved in the previous snapshot but not in this one have to be put
+    // to their final place. If the render thread missed the previous snapshot, all of it is kept.
+    // Only this thread writes the current snapshot, so it can be read without the lock.
+    for (const Entry& prev : m_currSnapshot.entries)
+    {
+        if (prev.state->updateId == m_updateId || (isCurrSeen && !prev.isMoving))
+            continue;
+        prev.state->updateId = m_updateId;
+        prev.state->entryI = m_backSnapshot.entries.size();
+        m_backSnapshot.entries.push_back({prev.state, prev.to, prev.to, false});
+    }
+    m_backSnapshot.fromTime = fromTime;
+    m_backSnapshot.toTime = toTime;
+
+    std::lock_guard<std::mutex> lock{m_snapshotMutex};
+    std::swap(m_currSnapshot, m_backSnapshot);
+    m_isCurrSeen = false;
+}
+
+void PhysicsWorld::applyTransforms(clock_t::time_point now/*=clock_t::now()*/)
+{
+    std::lock_guard<std::mutex> lock{m_snapshotMutex};
+
+    // Render one step in the past, so there is usually a newer state to interpolate to
+    const auto renderTime = now-std::chrono::duration<double>{PHYS_FIXED_TIMESTEP};
+    const std::chrono::duration<double> span = m_currSnapshot.toTime-m_currSnapshot.fromTime;
+    btScalar alpha = 1;
+    if (span.count() > 0)
+        alpha = std::clamp(std::chrono::duration<double>{renderTime-m_currSnapshot.fromTime}/span, 0.0, 1.0);
+
+    for (const Entry& entry : m_currSnapshot.entries)
+    {
+        // Already placed in an earlier frame
+        if (!entry.isMoving && m_isCurrSeen)
+            continue;
+
+        const btVector3 pos = entry.from.pos.lerp(entry.to.pos, alpha);
+        const btQuaternion rot = entry.from.rot.slerp(entry.to.rot, alpha);
+        entry.state->object->setPosAndRotation(
+                {pos.getX(), pos.getY(), pos.getZ()},
+                {rot.w(), rot.x(), rot.y(), rot.z()});
     }
+    m_isCurrSeen = true;
+}
+
+void PhysicsWorld::drawDebug()
+{
+    if (m_dbgDrawer->getDebugMode() != PhysicsDebugDraw::DebugDrawModes::DBG_NoDebug)
+    {
+        // Only collecting the lines needs the world, they are drawn after unlocking
+        auto lock = lockWorld();
+        m_dynamicsWorld->debugDrawWorld();
+    }
+    m_dbgDrawer->flushLines();
 }
 
 void PhysicsWorld::addObject(GameObject* obj)
+{
+    auto lock = lockWorld();
+    addObjectLocked(obj);
+}
+
+void PhysicsWorld::addObjects(const std::vector<GameObject*>& objects)
+{
+    auto lock = lockWorld();
+    for (GameObject* obj : objects)
+        addObjectLocked(obj);
+}
+
+void PhysicsWorld::addObjectLocked(GameObject* obj)
 {
     assert(obj);
+    assert(!obj->m_body);
     if (!obj->m_collShape)
     {
         obj->m_collShape.reset(new btEmptyShape);
@@ -81,16 +244,52 @@ void PhysicsWorld::addObject(GameObject* obj)
     if (isDynamic)
         obj->m_collShape->calculateLocalInertia(obj->m_mass, localInertia);
 
-    startTransform.setOrigin(btVector3{obj->m_pos.x, obj->m_pos.y, obj->m_pos.z});
+    const glm::vec3 pos = obj->getPos();
+    startTransform.setOrigin(btVector3{pos.x, pos.y, pos.z});
 
-    btDefaultMotionState* motionState = new btDefaultMotionState{startTransform};
+    MotionState* motionState = new MotionState{this, obj, startTransform};
     btRigidBody::btRigidBodyConstructionInfo rbInfo{
         obj->m_mass, motionState, obj->m_collShape.get(), localInertia};
     btRigidBody* body = new btRigidBody{rbInfo};
+    body->setUserPointer(obj);
+    obj->m_body = body;
 
     m_dynamicsWorld->addRigidBody(body);
 }
 
+void PhysicsWorld::removeObjects(const std::vector<GameObject*>& objects)
+{
+    auto lock = lockWorld();
+
+    std::unordered_set<const MotionState*> removedStates;
+    removedStates.reserve(objects.size());
+    for (GameObject* obj : objects)
+    {
+        btRigidBody* body = obj->m_body;
+        if (!body)
+            continue;
+        m_dynamicsWorld->removeRigidBody(body);
+        removedStates.insert((const MotionState*)body->getMotionState());
+    }
+
+    // The back snapshot is cleared before the next step, but the render thread
+    // would still apply the published one to the destroyed objects
+    {
+        std::lock_guard<std::mutex> snapshotLock{m_snapshotMutex};
+        std::erase_if(m_currSnapshot.entries, [&](const Entry& entry){
+                return removedStates.contains(entry.state); });
+    }
+
+    for (GameObject* obj : objects)
+    {
+        if (!obj->m_body)
+            continue;
+        delete obj->m_body->getMotionState();
+        delete obj->m_body;
+        obj->m_body = nullptr;
+    }
+}
+
 btCollisionObject* PhysicsWorld::getObj(size_t i)
 {
     if (i >= (size_t)m_dynamicsWorld->getNumCollisionObjects())
@@ -100,6 +299,8 @@ btCollisionObject* PhysicsWorld::getObj(size_t i)
 
 PhysicsWorld::~PhysicsWorld()
 {
+    stop();
+
     for (int i{}; i < m_dynamicsWorld->getNumCollisionObjects(); ++i)
     {
         btCollisionObject* obj = m_dynamicsWorld->getCollisionObjectArray()[i];
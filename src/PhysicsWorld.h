@@ -1,14 +1,36 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "GameObject.h"
 #include "PhysicsDebugDraw.h"
 #include <bullet/BulletCollision/btBulletCollisionCommon.h>
 #include <bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
 #include <bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <bullet/BulletDynamics/Dynamics/btRigidBody.h>
 
+// The simulation always advances with steps of this length
+#define PHYS_FIXED_TIMESTEP (1/60.0)
+// If the thread falls behind more than this many steps, the rest of the time is dropped
+#define PHYS_MAX_SUBSTEPS 8
+
+/*
+ * The dynamics world, stepped with a fixed timestep on its own thread.
+ *
+ * After every update the thread publishes the transforms of the bodies that
+ * moved through a double buffer, and the render thread interpolates them in
+ * `applyTransforms()`. The render thread must hold `lockWorld()` while it
+ * touches the Bullet world directly.
+ */
 class PhysicsWorld final
 {
+public:
+    using clock_t = std::chrono::steady_clock;
+
 private:
     std::unique_ptr<btDefaultCollisionConfiguration> m_collisionConfig;
     std::unique_ptr<btCollisionDispatcher> m_dispatcher;
@@ -18,21 +40,169 @@ private:
 
     std::unique_ptr<PhysicsDebugDraw> m_dbgDrawer;
 
+    struct BodyTransform
+    {
+        btVector3 pos;
+        btQuaternion rot;
+    };
+
+    /*
+     * Links a body to its GameObject. Bullet only reports the transforms
+     * of active bodies to their motion state, so sleeping and static bodies
+     * never show up in the snapshots.
+     */
+    class MotionState final : public btMotionState
+    {
+    public:
+        PhysicsWorld* world;
+        GameObject* object;
+        // The transform last reported by Bullet
+        btTransform transform;
+        // The update the entry at `entryI` in the back snapshot belongs to
+        uint64_t updateId{};
+        size_t entryI{};
+
+        MotionState(PhysicsWorld* world, GameObject* object, const btTransform& startTransform)
+            : world{world}, object{object}, transform{startTransform}
+        {
+        }
+
+        virtual void getWorldTransform(btTransform& worldTrans) const { worldTrans = transform; }
+        // Called by the physics thread after every step for each active body
+        virtual void setWorldTransform(const btTransform& worldTrans);
+    };
+
+    struct Entry
+    {
+        MotionState* state;
+        BodyTransform from;
+        BodyTransform to;
+        // Cleared for bodies that stopped, those are only moved to `to` once
+        bool isMoving;
+    };
+
+    /*
+     * The bodies that moved in one update of the physics thread, and the bodies
+     * that stopped since the previous snapshot, with their transforms at
+     * the start and at the end of the update.
+     */
+    struct Snapshot
+    {
+        clock_t::time_point fromTime;
+        clock_t::time_point toTime;
+        std::vector<Entry> entries;
+    };
+
+    std::thread m_thread;
+    std::atomic<bool> m_shouldStop{};
+    // Guards `m_dynamicsWorld` while the thread is running
+    std::mutex m_worldMutex;
+
+    // Guards the published snapshot
+    std::mutex m_snapshotMutex;
+    Snapshot m_currSnapshot;
+    // Set when the render thread picked up / applied the entries of `m_currSnapshot`
+    bool m_isCurrSeen{};
+    // Filled by the physics thread and swapped with the current one when complete
+    Snapshot m_backSnapshot;
+    uint64_t m_updateId{};
+
+    std::atomic<uint32_t> m_lastUpdateDurUs{};
+    std::atomic<uint32_t> m_lastSubstepCount{};
+    std::atomic<uint64_t> m_droppedSteps{};
+    std::atomic<uint32_t> m_lastMovedCount{};
+
+    // The simulation time of `stepTo()`, when there is no thread
+    clock_t::time_point m_manualSimTime{};
+
+    void threadLoop(clock_t::time_point simTime);
+    /*
+     * Takes the fixed steps from `*simTime` up to `now` and publishes them.
+     *
+     * Returns: The number of steps taken
+     */
+    uint32_t update(clock_t::time_point now, clock_t::time_point* simTime);
+    // Adds the stopped bodies to the back snapshot and swaps it in
+    void publishSnapshot(clock_t::time_point fromTime, clock_t::time_point toTime);
+
+    // Creates the body of the object and adds it to the world. The world must be locked.
+    void addObjectLocked(GameObject* obj);
+
 public:
+    // The memory used by the body of an object, without its collision shape
+    static constexpr size_t bodyMemSize = sizeof(btRigidBody)+sizeof(MotionState);
+
     PhysicsWorld();
     ~PhysicsWorld();
 
+    // Copy ctor, copy assignment op
+    PhysicsWorld(const PhysicsWorld&) = delete;
+    PhysicsWorld& operator=(const PhysicsWorld&) = delete;
+    // Move ctor, move assignment op
+    PhysicsWorld(PhysicsWorld&&) = delete;
+    PhysicsWorld& operator=(PhysicsWorld&&) = delete;
+
     void setDbgMode(PhysicsDebugDraw::DebugDrawModes mode);
     void setDbgMode(int mode);
     PhysicsDebugDraw::DebugDrawModes getDbgMode() const;
-    void updateDbgDrawUniforms(Camera& cam);
-    void stepSimulation(float step);
-    void applyTransforms(std::vector<std::unique_ptr<GameObject>>& objs);
+    inline size_t getDbgLineCount() const { return m_dbgDrawer->getLinesLastFlush(); }
+
+    /*
+     * Starts the physics thread. Objects can be added and removed while it runs.
+     */
+    void start();
+    // Stops and joins the physics thread
+    void stop();
+    inline bool isRunning() const { return m_thread.joinable(); }
+
+    /*
+     * Instead of the thread, the simulation is advanced by `stepTo()` on the
+     * calling thread. With a simulated clock the run is deterministic.
+     */
+    void startManual(clock_t::time_point startTime);
+    /*
+     * Takes the steps up to `now` and publishes them like an update of the thread.
+     *
+     * Returns: The number of steps taken
+     */
+    uint32_t stepTo(clock_t::time_point now);
+
+    /*
+     * Moves the objects of the bodies in the last snapshot to their state one
+     * step before `now`, interpolated between the start and the end of the update.
+     * Objects that did not move are not touched.
+     */
+    void applyTransforms(clock_t::time_point now=clock_t::now());
+
+    /*
+     * Draws the debug lines of the current state of the world.
+     * Must be called on the render thread.
+     */
+    void drawDebug();
+
+    // Time spent in the last update, with all its substeps
+    inline uint32_t getLastUpdateDurUs() const { return m_lastUpdateDurUs.load(std::memory_order_relaxed); }
+    // The number of fixed steps taken in the last update
+    inline uint32_t getLastSubstepCount() const { return m_lastSubstepCount.load(std::memory_order_relaxed); }
+    // The number of bodies that moved in the last update
+    inline uint32_t getLastMovedCount() const { return m_lastMovedCount.load(std::memory_order_relaxed); }
+    // The number of steps skipped because the thread fell behind
+    inline uint64_t getDroppedSteps() const { return m_droppedSteps.load(std::memory_order_relaxed); }
 
     void addObject(GameObject* obj);
+    // Adds the objects with locking the world once
+    void addObjects(const std::vector<GameObject*>& objects);
+    /*
+     * Removes the bodies of the objects from the world and from the last snapshot.
+     * The objects can be destroyed after this.
+     */
+    void removeObjects(const std::vector<GameObject*>& objects);
     inline size_t getObjectCount() const { return m_dynamicsWorld->getNumCollisionObjects(); };
     btCollisionObject* getObj(size_t i);
 
+    /*
+     * Locks the world against the physics thread, hold it while using `getWorld()`.
+     */
+    [[nodiscard]] inline std::unique_lock<std::mutex> lockWorld() { return std::unique_lock<std::mutex>{m_worldMutex}; }
     inline btDynamicsWorld* getWorld() { return m_dynamicsWorld.get(); }
 };
-
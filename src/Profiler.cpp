@@ -0,0 +1,258 @@
+#include "Profiler.h"
+#include "Logger.h"
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+
+Profiler::Profiler()
+    : m_startTime{clock_t::now()}, m_frames(PROFILER_FRAME_HISTORY)
+{
+}
+
+int Profiler::allocQuery()
+{
+    if (m_freeQueryIs.empty())
+    {
+        uint query;
+        glGenQueries(1, &query);
+        m_queryPool.push_back(query);
+        return m_queryPool.size()-1;
+    }
+    const int queryI = m_freeQueryIs.back();
+    m_freeQueryIs.pop_back();
+    return queryI;
+}
+
+void Profiler::collectQueryResults(Frame* frame, bool shouldWait)
+{
+    for (ZoneRecord& zone : frame->zones)
+    {
+        if (zone.queryI == -1)
+            continue;
+
+        const uint query = m_queryPool[zone.queryI];
+        if (!shouldWait)
+        {
+            int isAvailable{};
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+            if (!isAvailable)
+                continue;
+        }
+        GLuint64 elapsedNs{};
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+        zone.gpuDurNs = elapsedNs;
+        m_freeQueryIs.push_back(zone.queryI);
+        zone.queryI = -1;
+    }
+}
+
+void Profiler::beginFrame()
+{
+    assert(!m_isInFrame);
+
+    // The results of the previous frames arrive a few frames later
+    const size_t frameCount = std::min<uint64_t>(m_frameCount, m_frames.size());
+    for (size_t i{}; i < frameCount; ++i)
+    {
+        Frame& frame = m_frames[(m_frameCount-1-i)%m_frames.size()];
+        // The oldest frame is overwritten next, don't leave its queries behind
+        collectQueryResults(&frame, i+1 == m_frames.size());
+    }
+
+    ++m_frameCount;
+    Frame& frame = getCurrFrame();
+    frame.index = m_frameCount-1;
+    frame.startNs = getNowNs();
+    frame.durNs = 0;
+    frame.zones.clear();
+    m_isInFrame = true;
+}
+
+void Profiler::endFrame()
+{
+    assert(m_isInFrame);
+    assert(m_zoneStack.empty());
+
+    Frame& frame = getCurrFrame();
+    frame.durNs = getNowNs()-frame.startNs;
+    m_isInFrame = false;
+}
+
+uint32_t Profiler::beginZone(const char* name, bool isGpuTimed)
+{
+    assert(m_isInFrame);
+
+    Frame& frame = getCurrFrame();
+    ZoneRecord zone;
+    zone.name = name;
+    zone.depth = m_zoneStack.size();
+    if (isGpuTimed && !m_isGpuZoneOpen)
+    {
+        zone.queryI = allocQuery();
+        glBeginQuery(GL_TIME_ELAPSED, m_queryPool[zone.queryI]);
+        m_isGpuZoneOpen = true;
+    }
+    // Last, so the query setup is not counted
+    zone.cpuStartNs = getNowNs();
+
+    frame.zones.push_back(zone);
+    m_zoneStack.push_back(frame.zones.size()-1);
+    return frame.zones.size()-1;
+}
+
+void Profiler::endZone(uint32_t zoneI)
+{
+    const int64_t endNs = getNowNs();
+
+    assert(m_isInFrame);
+    assert(!m_zoneStack.empty() && m_zoneStack.back() == zoneI);
+    m_zoneStack.pop_back();
+
+    ZoneRecord& zone = getCurrFrame().zones[zoneI];
+    zone.cpuDurNs = endNs-zone.cpuStartNs;
+    if (zone.queryI != -1)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_isGpuZoneOpen = false;
+    }
+}
+
+std::string Profiler::formatBreakdown(size_t frameCount/*=PROFILER_DEF_BREAKDOWN_FRAMES*/) const
+{
+    struct ZoneStats
+    {
+        const char* name;
+        uint32_t depth;
+        int64_t cpuSumNs{};
+        size_t cpuCount{};
+        int64_t gpuSumNs{};
+        size_t gpuCount{};
+    };
+    // In the order of the first appearance
+    std::vector<ZoneStats> stats;
+    int64_t frameSumNs{};
+    int64_t frameMaxNs{};
+
+    const uint64_t finishedCount = m_frameCount-(m_isInFrame ? 1 : 0);
+    frameCount = std::min<uint64_t>({frameCount, finishedCount, m_frames.size()-(m_isInFrame ? 1 : 0)});
+    for (size_t i{}; i < frameCount; ++i)
+    {
+        const Frame& frame = m_frames[(finishedCount-1-i)%m_frames.size()];
+        frameSumNs += frame.durNs;
+        frameMaxNs = std::max(frameMaxNs, frame.durNs);
+        for (const ZoneRecord& zone : frame.zones)
+        {
+            auto it = std::find_if(stats.begin(), stats.end(), [&](const ZoneStats& entry){
+                    return entry.depth == zone.depth && std::strcmp(entry.name, zone.name) == 0; });
+            if (it == stats.end())
+            {
+                stats.push_back({zone.name, zone.depth});
+                it = stats.end()-1;
+            }
+            it->cpuSumNs += zone.cpuDurNs;
+            ++it->cpuCount;
+            if (zone.gpuDurNs != -1)
+            {
+                it->gpuSumNs += zone.gpuDurNs;
+                ++it->gpuCount;
+            }
+        }
+    }
+    if (frameCount == 0)
+        return "No frames recorded";
+
+    char line[128];
+    snprintf(line, sizeof(line), "Frame: avg %.2fms, max %.2fms (%zu frames)",
+            frameSumNs/1e6/frameCount, frameMaxNs/1e6, frameCount);
+    std::string output = line;
+    output += "\nZone              CPU ms   GPU ms";
+    for (const ZoneStats& entry : stats)
+    {
+        const std::string name = std::string(entry.depth*2, ' ')+entry.name;
+        if (entry.gpuCount)
+            snprintf(line, sizeof(line), "\n%-16s %7.3f  %7.3f", name.c_str(),
+                    entry.cpuSumNs/1e6/frameCount, entry.gpuSumNs/1e6/entry.gpuCount);
+        else
+            snprintf(line, sizeof(line), "\n%-16s %7.3f        -", name.c_str(), entry.cpuSumNs/1e6/frameCount);
+        output += line;
+    }
+    return output;
+}
+
+static void writeJsonString(std::ostream& output, const char* str)
+{
+    output << '"';
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            output << '\\';
+        output << *str;
+    }
+    output << '"';
+}
+
+bool Profiler::exportChromeTrace(const std::string& path) const
+{
+    std::ofstream file{path, std::ios::trunc};
+    if (!file.is_open())
+    {
+        Logger::err << "Failed to create profiler trace: " << path << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+
+    // Complete events ("ph": "X") in microseconds, CPU zones on track 1, GPU zones on track 2
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    char buffer[128];
+    auto writeEvent{[&](const char* name, int tid, int64_t startNs, int64_t durNs){
+        file << ",\n{\"name\":";
+        writeJsonString(file, name);
+        snprintf(buffer, sizeof(buffer), ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                tid, startNs/1e3, durNs/1e3);
+        file << buffer;
+    }};
+
+    const uint64_t finishedCount = m_frameCount-(m_isInFrame ? 1 : 0);
+    const size_t frameCount = std::min<uint64_t>(finishedCount, m_frames.size()-(m_isInFrame ? 1 : 0));
+    for (size_t i{}; i < frameCount; ++i)
+    {
+        // Oldest first
+        const Frame& frame = m_frames[(finishedCount-frameCount+i)%m_frames.size()];
+        char frameName[32];
+        snprintf(frameName, sizeof(frameName), "Frame %llu", (unsigned long long)frame.index);
+        writeEvent(frameName, 1, frame.startNs, frame.durNs);
+        for (const ZoneRecord& zone : frame.zones)
+        {
+            writeEvent(zone.name, 1, zone.cpuStartNs, zone.cpuDurNs);
+            if (zone.gpuDurNs != -1)
+                writeEvent(zone.name, 2, zone.cpuStartNs, zone.gpuDurNs);
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file.good())
+    {
+        Logger::err << "Failed to write profiler trace: " << path << Logger::End;
+        return 1;
+    }
+    Logger::log << "Exported " << frameCount << " frames to " << path << Logger::End;
+    return 0;
+}
+
+int64_t Profiler::getLastFrameDurNs() const
+{
+    const uint64_t finishedCount = m_frameCount-(m_isInFrame ? 1 : 0);
+    if (finishedCount == 0)
+        return 0;
+    return m_frames[(finishedCount-1)%m_frames.size()].durNs;
+}
+
+Profiler::~Profiler()
+{
+    glDeleteQueries(m_queryPool.size(), m_queryPool.data());
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// The number of recent frames kept for the breakdown and the trace export
+#define PROFILER_FRAME_HISTORY 300
+// The number of frames averaged by `formatBreakdown()`
+#define PROFILER_DEF_BREAKDOWN_FRAMES 60
+
+/*
+ * Frame profiler with scoped zones. Render thread only.
+ *
+ * CPU zones are timed with `steady_clock` and can be nested. GPU zones are
+ * also timed on the GPU with `GL_TIME_ELAPSED` queries. The queries are read
+ * back in later frames, without waiting for the GPU. GL allows only one
+ * elapsed time query at a time, so a GPU zone inside another GPU zone is only
+ * timed on the CPU.
+ *
+ * The last `PROFILER_FRAME_HISTORY` frames are kept in a ring buffer. They can be
+ * shown as a per-zone breakdown and exported as Chrome trace JSON
+ * (chrome://tracing or https://ui.perfetto.dev).
+ */
+class Profiler final
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    struct ZoneRecord
+    {
+        const char* name{};
+        // The number of enclosing zones
+        uint32_t depth{};
+        // Relative to the start of the profiler
+        int64_t cpuStartNs{};
+        int64_t cpuDurNs{};
+        // Index in `m_queryPool`, -1 if not timed on the GPU or already read back
+        int queryI{-1};
+        // -1 if not timed on the GPU or not available yet
+        int64_t gpuDurNs{-1};
+    };
+
+    struct Frame
+    {
+        uint64_t index{};
+        int64_t startNs{};
+        int64_t durNs{};
+        std::vector<ZoneRecord> zones;
+    };
+
+    /*
+     * Times the enclosing scope:
+     *      Profiler::Zone zone{&profiler, "Scene draw", true};
+     */
+    class Zone final
+    {
+    private:
+        Profiler* m_profiler;
+        uint32_t m_zoneI;
+
+    public:
+        Zone(Profiler* profiler, const char* name, bool isGpuTimed=false)
+            : m_profiler{profiler}, m_zoneI{profiler->beginZone(name, isGpuTimed)}
+        {
+        }
+
+        // Copy ctor, copy assignment op
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+        // Move ctor, move assignment op
+        Zone(Zone&&) = delete;
+        Zone& operator=(Zone&&) = delete;
+
+        ~Zone() { m_profiler->endZone(m_zoneI); }
+    };
+
+private:
+    clock_t::time_point m_startTime;
+    std::vector<Frame> m_frames;
+    // The number of frames begun, the current one is `m_frames[(m_frameCount-1)%size]`
+    uint64_t m_frameCount{};
+    bool m_isInFrame{};
+    // The open zones of the current frame, indices in `Frame::zones`
+    std::vector<uint32_t> m_zoneStack;
+    // Whether an elapsed time query is running
+    bool m_isGpuZoneOpen{};
+
+    std::vector<uint> m_queryPool;
+    std::vector<int> m_freeQueryIs;
+
+    inline int64_t getNowNs() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now()-m_startTime).count();
+    }
+    inline Frame& getCurrFrame() { return m_frames[(m_frameCount-1)%m_frames.size()]; }
+
+    int allocQuery();
+    // Reads back the results available without waiting. If `shouldWait` is set, waits for all of them.
+    void collectQueryResults(Frame* frame, bool shouldWait);
+
+public:
+    Profiler();
+
+    // Copy ctor, copy assignment op
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    // Move ctor, move assignment op
+    Profiler(Profiler&&) = delete;
+    Profiler& operator=(Profiler&&) = delete;
+
+    // Starts recording a frame, the oldest one in the ring is overwritten
+    void beginFrame();
+    void endFrame();
+
+    /*
+     * Prefer `Zone`.
+     * name: Must live as long as the profiler, e.g. a string literal
+     *
+     * Returns: The index of the zone, for `endZone()`
+     */
+    uint32_t beginZone(const char* name, bool isGpuTimed);
+    void endZone(uint32_t zoneI);
+
+    /*
+     * Returns: The average CPU and GPU time of each zone of the last
+     *          `frameCount` finished frames, one line per zone, indented by depth
+     */
+    std::string formatBreakdown(size_t frameCount=PROFILER_DEF_BREAKDOWN_FRAMES) const;
+
+    /*
+     * Writes the kept frames as Chrome trace JSON. The GPU zones are on a separate
+     * track, placed at the CPU time of the zone since the GPU clock is not synchronized.
+     *
+     * Returns:
+     *      true if failed,
+     *      false otherwise
+     */
+    bool exportChromeTrace(const std::string& path) const;
+
+    // The duration of the last finished frame
+    int64_t getLastFrameDurNs() const;
+    inline uint64_t getFrameCount() const { return m_frameCount; }
+
+    ~Profiler();
+};
@@ -0,0 +1,91 @@
+#include "RenderQueue.h"
+#include "Model.h"
+#include "Texture.h"
+#include "Logger.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+RenderQueue::RenderQueue()
+{
+    glGenBuffers(1, &m_instanceBuffer);
+}
+
+void RenderQueue::submit(ShaderProgram* shader, ShaderProgram::UniformHandle<int> isTexUpsideDownUniform,
+        Model* model, Texture* texture, const glm::mat4& modelMat)
+{
+    assert(shader);
+    assert(model);
+    assert(texture);
+
+    m_items.push_back({shader, isTexUpsideDownUniform, texture, model, (uint32_t)m_matrices.size()});
+    m_matrices.push_back(modelMat);
+}
+
+void RenderQueue::flush()
+{
+    m_drawCallsLastFlush = 0;
+    m_instancesLastFlush = m_items.size();
+    if (m_items.empty())
+        return;
+
+    // Sort by the most expensive state change first
+    std::sort(m_items.begin(), m_items.end(), [](const Item& a, const Item& b){
+        if (a.shader != b.shader) return a.shader < b.shader;
+        if (a.texture != b.texture) return a.texture < b.texture;
+        return a.model < b.model;
+    });
+
+    m_sortedMatrices.resize(m_items.size());
+    for (size_t i{}; i < m_items.size(); ++i)
+        m_sortedMatrices[i] = m_matrices[m_items[i].matrixI];
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    if (m_sortedMatrices.size() > m_instanceBufferCap)
+    {
+        m_instanceBufferCap = std::bit_ceil(m_sortedMatrices.size());
+        LOGGER_VERB << "Resizing instance buffer to " << m_instanceBufferCap << " matrices" << Logger::End;
+    }
+    // Orphan the previous storage, so the driver doesn't wait for the last frame's draws
+    glBufferData(GL_ARRAY_BUFFER, m_instanceBufferCap*sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_sortedMatrices.size()*sizeof(glm::mat4), m_sortedMatrices.data());
+
+    ShaderProgram* currShader{};
+    const Texture* currTexture{};
+    for (size_t groupStart{}; groupStart < m_items.size();)
+    {
+        const Item& first = m_items[groupStart];
+        size_t groupEnd = groupStart+1;
+        while (groupEnd < m_items.size()
+            && m_items[groupEnd].shader == first.shader
+            && m_items[groupEnd].texture == first.texture
+            && m_items[groupEnd].model == first.model)
+            ++groupEnd;
+
+        if (first.shader != currShader)
+        {
+            first.shader->use();
+            currShader = first.shader;
+            // The uniform belongs to the program, set it again
+            currTexture = nullptr;
+        }
+        if (first.texture != currTexture)
+        {
+            first.texture->bind();
+            currShader->setUniform(first.isTexUpsideDownUniform, (int)first.texture->isUpsideDown());
+            currTexture = first.texture;
+        }
+        first.model->drawInstanced(m_instanceBuffer, groupStart*sizeof(glm::mat4), groupEnd-groupStart);
+        ++m_drawCallsLastFlush;
+
+        groupStart = groupEnd;
+    }
+
+    m_items.clear();
+    m_matrices.clear();
+}
+
+RenderQueue::~RenderQueue()
+{
+    glDeleteBuffers(1, &m_instanceBuffer);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "types.h"
+#include "ShaderProgram.h"
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+class Model;
+class Texture;
+
+/*
+ * Collects the draws of a frame and groups the ones with the same
+ * shader, texture and model, so each group is drawn with a single
+ * instanced draw call. The model matrices of the whole frame are
+ * uploaded into one instance buffer.
+ * The shaders must take the model matrix as the per-instance
+ * attribute `VERTEX_ATTR_I_INSTANCE_MAT`.
+ */
+class RenderQueue final
+{
+private:
+    struct Item
+    {
+        ShaderProgram* shader;
+        // Set from `Texture::isUpsideDown()` when the texture changes
+        ShaderProgram::UniformHandle<int> isTexUpsideDownUniform;
+        Texture* texture;
+        Model* model;
+        // Index of the model matrix in `m_matrices`
+        uint32_t matrixI;
+    };
+
+    std::vector<Item> m_items;
+    // The model matrices in submission order
+    std::vector<glm::mat4> m_matrices;
+    // The model matrices in draw order, as uploaded
+    std::vector<glm::mat4> m_sortedMatrices;
+
+    uint m_instanceBuffer{};
+    // The size of the instance buffer in matrices
+    size_t m_instanceBufferCap{};
+
+    size_t m_drawCallsLastFlush{};
+    size_t m_instancesLastFlush{};
+
+public:
+    RenderQueue();
+
+    // Copy ctor, copy assignment op
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+    // Move ctor, move assignment op
+    RenderQueue(RenderQueue&&) = delete;
+    RenderQueue& operator=(RenderQueue&&) = delete;
+
+    /*
+     * Queues a draw. The shader, the model and the texture must be usable and must
+     * outlive the next `flush()`.
+     *
+     * isTexUpsideDownUniform: The `isTexUpsideDown` uniform of the shader, looked up once
+     */
+    void submit(ShaderProgram* shader, ShaderProgram::UniformHandle<int> isTexUpsideDownUniform,
+            Model* model, Texture* texture, const glm::mat4& modelMat);
+
+    /*
+     * Draws the queued objects and clears the queue.
+     * The camera uniforms of the shaders must be set before.
+     */
+    void flush();
+
+    inline size_t getDrawCallsLastFlush() const { return m_drawCallsLastFlush; }
+    inline size_t getInstancesLastFlush() const { return m_instancesLastFlush; }
+
+    ~RenderQueue();
+};
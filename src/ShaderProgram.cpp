@@ -1,10 +1,17 @@
 #include "ShaderProgram.h"
 #include "Logger.h"
+#include "assets.h"
+#include "hash.h"
 #include <SDL2/SDL_opengl_glext.h>
 #include <cstring>
 #include <exception>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+
+using steadyClock_t = std::chrono::steady_clock;
 
 /*
  * Reads the file and sets output to its contents.
@@ -15,7 +22,7 @@
  */
 static bool getFileContents(const std::string& filePath, std::string* output)
 {
-    Logger::verb << "Reading shader file: " << filePath << Logger::End;
+    LOGGER_VERB << "Reading shader file: " << filePath << Logger::End;
 
     std::ifstream fileObject;
     try
@@ -37,7 +44,7 @@ static bool getFileContents(const std::string& filePath, std::string* output)
         return 1;
     }
 
-    Logger::verb << "Shader code:\n" << *output << Logger::End;
+    LOGGER_VERB << "Shader code:\n" << *output << Logger::End;
 
     fileObject.close();
     return 0;
@@ -45,7 +52,7 @@ static bool getFileContents(const std::string& filePath, std::string* output)
 
 static bool compileShader(uint shaderId)
 {
-    Logger::verb << "Compiling shader" << Logger::End;
+    LOGGER_VERB << "Compiling shader" << Logger::End;
 
     glCompileShader(shaderId);
     int compileStatus;
@@ -60,77 +67,470 @@ static bool compileShader(uint shaderId)
     return 0;
 }
 
-bool ShaderProgram::open(const std::string& vertexPath, const std::string& fragmentPath)
+// Header of a program binary cache file, followed by the binary
+struct BinaryCacheHeader
+{
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    sourceHash; // FNV-1a of the shader sources
+    uint64_t    driverHash; // FNV-1a of the GL vendor, renderer and version strings
+    uint32_t    binaryFormat;
+    uint32_t    binarySize;
+};
+static_assert(sizeof(BinaryCacheHeader) % 8 == 0);
+static constexpr char binaryCacheMagic[4] = {'E', 'S', 'P', 'B'};
+// Increment when the layout of the file changes
+static constexpr uint32_t binaryCacheVersion = 1;
+
+static bool isBinaryCacheSupported()
+{
+    static const bool isSupported = [](){
+        int formatCount{};
+        if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (formatCount == 0)
+            Logger::log << "The driver can't save program binaries, shaders are compiled on every start" << Logger::End;
+        return formatCount > 0;
+    }();
+    return isSupported;
+}
+
+// A driver update may produce different binaries, or refuse the old ones
+static uint64_t getDriverHash()
+{
+    static const uint64_t hash = [](){
+        uint64_t result = Hash::fnvOffsetBasis;
+        for (uint name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char* str = (const char*)glGetString(name);
+            result = Hash::fnv1a64(std::string_view{str ? str : ""}, result);
+            result = Hash::fnv1a64(std::string_view{"\n"}, result);
+        }
+        return result;
+    }();
+    return hash;
+}
+
+// One cache file per program, overwritten when the sources or the driver change
+static std::string getBinaryCachePath(const std::string& vertexPath, const std::string& fragmentPath)
+{
+    const std::string paths = std::filesystem::path{vertexPath}.lexically_normal().string()
+        + '\n' + std::filesystem::path{fragmentPath}.lexically_normal().string();
+    char hashStr[17]{};
+    snprintf(hashStr, sizeof(hashStr), "%016llx", (unsigned long long)Hash::fnv1a64(paths));
+    return std::string(ASSET_DIR_SHADER_CACHE)+"/"+std::filesystem::path{vertexPath}.stem().string()+"-"+hashStr+".bin";
+}
+
+/*
+ * Creates a program from the cached binary, if it matches the sources and the driver.
+ *
+ * Returns: The ID of the program, 0 if there is no usable binary
+ */
+static uint loadCachedProgram(const std::string& cachePath, uint64_t sourceHash)
 {
-    uint vertexId, fragmentId;
+    std::ifstream file{cachePath, std::ios::binary};
+    if (!file.is_open())
+        return 0;
 
-    // Vertex shader
+    BinaryCacheHeader header{};
+    file.read((char*)&header, sizeof(header));
+    if (!file.good()
+     || memcmp(header.magic, binaryCacheMagic, sizeof(binaryCacheMagic)) != 0
+     || header.version != binaryCacheVersion)
     {
-        vertexId = glCreateShader(GL_VERTEX_SHADER);
+        LOGGER_VERB << "Program binary cache has an unknown format: " << cachePath << Logger::End;
+        return 0;
+    }
+    if (header.sourceHash != sourceHash || header.driverHash != getDriverHash())
+    {
+        LOGGER_VERB << "Program binary cache is stale: " << cachePath << Logger::End;
+        return 0;
+    }
+
+    std::vector<char> binary(header.binarySize);
+    file.read(binary.data(), binary.size());
+    if (!file.good())
+    {
+        LOGGER_VERB << "Program binary cache is truncated: " << cachePath << Logger::End;
+        return 0;
+    }
+
+    const uint programId = glCreateProgram();
+    glProgramBinary(programId, header.binaryFormat, binary.data(), binary.size());
+    int linkStatus;
+    glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus)
+    {
+        LOGGER_VERB << "The driver rejected the cached program binary, compiling: " << cachePath << Logger::End;
+        glDeleteProgram(programId);
+        return 0;
+    }
 
-        std::string vertexSource;
-        if (getFileContents(vertexPath, &vertexSource))
+    LOGGER_VERB << "Loaded program binary: " << cachePath << Logger::End;
+    return programId;
+}
+
+/*
+ * Saves the binary of a linked program.
+ * Writes to a temporary file and moves it in place, so a crash never leaves a half written cache.
+ */
+static void writeCachedProgram(const std::string& cachePath, uint64_t sourceHash, uint programId)
+{
+    int binarySize{};
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0)
+        return;
+    std::vector<char> binary(binarySize);
+    uint binaryFormat{};
+    glGetProgramBinary(programId, binarySize, nullptr, &binaryFormat, binary.data());
+
+    BinaryCacheHeader header{};
+    memcpy(header.magic, binaryCacheMagic, sizeof(binaryCacheMagic));
+    header.version = binaryCacheVersion;
+    header.sourceHash = sourceHash;
+    header.driverHash = getDriverHash();
+    header.binaryFormat = binaryFormat;
+    header.binarySize = binarySize;
+
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path{cachePath}.parent_path(), ec);
+    if (ec)
+    {
+        Logger::warn << "Failed to create shader cache directory: " << ec.message() << Logger::End;
+        return;
+    }
+
+    const std::string tmpPath = cachePath+".tmp";
+    {
+        std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binary.size());
+        if (!file.good())
         {
-            m_state = State::OpenFailed;
-            return 1;
+            Logger::warn << "Failed to write program binary cache file: " << tmpPath << Logger::End;
+            file.close();
+            std::filesystem::remove(tmpPath, ec);
+            return;
         }
-        const char* vertexSourceCStr = vertexSource.c_str();
-        glShaderSource(vertexId, 1, &vertexSourceCStr, nullptr);
+    }
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        Logger::warn << "Failed to move program binary cache file in place: " << ec.message() << Logger::End;
+        std::filesystem::remove(tmpPath, ec);
+        return;
+    }
+    LOGGER_VERB << "Saved program binary (" << binarySize/1024 << " KiB): " << cachePath << Logger::End;
+}
+
+/*
+ * Creates a shader object from the source and compiles it.
+ *
+ * Returns: The ID of the shader, 0 if failed
+ */
+static uint createShader(uint type, const std::string& source)
+{
+    const uint shaderId = glCreateShader(type);
+    const char* sourceCStr = source.c_str();
+    glShaderSource(shaderId, 1, &sourceCStr, nullptr);
+    if (compileShader(shaderId))
+    {
+        glDeleteShader(shaderId);
+        return 0;
+    }
+    return shaderId;
+}
+
+/*
+ * Loads the program from the binary cache, or compiles and links the shaders and caches the result.
+ *
+ * Returns: The ID of the program, 0 if failed
+ */
+static uint buildProgram(const std::string& vertexPath, const std::string& fragmentPath,
+        ShaderProgram::State* outState, bool* outIsFromCache)
+{
+    *outIsFromCache = false;
 
-        if (compileShader(vertexId))
+    std::string vertexSource;
+    std::string fragmentSource;
+    if (getFileContents(vertexPath, &vertexSource) || getFileContents(fragmentPath, &fragmentSource))
+    {
+        *outState = ShaderProgram::State::OpenFailed;
+        return 0;
+    }
+
+    const bool useCache = isBinaryCacheSupported();
+    // GLSL sources contain no NUL characters, so the boundary is unambiguous
+    const uint64_t sourceHash = Hash::fnv1a64(fragmentSource,
+            Hash::fnv1a64(std::string_view{"", 1}, Hash::fnv1a64(vertexSource)));
+    const std::string cachePath = getBinaryCachePath(vertexPath, fragmentPath);
+    if (useCache)
+    {
+        if (const uint programId = loadCachedProgram(cachePath, sourceHash))
         {
-            m_state = State::CompileFailed;
-            return 1;
+            *outIsFromCache = true;
+            *outState = ShaderProgram::State::Ok;
+            return programId;
         }
     }
 
-    // Fragment shader
+    const uint vertexId = createShader(GL_VERTEX_SHADER, vertexSource);
+    if (!vertexId)
     {
-        fragmentId = glCreateShader(GL_FRAGMENT_SHADER);
+        *outState = ShaderProgram::State::CompileFailed;
+        return 0;
+    }
+    const uint fragmentId = createShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!fragmentId)
+    {
+        glDeleteShader(vertexId);
+        *outState = ShaderProgram::State::CompileFailed;
+        return 0;
+    }
+
+    LOGGER_VERB << "Linking shaders" << Logger::End;
 
-        std::string fragmentSource;
-        if (getFileContents(fragmentPath, &fragmentSource))
+    // Create program and link shaders
+    const uint programId = glCreateProgram();
+    glAttachShader(programId, vertexId);
+    glAttachShader(programId, fragmentId);
+    if (useCache)
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(programId);
+    // Only flagged for deletion, they are deleted with the program
+    glDeleteShader(vertexId);
+    glDeleteShader(fragmentId);
+    int linkStatus;
+    glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus)
+    {
+        char errMsg[1024]{};
+        glGetProgramInfoLog(programId, 1024, nullptr, errMsg);
+        Logger::err << "Failed to link shaders:\n" << errMsg << Logger::End;
+        glDeleteProgram(programId);
+        *outState = ShaderProgram::State::LinkFailed;
+        return 0;
+    }
+
+    if (useCache)
+        writeCachedProgram(cachePath, sourceHash, programId);
+
+    *outState = ShaderProgram::State::Ok;
+    return programId;
+}
+
+uint ShaderProgram::_buildProgramTimed(State* outState)
+{
+    const auto start = steadyClock_t::now();
+    bool isFromCache;
+    const uint programId = buildProgram(m_vertexPath, m_fragmentPath, outState, &isFromCache);
+    s_buildStats.totalMs += std::chrono::duration<double, std::milli>(steadyClock_t::now()-start).count();
+    if (isFromCache)
+        ++s_buildStats.cachedCount;
+    else if (programId)
+        ++s_buildStats.compiledCount;
+    return programId;
+}
+
+std::vector<ShaderProgram*> ShaderProgram::s_programs;
+ShaderProgram::BuildStats ShaderProgram::s_buildStats;
+
+bool ShaderProgram::open(const std::string& vertexPath, const std::string& fragmentPath)
+{
+    m_vertexPath = vertexPath;
+    m_fragmentPath = fragmentPath;
+    if (std::find(s_programs.begin(), s_programs.end(), this) == s_programs.end())
+        s_programs.push_back(this);
+
+    const uint programId = _buildProgramTimed(&m_state);
+    if (!programId)
+        return 1;
+    glDeleteProgram(m_shaderProgramId);
+    m_shaderProgramId = programId;
+
+    _introspectUniforms();
+    _bindUniformBlocks();
+    // Opened again, the shadow values must match the new program
+    _reuploadUniforms();
+    return 0;
+}
+
+bool ShaderProgram::reload()
+{
+    State state;
+    const uint programId = _buildProgramTimed(&state);
+    if (!programId)
+    {
+        if (m_state == State::Ok)
+            Logger::warn << "Keeping the previous version of the shader program" << Logger::End;
+        else
+            m_state = state;
+        return 1;
+    }
+
+    glDeleteProgram(m_shaderProgramId);
+    m_shaderProgramId = programId;
+    m_state = State::Ok;
+    _introspectUniforms();
+    _bindUniformBlocks();
+    // The values set once, e.g. projection matrices, would be lost otherwise
+    _reuploadUniforms();
+    return 0;
+}
+
+size_t ShaderProgram::reloadFile(const std::string& path)
+{
+    size_t reloaded{};
+    for (ShaderProgram* program : s_programs)
+    {
+        std::error_code ec;
+        if (!std::filesystem::equivalent(path, program->m_vertexPath, ec)
+         && !std::filesystem::equivalent(path, program->m_fragmentPath, ec))
+            continue;
+
+        Logger::log << "Reloading shader program (" << program->m_vertexPath
+            << ", " << program->m_fragmentPath << ')' << Logger::End;
+        if (program->reload() == 0)
+            ++reloaded;
+    }
+    return reloaded;
+}
+
+// Returns the size of a uniform value of the GL type, 0 if the type is not supported by `setUniform()`
+static size_t getUniformTypeSize(uint type)
+{
+    switch (type)
+    {
+    case GL_FLOAT:
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+        return 4;
+    case GL_FLOAT_VEC2: return 2*sizeof(float);
+    case GL_FLOAT_VEC3: return 3*sizeof(float);
+    case GL_FLOAT_VEC4: return 4*sizeof(float);
+    case GL_FLOAT_MAT4: return 16*sizeof(float);
+    default:            return 0;
+    }
+}
+
+void ShaderProgram::_introspectUniforms()
+{
+    // The uniforms of the previous version keep their index and their shadow value, the handles refer to it.
+    // Those that are not in the new version are set at location -1, which GL ignores.
+    for (UniformInfo& uniform : m_uniforms)
+        uniform.location = -1;
+
+    int uniformCount{};
+    glGetProgramiv(m_shaderProgramId, GL_ACTIVE_UNIFORMS, &uniformCount);
+    for (int i{}; i < uniformCount; ++i)
+    {
+        char name[256]{};
+        int nameLen{};
+        int arraySize{};
+        uint type{};
+        glGetActiveUniform(m_shaderProgramId, i, sizeof(name), &nameLen, &arraySize, &type, name);
+
+        const int location = glGetUniformLocation(m_shaderProgramId, name);
+        if (location < 0) // Part of a uniform block
+            continue;
+
+        // Arrays are reported as "name[0]", only their first element can be set
+        std::string nameStr{name, (size_t)nameLen};
+        if (nameStr.ends_with("[0]"))
+            nameStr.resize(nameStr.size()-3);
+
+        auto existing = std::find_if(m_uniforms.begin(), m_uniforms.end(),
+                [&](const UniformInfo& uniform){ return uniform.name == nameStr; });
+        if (existing != m_uniforms.end())
         {
-            m_state = State::OpenFailed;
-            return 1;
+            if (existing->type == type)
+                existing->location = location;
+            else
+                Logger::warn << "Uniform \"" << nameStr << "\" changed its type, it is not set until restart" << Logger::End;
+            continue;
         }
-        const char* fragmentSourceCStr = fragmentSource.c_str();
-        glShaderSource(fragmentId, 1, &fragmentSourceCStr, nullptr);
 
-        if (compileShader(fragmentId))
+        m_uniforms.push_back({std::move(nameStr), location, type, m_shadowValues.size(), false});
+        m_shadowValues.resize(m_shadowValues.size()+getUniformTypeSize(type));
+    }
+
+    LOGGER_VERB << "Shader program has " << m_uniforms.size() << " uniforms" << Logger::End;
+}
+
+void ShaderProgram::_reuploadUniforms()
+{
+    if (std::none_of(m_uniforms.begin(), m_uniforms.end(), [](const UniformInfo& uniform){ return uniform.hasValue; }))
+        return;
+
+    int prevProgramId{};
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prevProgramId);
+    glUseProgram(m_shaderProgramId);
+
+    size_t reuploaded{};
+    for (const UniformInfo& uniform : m_uniforms)
+    {
+        if (!uniform.hasValue || uniform.location < 0)
+            continue;
+
+        const void* shadow = m_shadowValues.data()+uniform.shadowOffset;
+        switch (uniform.type)
         {
-            m_state = State::CompileFailed;
-            return 1;
+        case GL_FLOAT:      glUniform1fv(uniform.location, 1, (const float*)shadow); break;
+        case GL_FLOAT_VEC2: glUniform2fv(uniform.location, 1, (const float*)shadow); break;
+        case GL_FLOAT_VEC3: glUniform3fv(uniform.location, 1, (const float*)shadow); break;
+        case GL_FLOAT_VEC4: glUniform4fv(uniform.location, 1, (const float*)shadow); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(uniform.location, 1, GL_FALSE, (const float*)shadow); break;
+        default:            glUniform1iv(uniform.location, 1, (const int*)shadow); break;
         }
+        ++reuploaded;
     }
 
-    Logger::verb << "Linking shaders" << Logger::End;
+    glUseProgram(prevProgramId);
+    LOGGER_VERB << "Uploaded " << reuploaded << " uniform values to the new program" << Logger::End;
+}
 
-    // Create program and link shaders
+void ShaderProgram::_bindUniformBlocks()
+{
+    static constexpr struct { const char* name; uint binding; } sharedBlocks[] = {
+        {"Camera", UNIFORM_BLOCK_BINDING_CAMERA},
+    };
+
+    for (const auto& block : sharedBlocks)
     {
-        m_shaderProgramId = glCreateProgram();
-        glAttachShader(m_shaderProgramId, vertexId);
-        glAttachShader(m_shaderProgramId, fragmentId);
-        glLinkProgram(m_shaderProgramId);
-        int linkStatus;
-        glGetProgramiv(m_shaderProgramId, GL_LINK_STATUS, &linkStatus);
-        if (!linkStatus)
+        const uint blockIndex = glGetUniformBlockIndex(m_shaderProgramId, block.name);
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(m_shaderProgramId, blockIndex, block.binding);
+    }
+}
+
+int ShaderProgram::_findUniform(std::string_view name, uint type) const
+{
+    for (size_t i{}; i < m_uniforms.size(); ++i)
+    {
+        if (m_uniforms[i].name != name)
+            continue;
+
+        const uint actualType = m_uniforms[i].type;
+        const bool isSampler = (actualType == GL_SAMPLER_2D || actualType == GL_SAMPLER_3D || actualType == GL_SAMPLER_CUBE);
+        if (actualType != type && !(type == GL_INT && (isSampler || actualType == GL_BOOL)))
         {
-            char errMsg[1024]{};
-            glGetProgramInfoLog(m_shaderProgramId, 1024, nullptr, errMsg);
-            Logger::err << "Failed to link shaders:\n" << errMsg << Logger::End;
-            m_state = State::LinkFailed;
-            return 1;
+            Logger::err << "Uniform \"" << name << "\" has a different type" << Logger::End;
+            return -1;
         }
+        return i;
     }
 
-    m_state = State::Ok;
-    return 0;
+    Logger::warn << "Uniform \"" << name << "\" is not active in the shader program" << Logger::End;
+    return -1;
 }
 
 ShaderProgram::~ShaderProgram()
 {
+    std::erase(s_programs, this);
     glDeleteProgram(m_shaderProgramId);
-    Logger::verb << "Deleted a shader program (" << this << ')' << Logger::End;
+    LOGGER_VERB << "Deleted a shader program (" << this << ')' << Logger::End;
 }
 
@@ -2,10 +2,18 @@
 
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
 #include <cassert>
 #include "types.h"
 
+// Binding points of the uniform blocks shared by the programs, assigned after linking
+#define UNIFORM_BLOCK_BINDING_CAMERA 0
+
 class ShaderProgram final
 {
 public:
@@ -18,9 +26,72 @@ public:
         LinkFailed,
     };
 
+    // Time spent on building programs, see `getBuildStats()`
+    struct BuildStats
+    {
+        size_t cachedCount{};   // Loaded from the program binary cache
+        size_t compiledCount{}; // Compiled from the sources
+        double totalMs{};       // Including the failed builds
+    };
+
+    /*
+     * Identifies a uniform of a program, returned by `getUniform()`.
+     * Setting an invalid handle (a uniform that doesn't exist) does nothing.
+     */
+    template <typename T>
+    struct UniformHandle
+    {
+        int index{-1};
+
+        inline bool isValid() const { return index >= 0; }
+    };
+
 private:
+    struct UniformInfo
+    {
+        std::string name;
+        int location{};
+        uint type{};
+        // Offset of the last uploaded value in `m_shadowValues`
+        size_t shadowOffset{};
+        bool hasValue{};
+    };
+
     uint m_shaderProgramId{};
     State m_state{State::Uninitialized};
+    std::string m_vertexPath;
+    std::string m_fragmentPath;
+
+    // The active uniforms outside uniform blocks
+    std::vector<UniformInfo> m_uniforms;
+    std::vector<unsigned char> m_shadowValues;
+    size_t m_uploadCount{};
+    size_t m_skippedUploadCount{};
+
+    // Every opened program, for `reloadFile()`
+    static std::vector<ShaderProgram*> s_programs;
+    static BuildStats s_buildStats;
+
+    // Builds the program from `m_vertexPath` and `m_fragmentPath`, updates `s_buildStats`
+    uint _buildProgramTimed(State* outState);
+
+    // Looks up the uniforms, keeping the index and the value of those already known
+    void _introspectUniforms();
+    // Uploads the values set before to the current program, after it was rebuilt
+    void _reuploadUniforms();
+    void _bindUniformBlocks();
+
+    // Returns the index of the uniform in `m_uniforms` if it exists and has the given type, -1 otherwise
+    int _findUniform(std::string_view name, uint type) const;
+
+    template <typename T> static constexpr uint glTypeOf();
+
+    static inline void uploadValue(int location, float value) { glUniform1f(location, value); }
+    static inline void uploadValue(int location, int value) { glUniform1i(location, value); }
+    static inline void uploadValue(int location, const glm::vec2& value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+    static inline void uploadValue(int location, const glm::vec3& value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+    static inline void uploadValue(int location, const glm::vec4& value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+    static inline void uploadValue(int location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
 
 public:
     ShaderProgram(){}
@@ -34,6 +105,8 @@ public:
 
     /*
      * Opens a vertex and a fragment shader, compiles and links them.
+     * The linked program is saved to `ASSET_DIR_SHADER_CACHE` if the driver supports it,
+     * and later loaded from there while the sources and the driver are the same.
      *
      * Returns:
      *      true if failed,
@@ -41,11 +114,77 @@ public:
      */
     bool open(const std::string& vertexPath, const std::string& fragmentPath);
 
+    /*
+     * Compiles and links the shader files again. If it fails, the previous
+     * version is kept. The uniform handles stay valid, and the values set before
+     * are uploaded to the new version if the uniform still exists with the same type.
+     *
+     * Returns:
+     *      true if failed,
+     *      false otherwise
+     */
+    bool reload();
+
+    /*
+     * Reloads the programs that use the shader file at `path`. Render thread only.
+     *
+     * Returns: The number of reloaded programs
+     */
+    static size_t reloadFile(const std::string& path);
+
+    // The time spent on building the programs since start
+    static inline const BuildStats& getBuildStats() { return s_buildStats; }
+
     inline uint getId() const { return m_shaderProgramId; }
     inline State getState() const { return m_state; }
 
     inline void use() { assert(m_state == State::Ok); glUseProgram(m_shaderProgramId); }
 
+    /*
+     * Looks up a uniform. Call it once and keep the handle, not on every draw.
+     * Supported types: `float`, `int` (also for samplers), `glm::vec2`, `glm::vec3`, `glm::vec4`, `glm::mat4`.
+     *
+     * Returns: The handle, invalid if the uniform is not active or has a different type
+     */
+    template <typename T>
+    UniformHandle<T> getUniform(std::string_view name) const
+    {
+        return {_findUniform(name, glTypeOf<T>())};
+    }
+
+    /*
+     * Sets a uniform. The upload is skipped if the uniform already has this value.
+     * The program must be in use.
+     */
+    template <typename T>
+    void setUniform(UniformHandle<T> handle, const T& value)
+    {
+        if (!handle.isValid())
+            return;
+
+        UniformInfo& uniform = m_uniforms[handle.index];
+        unsigned char* shadow = m_shadowValues.data()+uniform.shadowOffset;
+        if (uniform.hasValue && memcmp(shadow, &value, sizeof(T)) == 0)
+        {
+            ++m_skippedUploadCount;
+            return;
+        }
+        memcpy(shadow, &value, sizeof(T));
+        uniform.hasValue = true;
+        uploadValue(uniform.location, value);
+        ++m_uploadCount;
+    }
+
+    inline size_t getUniformUploadCount() const { return m_uploadCount; }
+    inline size_t getSkippedUniformUploadCount() const { return m_skippedUploadCount; }
+
     ~ShaderProgram();
 };
 
+template <> constexpr uint ShaderProgram::glTypeOf<float>() { return GL_FLOAT; }
+template <> constexpr uint ShaderProgram::glTypeOf<int>() { return GL_INT; }
+template <> constexpr uint ShaderProgram::glTypeOf<glm::vec2>() { return GL_FLOAT_VEC2; }
+template <> constexpr uint ShaderProgram::glTypeOf<glm::vec3>() { return GL_FLOAT_VEC3; }
+template <> constexpr uint ShaderProgram::glTypeOf<glm::vec4>() { return GL_FLOAT_VEC4; }
+template <> constexpr uint ShaderProgram::glTypeOf<glm::mat4>() { return GL_FLOAT_MAT4; }
+
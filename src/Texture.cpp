@@ -10,26 +10,49 @@
 
 #include "memory.h"
 #include "Logger.h"
+#include "MappedFile.h"
+#include "dds.h"
+#include "mipmap.h"
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
 
 Texture::Texture(const std::string& filePath, int horizontalWrapMode/*=GL_REPEAT*/, int verticalWrapMode/*=GL_REPEAT*/)
 {
     open(filePath, horizontalWrapMode, verticalWrapMode);
 }
 
-int Texture::open(const std::string& filePath, int horizontalWrapMode/*=GL_REPEAT*/, int verticalWrapMode/*=GL_REPEAT*/)
+int Texture::load(const std::string& filePath, int horizontalWrapMode/*=GL_REPEAT*/, int verticalWrapMode/*=GL_REPEAT*/)
 {
     assert(!filePath.empty());
-    unsigned char* textureData;
     int channelCount;
-    Logger::verb << "Reading image: " << filePath << Logger::End;
 
-    stbi_set_flip_vertically_on_load(1);
-    textureData = stbi_load(filePath.c_str(), &m_widthPx, &m_heightPx, &channelCount, 4);
-    if (textureData)
+    m_horizontalWrapMode = horizontalWrapMode;
+    m_verticalWrapMode = verticalWrapMode;
+
+    if (std::filesystem::path{filePath}.extension() == ".dds")
+        return _loadDds(filePath);
+
+    // Prefer the version compressed by `texbake`
+    const std::string bakedPath = DDS::getBakedPath(filePath);
+    std::error_code ec;
+    if (std::filesystem::exists(bakedPath, ec)
+     && std::filesystem::last_write_time(bakedPath, ec) >= std::filesystem::last_write_time(filePath, ec)
+     && !ec)
+    {
+        if (_loadDds(bakedPath) == 0)
+            return 0;
+        Logger::warn << "Falling back to the source image" << Logger::End;
+    }
+
+    LOGGER_VERB << "Reading image: " << filePath << Logger::End;
+    // Only affects the calling thread, the decoders may run in parallel
+    stbi_set_flip_vertically_on_load_thread(1);
+    unsigned char* pixels = stbi_load(filePath.c_str(), &m_widthPx, &m_heightPx, &channelCount, 4);
+    if (pixels)
     {
-        Logger::verb << "Opened image (size: " << m_widthPx << 'x' << m_heightPx
+        LOGGER_VERB << "Opened image (size: " << m_widthPx << 'x' << m_heightPx
             << ", channels: " << channelCount << ')' << Logger::End;
-        m_state = State::Ok;
     }
     else
     {
@@ -38,23 +61,227 @@ int Texture::open(const std::string& filePath, int horizontalWrapMode/*=GL_REPEA
         return 1;
     }
 
+    m_compressedFormat = 0;
+    m_isUpsideDown = false;
+    _buildMipChain(pixels);
+    stbi_image_free(pixels);
+
+    m_state = State::Loading;
+    return 0;
+}
+
+int Texture::_loadDds(const std::string& filePath)
+{
+    LOGGER_VERB << "Reading compressed image: " << filePath << Logger::End;
+
+    MappedFile file;
+    DDS::Image image;
+    if (file.open(filePath) || DDS::parse(file.view(), &image))
+    {
+        Logger::err << "Failed to open compressed image: " << filePath << Logger::End;
+        m_state = State::OpenFailed;
+        return 1;
+    }
+
+    switch (image.format)
+    {
+    case DDS::Format::BC1: m_compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+    case DDS::Format::BC3: m_compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+    case DDS::Format::BC7: m_compressedFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+    }
+    m_widthPx = image.widthPx;
+    m_heightPx = image.heightPx;
+
+    const size_t blockSize = DDS::getBlockSize(image.format);
+    m_mipLevels.clear();
+    for (const DDS::Level& level : image.levels)
+    {
+        const int blocksX = (level.widthPx+DDS::blockDimPx-1)/DDS::blockDimPx;
+        const int blocksY = (level.heightPx+DDS::blockDimPx-1)/DDS::blockDimPx;
+        m_mipLevels.push_back({level.widthPx, level.heightPx, level.offset, level.size, blocksY, blocksX*blockSize});
+    }
+    m_baseLevel = m_mipLevels.size();
+
+    const size_t totalSize = m_mipLevels.back().offset+m_mipLevels.back().size;
+    m_mipData.assign(image.data, image.data+totalSize);
+
+    // The files of other tools are top-down, unlike the ones of `texbake`
+    m_isUpsideDown = false;
+    if (!image.isBottomUp)
+    {
+        if (std::all_of(m_mipLevels.begin(), m_mipLevels.end(), [&](const MipLevel& level){
+                    return DDS::canFlipLevel(image.format, level.heightPx); }))
+        {
+            for (const MipLevel& level : m_mipLevels)
+                DDS::flipLevel(image.format, level.widthPx, level.heightPx, m_mipData.data()+level.offset);
+        }
+        else
+        {
+            LOGGER_VERB << "The blocks can't be flipped, the texture coordinates are flipped instead" << Logger::End;
+            m_isUpsideDown = true;
+        }
+    }
+
+    LOGGER_VERB << "Opened compressed image (size: " << m_widthPx << 'x' << m_heightPx
+        << ", format: " << DDS::formatToStr(image.format) << ", levels: " << m_mipLevels.size()
+        << ", " << totalSize/1024 << " KiB instead of " << (size_t)m_widthPx*m_heightPx*4*4/3/1024
+        << " KiB as RGBA8)" << Logger::End;
+
+    m_state = State::Loading;
+    return 0;
+}
+
+void Texture::_buildMipChain(const unsigned char* pixels)
+{
+    m_mipLevels.clear();
+    size_t totalSize{};
+    for (int w = m_widthPx, h = m_heightPx;; w = std::max(1, w/2), h = std::max(1, h/2))
+    {
+        const size_t size = (size_t)w*h*4;
+        m_mipLevels.push_back({w, h, totalSize, size, h, (size_t)w*4});
+        totalSize += size;
+        if (w == 1 && h == 1)
+            break;
+    }
+    m_baseLevel = m_mipLevels.size();
+
+    m_mipData.resize(totalSize);
+    memcpy(m_mipData.data(), pixels, m_mipLevels[0].size);
+
+    for (size_t level{1}; level < m_mipLevels.size(); ++level)
+    {
+        const MipLevel& srcLevel = m_mipLevels[level-1];
+        Mipmap::downsampleRgba8(m_mipData.data()+srcLevel.offset, srcLevel.widthPx, srcLevel.heightPx,
+                m_mipData.data()+m_mipLevels[level].offset);
+    }
+}
+
+bool Texture::_isFormatSupported() const
+{
+    switch (m_compressedFormat)
+    {
+    case 0:
+        return true;
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return GLEW_EXT_texture_compression_s3tc;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+    }
+    return false;
+}
+
+void Texture::_createGlTexture()
+{
+    assert(!m_mipLevels.empty());
+
     glGenTextures(1, &m_textureIndex);
     glBindTexture(GL_TEXTURE_2D, m_textureIndex);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, horizontalWrapMode);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, verticalWrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_horizontalWrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_verticalWrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_mipLevels.size()-1);
+
+    // Allocate every level, so any range of them can be sampled while the others are uploaded
+    for (size_t level{}; level < m_mipLevels.size(); ++level)
+    {
+        const MipLevel& mip = m_mipLevels[level];
+        if (m_compressedFormat)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, m_compressedFormat, mip.widthPx, mip.heightPx, 0, mip.size, nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.widthPx, mip.heightPx, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    _setBaseLevel(m_mipLevels.size());
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_widthPx, m_heightPx, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureData);
+void Texture::_uploadRows(size_t level, int firstRow, int rowCount, const void* data)
+{
+    const MipLevel& mip = m_mipLevels[level];
+    assert(firstRow+rowCount <= mip.rowCount);
+
+    glBindTexture(GL_TEXTURE_2D, m_textureIndex);
+    if (m_compressedFormat)
+    {
+        // Partial blocks are only allowed at the edge of the level
+        const int yPx = firstRow*DDS::blockDimPx;
+        const int heightPx = std::min(rowCount*DDS::blockDimPx, mip.heightPx-yPx);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, yPx, mip.widthPx, heightPx,
+                m_compressedFormat, rowCount*mip.rowPitch, data);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, mip.widthPx, rowCount,
+                GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+}
+
+void Texture::_setBaseLevel(size_t level)
+{
+    m_baseLevel = level;
+    if (m_baseLevel < m_mipLevels.size())
+    {
+        glBindTexture(GL_TEXTURE_2D, m_textureIndex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
+        m_state = State::Ok;
+    }
+
+    if (m_baseLevel == 0) // Everything is on the GPU
+    {
+        m_mipData.clear();
+        m_mipData.shrink_to_fit();
+    }
+}
+
+int Texture::upload()
+{
+    assert(m_state == State::Loading);
+    assert(!m_mipData.empty());
+
+    if (!_isFormatSupported())
+    {
+        Logger::err << "Texture compression format is not supported by the GPU" << Logger::End;
+        m_state = State::OpenFailed;
+        return 1;
+    }
+
+    _createGlTexture();
+    for (size_t level{}; level < m_mipLevels.size(); ++level)
+        _uploadRows(level, 0, m_mipLevels[level].rowCount, m_mipData.data()+m_mipLevels[level].offset);
+    _setBaseLevel(0);
 
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    free(textureData);
     return 0;
 }
 
+size_t Texture::getGpuMemSize() const
+{
+    size_t size{};
+    for (const MipLevel& level : m_mipLevels)
+        size += level.size;
+    return size;
+}
+
+size_t Texture::getMemSize() const
+{
+    return sizeof(Texture)+getGpuMemSize()+m_mipData.capacity();
+}
+
+int Texture::open(const std::string& filePath, int horizontalWrapMode/*=GL_REPEAT*/, int verticalWrapMode/*=GL_REPEAT*/)
+{
+    if (load(filePath, horizontalWrapMode, verticalWrapMode))
+        return 1;
+    return upload();
+}
+
 Texture::Texture(Texture&& another)
 {
-    m_state = another.m_state;
+    m_state = another.m_state.load();
+    m_mipData = std::move(another.m_mipData);
+    m_mipLevels = std::move(another.m_mipLevels);
+    m_baseLevel = another.m_baseLevel;
+    m_horizontalWrapMode = another.m_horizontalWrapMode;
+    m_verticalWrapMode = another.m_verticalWrapMode;
+    m_compressedFormat = another.m_compressedFormat;
+    m_isUpsideDown = another.m_isUpsideDown;
     m_textureIndex = another.m_textureIndex;
     another.m_textureIndex = 0;
     m_widthPx = another.m_widthPx;
@@ -68,7 +295,15 @@ Texture& Texture::operator=(Texture&& another)
     if (this == &another)
         return *this;
 
-    m_state = another.m_state;
+    m_state = another.m_state.load();
+    m_mipData = std::move(another.m_mipData);
+    m_mipLevels = std::move(another.m_mipLevels);
+    m_baseLevel = another.m_baseLevel;
+    m_horizontalWrapMode = another.m_horizontalWrapMode;
+    m_verticalWrapMode = another.m_verticalWrapMode;
+    m_compressedFormat = another.m_compressedFormat;
+    m_isUpsideDown = another.m_isUpsideDown;
+    glDeleteTextures(1, &m_textureIndex);
     m_textureIndex = another.m_textureIndex;
     another.m_textureIndex = 0;
     m_widthPx = another.m_widthPx;
@@ -82,6 +317,5 @@ Texture& Texture::operator=(Texture&& another)
 Texture::~Texture()
 {
     glDeleteTextures(1, &m_textureIndex);
-    Logger::verb << "Deleted a texture (" << this << ')' << Logger::End;
+    LOGGER_VERB << "Deleted a texture (" << this << ')' << Logger::End;
 }
-
@@ -5,6 +5,10 @@
 #include <GL/gl.h>
 #include <cassert>
 #include <string>
+#include <vector>
+#include <atomic>
+
+class TextureStreamer;
 
 class Texture final
 {
@@ -12,15 +16,49 @@ public:
     enum class State
     {
         Uninitialized,
-        Ok,
+        Loading, // Decoded by `load()`, waiting for `upload()` or for the streamer
+        Ok, // Usable, but the streamer may still be uploading the higher resolution mip levels
         OpenFailed,
     };
 
+    struct MipLevel
+    {
+        int widthPx;
+        int heightPx;
+        size_t offset; // Offset of the pixels in `m_mipData`
+        size_t size;
+        int rowCount; // Rows of pixels, or rows of 4x4 blocks if compressed
+        size_t rowPitch;
+    };
+
 private:
-    State m_state{State::Uninitialized};
+    // Atomic, so the render thread can poll it while a worker thread decodes the image
+    std::atomic<State> m_state{State::Uninitialized};
     uint m_textureIndex{};
     int m_widthPx{};
     int m_heightPx{};
+    int m_horizontalWrapMode{GL_REPEAT};
+    int m_verticalWrapMode{GL_REPEAT};
+    // The GL format of the blocks, 0 if the texture is uncompressed RGBA8
+    uint m_compressedFormat{};
+    // The rows are stored top-down, so the texture has to be sampled with a flipped V coordinate
+    bool m_isUpsideDown{};
+
+    // Pixels or blocks of every mip level, read by `load()`, freed after the upload
+    std::vector<unsigned char> m_mipData;
+    std::vector<MipLevel> m_mipLevels;
+    // The highest resolution level that is on the GPU, `m_mipLevels.size()` if none
+    size_t m_baseLevel{};
+
+    void _buildMipChain(const unsigned char* pixels);
+    int _loadDds(const std::string& filePath);
+    bool _isFormatSupported() const;
+    void _createGlTexture();
+    // Uploads `rowCount` rows of a level. `data` is an offset if a pixel unpack buffer is bound.
+    void _uploadRows(size_t level, int firstRow, int rowCount, const void* data);
+    void _setBaseLevel(size_t level);
+
+    friend class TextureStreamer;
 
 public:
     Texture() {}
@@ -34,15 +72,48 @@ public:
     Texture(Texture&& another);
     Texture& operator=(Texture&& another);
 
+    /*
+     * Decodes the image file and builds its mip chain.
+     * DDS files (BC1, BC3, BC7) are used as they are, with their own mip chain,
+     * top-down BC1 and BC3 files are flipped.
+     * For other images, the compressed version made by `texbake` is loaded
+     * instead if it exists and is up to date.
+     * Does not use OpenGL, so it can be called from any thread.
+     * The texture becomes usable after `upload()` or when the streamer uploaded a level.
+     */
+    int load(const std::string& filePath,
+            int horizontalWrapMode=GL_REPEAT, int verticalWrapMode=GL_REPEAT);
+    // Uploads every mip level decoded by `load()` at once. Render thread only.
+    int upload();
+    // `load()` and `upload()` in one step
     int open(const std::string& filePath,
             int horizontalWrapMode=GL_REPEAT, int verticalWrapMode=GL_REPEAT);
 
     inline State getState() const { return m_state; }
     inline int getWidth() const { return m_widthPx; }
     inline int getHeight() const { return m_heightPx; }
+    inline bool isCompressed() const { return m_compressedFormat != 0; }
+    /*
+     * Whether the V texture coordinate has to be flipped. Only for DDS files of other tools
+     * that can't be flipped at load time, e.g. BC7 ones.
+     */
+    inline bool isUpsideDown() const { return m_isUpsideDown; }
+    inline bool isFullyResident() const { return m_state == State::Ok && m_baseLevel == 0; }
+    // Whether it is still being loaded or streamed, so it must not be replaced
+    inline bool isBusy() const { return m_state == State::Loading || (m_state == State::Ok && m_baseLevel != 0); }
+    // The size of every mip level in bytes, as stored on the GPU when fully resident
+    size_t getGpuMemSize() const;
+    // The GPU size plus the decoded levels not freed yet, in bytes. Not while `load()` runs.
+    size_t getMemSize() const;
 
     inline void setWrapMode(int horizontalWrapMode, int verticalWrapMode)
     {
+        m_horizontalWrapMode = horizontalWrapMode;
+        m_verticalWrapMode = verticalWrapMode;
+        // If the GL texture does not exist yet, it is applied when it is created
+        if (!m_textureIndex)
+            return;
+
         glBindTexture(GL_TEXTURE_2D, m_textureIndex);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, horizontalWrapMode);
@@ -57,4 +128,3 @@ public:
 
     ~Texture();
 };
-
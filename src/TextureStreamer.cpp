@@ -0,0 +1,163 @@
+#include "TextureStreamer.h"
+#include "Logger.h"
+#include <cstring>
+#include <algorithm>
+
+TextureStreamer::TextureStreamer(
+        size_t slotSize/*=TEXTURE_STREAMER_DEF_SLOT_SIZE*/,
+        size_t slotCount/*=TEXTURE_STREAMER_DEF_SLOT_COUNT*/,
+        size_t frameBudget/*=TEXTURE_STREAMER_DEF_FRAME_BUDGET*/)
+    : m_slots(slotCount)
+    , m_slotSize{slotSize}
+    , m_isPersistent{GLEW_ARB_buffer_storage != 0}
+    , m_frameBudget{frameBudget}
+{
+    assert(slotCount > 0);
+    assert(slotSize > 0);
+
+    for (Slot& slot : m_slots)
+    {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if (m_isPersistent)
+        {
+            static constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_slotSize, nullptr, flags);
+            slot.mappedPtr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_slotSize, flags);
+            assert(slot.mappedPtr);
+        }
+        else
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_slotSize, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    LOGGER_VERB << "Created texture streamer (" << slotCount << " x " << slotSize/1024 << " KiB "
+        << (m_isPersistent ? "persistently mapped" : "mapped on demand") << " buffers, budget: "
+        << frameBudget/1024 << " KiB/frame)" << Logger::End;
+}
+
+int TextureStreamer::enqueue(std::shared_ptr<Texture> texture)
+{
+    assert(texture);
+    if (texture->getState() != Texture::State::Loading || texture->m_mipLevels.empty())
+    {
+        Logger::err << "Tried to stream a texture that is not loaded" << Logger::End;
+        return 1;
+    }
+    if (!texture->_isFormatSupported())
+    {
+        Logger::err << "Texture compression format is not supported by the GPU" << Logger::End;
+        texture->m_state = Texture::State::OpenFailed;
+        return 1;
+    }
+
+    texture->_createGlTexture();
+    const size_t lowestResLevel = texture->m_mipLevels.size()-1;
+    m_jobs.push_back({std::move(texture), lowestResLevel, 0});
+    return 0;
+}
+
+TextureStreamer::Slot* TextureStreamer::acquireSlot()
+{
+    Slot& slot = m_slots[m_nextSlot];
+    if (slot.fence)
+    {
+        const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+            return nullptr; // The GPU is still reading it, try again next frame
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+    m_nextSlot = (m_nextSlot+1) % m_slots.size();
+    return &slot;
+}
+
+size_t TextureStreamer::uploadBand(Job* job)
+{
+    Texture* texture = job->texture.get();
+    const Texture::MipLevel& mip = texture->m_mipLevels[job->level];
+
+    // Rows are pixel rows or rows of compressed blocks
+    assert(mip.rowPitch <= m_slotSize);
+    const int rowsPerSlot = m_slotSize/mip.rowPitch;
+    const int rowCount = std::min(rowsPerSlot, mip.rowCount-job->nextRow);
+    const size_t byteCount = rowCount*mip.rowPitch;
+
+    Slot* slot = acquireSlot();
+    if (!slot)
+        return 0;
+
+    const unsigned char* src = texture->m_mipData.data()+mip.offset+job->nextRow*mip.rowPitch;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+    if (m_isPersistent)
+    {
+        memcpy(slot->mappedPtr, src, byteCount);
+    }
+    else
+    {
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_slotSize,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        assert(dst);
+        memcpy(dst, src, byteCount);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    // The data pointer is an offset into the bound pixel buffer
+    texture->_uploadRows(job->level, job->nextRow, rowCount, (void*)0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    job->nextRow += rowCount;
+    if (job->nextRow == mip.rowCount) // Finished the level
+    {
+        texture->_setBaseLevel(job->level);
+        if (job->level > 0)
+        {
+            --job->level;
+            job->nextRow = 0;
+        }
+    }
+
+    return byteCount;
+}
+
+void TextureStreamer::update()
+{
+    m_bytesLastFrame = 0;
+
+    while (!m_jobs.empty() && m_bytesLastFrame < m_frameBudget)
+    {
+        // Always continue with the smallest pending level, so every queued
+        // texture gets a low resolution version before any gets a high one
+        auto job = std::min_element(m_jobs.begin(), m_jobs.end(), [](const Job& a, const Job& b){
+            return a.texture->m_mipLevels[a.level].size < b.texture->m_mipLevels[b.level].size;
+        });
+
+        const size_t uploaded = uploadBand(&*job);
+        if (uploaded == 0) // Ran out of free buffers
+            break;
+        m_bytesLastFrame += uploaded;
+        m_totalBytes += uploaded;
+
+        if (job->texture->isFullyResident())
+            m_jobs.erase(job);
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (Slot& slot : m_slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.mappedPtr)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
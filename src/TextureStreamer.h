@@ -0,0 +1,95 @@
+#pragma once
+
+#include "types.h"
+#include "Texture.h"
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <deque>
+#include <vector>
+#include <memory>
+
+// Size of one pixel buffer in the upload ring
+#define TEXTURE_STREAMER_DEF_SLOT_SIZE (4*1024*1024)
+#define TEXTURE_STREAMER_DEF_SLOT_COUNT 4
+// Maximum number of bytes uploaded in a frame
+#define TEXTURE_STREAMER_DEF_FRAME_BUDGET (8*1024*1024)
+
+/*
+ * Uploads textures to the GPU over several frames.
+ *
+ * The pixels are copied into a ring of pixel buffer objects and transferred
+ * from there with `glTexSubImage2D()`, so the driver can do the copy
+ * asynchronously. The buffers are persistently mapped if `ARB_buffer_storage`
+ * is supported, otherwise they are mapped for each copy. Every frame at most
+ * the budget is uploaded. The mip levels of a texture are uploaded from the
+ * lowest resolution, so the texture becomes usable quickly and gets sharper
+ * as the rest arrives. Levels bigger than a buffer are uploaded in row bands.
+ */
+class TextureStreamer final
+{
+private:
+    struct Slot
+    {
+        uint buffer{};
+        void* mappedPtr{}; // Only if persistently mapped
+        GLsync fence{}; // Signaled when the GPU finished reading the buffer
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Texture> texture;
+        // The level being uploaded, counts down to 0
+        size_t level{};
+        // The first row of the level not uploaded yet
+        int nextRow{};
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_nextSlot{};
+    size_t m_slotSize{};
+    bool m_isPersistent{};
+    size_t m_frameBudget{};
+
+    std::deque<Job> m_jobs;
+
+    size_t m_bytesLastFrame{};
+    size_t m_totalBytes{};
+
+    // Returns a slot the GPU is done with, or null if all of them are in use
+    Slot* acquireSlot();
+    // Uploads the next band of the job. Returns the number of bytes uploaded, 0 if no slot was free.
+    size_t uploadBand(Job* job);
+
+public:
+    TextureStreamer(
+            size_t slotSize=TEXTURE_STREAMER_DEF_SLOT_SIZE,
+            size_t slotCount=TEXTURE_STREAMER_DEF_SLOT_COUNT,
+            size_t frameBudget=TEXTURE_STREAMER_DEF_FRAME_BUDGET);
+
+    // Copy ctor, copy assignment op
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    // Move ctor, move assignment op
+    TextureStreamer(TextureStreamer&&) = delete;
+    TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+    /*
+     * Queues a texture decoded by `Texture::load()` for uploading.
+     *
+     * Returns:
+     *      1 if failed,
+     *      0 otherwise
+     */
+    int enqueue(std::shared_ptr<Texture> texture);
+
+    // Uploads the next part of the queue. Call once per frame on the render thread.
+    void update();
+
+    inline size_t getQueueDepth() const { return m_jobs.size(); }
+    inline size_t getBytesLastFrame() const { return m_bytesLastFrame; }
+    inline size_t getTotalBytes() const { return m_totalBytes; }
+    inline size_t getFrameBudget() const { return m_frameBudget; }
+    inline void setFrameBudget(size_t bytes) { m_frameBudget = bytes; }
+
+    ~TextureStreamer();
+};
@@ -0,0 +1,42 @@
+#include "ThreadPool.h"
+#include "Logger.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount/*=0*/)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    m_workers.reserve(threadCount);
+    for (size_t i{}; i < threadCount; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    LOGGER_VERB << "Started a thread pool with " << threadCount << " threads" << Logger::End;
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_taskAvailableCv.wait(lock, [this](){ return m_shouldStop || !m_tasks.empty(); });
+            if (m_tasks.empty()) // Stopping and nothing left to do
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_shouldStop = true;
+    }
+    m_taskAvailableCv.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+}
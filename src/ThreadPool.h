@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+/*
+ * A fixed set of worker threads executing submitted tasks in FIFO order.
+ * Tasks must not touch the OpenGL context, it belongs to the render thread.
+ */
+class ThreadPool final
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailableCv;
+    bool m_shouldStop{};
+
+    void workerLoop();
+
+public:
+    /*
+     * threadCount: The number of worker threads, 0 means one per hardware thread.
+     */
+    ThreadPool(size_t threadCount=0);
+
+    // Copy ctor, copy assignment op
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // Move ctor, move assignment op
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    inline size_t getThreadCount() const { return m_workers.size(); }
+
+    /*
+     * Queues `func` for execution on a worker thread.
+     *
+     * Returns: A future holding the return value of `func`
+     */
+    template <typename F>
+    auto submit(F&& func) -> std::future<std::invoke_result_t<F>>
+    {
+        using result_t = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(func));
+        std::future<result_t> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            m_tasks.emplace_back([task](){ (*task)(); });
+        }
+        m_taskAvailableCv.notify_one();
+        return future;
+    }
+
+    // Finishes the queued tasks and joins the workers
+    ~ThreadPool();
+};
@@ -0,0 +1,174 @@
+#include "Trace.h"
+#include "Logger.h"
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cassert>
+
+namespace Trace
+{
+
+using steadyClock_t = std::chrono::steady_clock;
+
+struct ThreadBuffer
+{
+    std::mutex mutex;
+    std::vector<char> data;
+
+    ThreadBuffer();
+    ~ThreadBuffer();
+};
+
+// Lock order: s_buffersMutex, then ThreadBuffer::mutex, then s_fileMutex
+static std::mutex s_buffersMutex;
+static std::vector<ThreadBuffer*> s_buffers;
+
+static std::mutex s_fileMutex;
+static std::ofstream s_file;
+// The call sites by id-1, with their argument types
+static std::vector<std::pair<const CallSite*, const char*>> s_callSites;
+static std::atomic<steadyClock_t::rep> s_startTime{};
+
+static thread_local ThreadBuffer t_buffer;
+
+ThreadBuffer::ThreadBuffer()
+{
+    data.reserve(TRACE_THREAD_BUFFER_SIZE);
+    std::lock_guard<std::mutex> lock{s_buffersMutex};
+    s_buffers.push_back(this);
+}
+
+static void writeEntry(uint32_t id, const char* data, size_t size)
+{
+    const EntryHeader header{id, (uint32_t)size};
+    s_file.write((const char*)&header, sizeof(header));
+    s_file.write(data, size);
+}
+
+static void writeCallSite(uint32_t id, const CallSite* site, const char* argTypes)
+{
+    std::string payload((const char*)&id, sizeof(id));
+    payload.append(argTypes, strlen(argTypes)+1);
+    payload.append(site->file, strlen(site->file)+1);
+    payload.append(site->format, strlen(site->format)+1);
+    writeEntry(callSiteEntryId, payload.data(), payload.size());
+}
+
+// Writes the records of the thread. The caller locks the buffer.
+static void flushBuffer(ThreadBuffer* buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock{s_fileMutex};
+        if (s_file.is_open())
+            s_file.write(buffer->data.data(), buffer->data.size());
+    }
+    buffer->data.clear();
+}
+
+ThreadBuffer::~ThreadBuffer()
+{
+    std::lock_guard<std::mutex> buffersLock{s_buffersMutex};
+    std::erase(s_buffers, this);
+    std::lock_guard<std::mutex> lock{mutex};
+    flushBuffer(this);
+}
+
+bool open(const std::string& path)
+{
+    close();
+
+    std::lock_guard<std::mutex> buffersLock{s_buffersMutex};
+    // Drop what was recorded while closing the previous file
+    for (ThreadBuffer* buffer : s_buffers)
+    {
+        std::lock_guard<std::mutex> lock{buffer->mutex};
+        buffer->data.clear();
+    }
+
+    std::lock_guard<std::mutex> lock{s_fileMutex};
+    s_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!s_file.is_open())
+    {
+        Logger::err << "Failed to create trace file: " << path << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+    FileHeader header{};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = fileVersion;
+    s_file.write((const char*)&header, sizeof(header));
+    // The call sites registered before, their records don't repeat the format
+    for (size_t i{}; i < s_callSites.size(); ++i)
+        writeCallSite(i+1, s_callSites[i].first, s_callSites[i].second);
+
+    s_startTime = steadyClock_t::now().time_since_epoch().count();
+    s_isOpen = true;
+    Logger::log << "Writing trace records to " << path << Logger::End;
+    return 0;
+}
+
+void close()
+{
+    if (!s_isOpen.exchange(false))
+        return;
+
+    std::lock_guard<std::mutex> buffersLock{s_buffersMutex};
+    for (ThreadBuffer* buffer : s_buffers)
+    {
+        std::lock_guard<std::mutex> lock{buffer->mutex};
+        flushBuffer(buffer);
+    }
+
+    std::lock_guard<std::mutex> lock{s_fileMutex};
+    s_file.close();
+    if (!s_file.good())
+        Logger::warn << "Failed to write the trace file" << Logger::End;
+}
+
+uint32_t registerCallSite(CallSite* site, const char* argTypes)
+{
+    std::lock_guard<std::mutex> lock{s_fileMutex};
+    // Another thread may have registered it meanwhile
+    if (const uint32_t id = site->id.load(std::memory_order_relaxed))
+        return id;
+
+    s_callSites.emplace_back(site, argTypes);
+    const uint32_t id = s_callSites.size();
+    if (s_file.is_open())
+        writeCallSite(id, site, argTypes);
+    site->id.store(id, std::memory_order_release);
+    return id;
+}
+
+char* beginRecord(uint32_t id, size_t payloadSize)
+{
+    assert(id != callSiteEntryId);
+
+    ThreadBuffer& buffer = t_buffer;
+    buffer.mutex.lock();
+
+    const size_t size = sizeof(uint64_t)+payloadSize;
+    if (buffer.data.size()+sizeof(EntryHeader)+size > TRACE_THREAD_BUFFER_SIZE)
+        flushBuffer(&buffer);
+
+    const size_t offset = buffer.data.size();
+    buffer.data.resize(offset+sizeof(EntryHeader)+size);
+    char* dst = buffer.data.data()+offset;
+
+    const EntryHeader header{id, (uint32_t)size};
+    std::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+
+    const uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            steadyClock_t::duration{steadyClock_t::now().time_since_epoch().count()-s_startTime.load(std::memory_order_relaxed)}).count();
+    std::memcpy(dst, &timestamp, sizeof(timestamp));
+    return dst+sizeof(timestamp);
+}
+
+void endRecord()
+{
+    t_buffer.mutex.unlock();
+}
+
+} // namespace Trace
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+// If 0, the `LOGGER_TRACE` calls generate no code
+#define TRACE_ALLOW 1
+// The records of a thread are written to the file when its buffer reaches this size
+#define TRACE_THREAD_BUFFER_SIZE (64*1024)
+
+/*
+ * Binary trace records for high-rate diagnostics.
+ *
+ *      LOGGER_TRACE("Stepped {} substeps in {}us", substeps, durUs);
+ *
+ * stores the id of the call site, a timestamp and the raw arguments in a buffer
+ * of the calling thread, without formatting. The format of a call site is written
+ * once. `tracedump` decodes the file offline. While no trace file is open, the
+ * arguments are not evaluated.
+ * Arguments can be integers, floating point values, bools, enums and strings.
+ *
+ * File layout (native endianness):
+ *  * `FileHeader`
+ *  * entries, each an `EntryHeader` followed by `size` bytes:
+ *      * `callSiteEntryId`: the uint32 id of the call site, then the argument type codes
+ *        (see `ArgType`), the source file and the format string, each zero terminated.
+ *        Written before the records of the call site.
+ *      * other ids: a record of that call site. A uint64 timestamp in nanoseconds since
+ *        `open()`, then the arguments, 8 bytes for numbers, a uint32 length and the bytes for strings.
+ */
+namespace Trace
+{
+
+static constexpr char fileMagic[4] = {'E', 'T', 'R', 'C'};
+// Increment when the layout of the file changes
+static constexpr uint32_t fileVersion = 1;
+static constexpr uint32_t callSiteEntryId = 0;
+
+struct FileHeader
+{
+    char        magic[4];
+    uint32_t    version;
+};
+
+struct EntryHeader
+{
+    uint32_t    id;
+    uint32_t    size; // The bytes after the header
+};
+
+enum class ArgType : char
+{
+    Int     = 'i', // int64_t
+    UInt    = 'u', // uint64_t
+    Float   = 'f', // double
+    String  = 's', // uint32_t length, then the characters
+};
+
+// A `LOGGER_TRACE` call, the static storage of the macro
+struct CallSite
+{
+    const char* format{};
+    const char* file{};
+    // Assigned by the first record, 0 before that
+    std::atomic<uint32_t> id{};
+};
+
+inline std::atomic<bool> s_isOpen{};
+
+inline bool isOpen() { return s_isOpen.load(std::memory_order_relaxed); }
+
+/*
+ * Starts writing the records to a new file. Closes the previous one.
+ *
+ * Returns:
+ *      true if failed,
+ *      false otherwise
+ */
+bool open(const std::string& path);
+// Writes the buffered records of every thread and closes the file
+void close();
+
+// Assigns the id of the call site and writes its format to the file
+uint32_t registerCallSite(CallSite* site, const char* argTypes);
+/*
+ * Starts a record in the buffer of the calling thread and writes its header and timestamp.
+ * Returns where the arguments go, `payloadSize` bytes. Must be followed by `endRecord()`.
+ */
+char* beginRecord(uint32_t id, size_t payloadSize);
+void endRecord();
+
+template <typename T>
+constexpr ArgType getArgType()
+{
+    if constexpr (std::is_same_v<T, bool>)
+        return ArgType::UInt;
+    else if constexpr (std::is_enum_v<T>)
+        return getArgType<std::underlying_type_t<T>>();
+    else if constexpr (std::is_integral_v<T>)
+        return std::is_signed_v<T> ? ArgType::Int : ArgType::UInt;
+    else if constexpr (std::is_floating_point_v<T>)
+        return ArgType::Float;
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+        return ArgType::String;
+    else
+        static_assert(!sizeof(T), "Unsupported trace argument type");
+}
+
+template <typename T>
+inline size_t getArgSize(const T& value)
+{
+    if constexpr (getArgType<T>() == ArgType::String)
+        return sizeof(uint32_t)+std::string_view{value}.size();
+    else
+        return sizeof(uint64_t);
+}
+
+template <typename T>
+inline void writeArg(char** dst, const T& value)
+{
+    static constexpr ArgType type = getArgType<T>();
+    if constexpr (type == ArgType::String)
+    {
+        const std::string_view str{value};
+        const uint32_t size = str.size();
+        std::memcpy(*dst, &size, sizeof(size));
+        std::memcpy(*dst+sizeof(size), str.data(), size);
+        *dst += sizeof(size)+size;
+        return;
+    }
+    else if constexpr (type == ArgType::Int)
+    {
+        const int64_t converted = (int64_t)value;
+        std::memcpy(*dst, &converted, sizeof(converted));
+    }
+    else if constexpr (type == ArgType::UInt)
+    {
+        const uint64_t converted = (uint64_t)value;
+        std::memcpy(*dst, &converted, sizeof(converted));
+    }
+    else
+    {
+        const double converted = (double)value;
+        std::memcpy(*dst, &converted, sizeof(converted));
+    }
+    *dst += sizeof(uint64_t);
+}
+
+template <typename... Args>
+void record(CallSite* site, const Args&... args)
+{
+    static constexpr char argTypes[] = {(char)getArgType<Args>()..., '\0'};
+    uint32_t id = site->id.load(std::memory_order_acquire);
+    if (!id)
+        id = registerCallSite(site, argTypes);
+
+    char* dst = beginRecord(id, (getArgSize(args)+...+0));
+    (writeArg(&dst, args), ...);
+    endRecord();
+}
+
+} // namespace Trace
+
+#if TRACE_ALLOW
+#define LOGGER_TRACE(format, ...) \
+    do \
+    { \
+        if (::Trace::isOpen()) \
+        { \
+            static ::Trace::CallSite traceCallSite_{format, __FILE__}; \
+            ::Trace::record(&traceCallSite_ __VA_OPT__(,) __VA_ARGS__); \
+        } \
+    } while (false)
+#else
+#define LOGGER_TRACE(format, ...) \
+    do \
+    { \
+        if constexpr (false) \
+            ::Trace::record(nullptr __VA_OPT__(,) __VA_ARGS__); \
+    } while (false)
+#endif
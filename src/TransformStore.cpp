@@ -0,0 +1,211 @@
+#include "TransformStore.h"
+#include <cassert>
+#include <algorithm>
+#include <bit>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+// The arrays grow in steps of this, so a word of dirty bits always covers whole groups
+static constexpr size_t allocGranularity = 64;
+static_assert(allocGranularity % TransformStore::groupSize == 0);
+
+TransformStore::handle_t TransformStore::create()
+{
+    if (m_count == m_posX.size())
+    {
+        const size_t newSize = std::max(allocGranularity, m_posX.size()*2);
+        for (auto* array : {&m_posX, &m_posY, &m_posZ, &m_rotX, &m_rotY, &m_rotZ})
+            array->resize(newSize, 0.0f);
+        for (auto* array : {&m_rotW, &m_scaleX, &m_scaleY, &m_scaleZ})
+            array->resize(newSize, 1.0f);
+        m_matrices.resize(newSize*16, 0.0f);
+        m_dirtyBits.resize(newSize/64, 0);
+        m_denseToHandle.resize(newSize, nullHandle);
+    }
+
+    handle_t handle;
+    if (m_freeHandles.empty())
+    {
+        handle = m_handleToDense.size();
+        m_handleToDense.push_back(0);
+    }
+    else
+    {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+
+    const uint32_t i = m_count++;
+    m_handleToDense[handle] = i;
+    m_denseToHandle[i] = handle;
+    resetElement(i);
+    return handle;
+}
+
+void TransformStore::destroy(handle_t handle)
+{
+    assert(handle < m_handleToDense.size());
+    const uint32_t i = m_handleToDense[handle];
+    const uint32_t last = m_count-1;
+    if (i != last)
+    {
+        copyElement(last, i);
+        m_denseToHandle[i] = m_denseToHandle[last];
+        m_handleToDense[m_denseToHandle[i]] = i;
+    }
+    // Keep the padding an identity, so the batches never compute garbage
+    resetElement(last);
+    m_dirtyBits[last/64] &= ~(uint64_t(1) << (last%64));
+    m_denseToHandle[last] = nullHandle;
+    m_freeHandles.push_back(handle);
+    --m_count;
+}
+
+void TransformStore::resetElement(uint32_t i)
+{
+    m_posX[i] = 0; m_posY[i] = 0; m_posZ[i] = 0;
+    m_rotX[i] = 0; m_rotY[i] = 0; m_rotZ[i] = 0; m_rotW[i] = 1;
+    m_scaleX[i] = 1; m_scaleY[i] = 1; m_scaleZ[i] = 1;
+    markDirty(i);
+}
+
+void TransformStore::copyElement(uint32_t from, uint32_t to)
+{
+    m_posX[to] = m_posX[from]; m_posY[to] = m_posY[from]; m_posZ[to] = m_posZ[from];
+    m_rotX[to] = m_rotX[from]; m_rotY[to] = m_rotY[from]; m_rotZ[to] = m_rotZ[from]; m_rotW[to] = m_rotW[from];
+    m_scaleX[to] = m_scaleX[from]; m_scaleY[to] = m_scaleY[from]; m_scaleZ[to] = m_scaleZ[from];
+    for (int j{}; j < 16; ++j)
+        m_matrices[to*16+j] = m_matrices[from*16+j];
+    if (m_dirtyBits[from/64] & (uint64_t(1) << (from%64)))
+        markDirty(to);
+}
+
+/*
+ * The matrix of a transform, column by column:
+ *   (1-2(yy+zz)) * sx,  2(xy+wz)     * sx,  2(xz-wy)     * sx,  0
+ *   2(xy-wz)     * sy,  (1-2(xx+zz)) * sy,  2(yz+wx)     * sy,  0
+ *   2(xz+wy)     * sz,  2(yz-wx)     * sz,  (1-2(xx+yy)) * sz,  0
+ *   px,                 py,                 pz,                 1
+ */
+#if defined(__SSE__)
+
+#ifdef __AVX__
+using vec_t = __m256;
+static inline vec_t load(const float* p) { return _mm256_loadu_ps(p); }
+static inline vec_t set1(float v) { return _mm256_set1_ps(v); }
+static inline vec_t add(vec_t a, vec_t b) { return _mm256_add_ps(a, b); }
+static inline vec_t sub(vec_t a, vec_t b) { return _mm256_sub_ps(a, b); }
+static inline vec_t mul(vec_t a, vec_t b) { return _mm256_mul_ps(a, b); }
+// The 4 transforms of `lane` (0 or 1) in an SSE register
+static inline __m128 half(vec_t v, int lane) { return lane ? _mm256_extractf128_ps(v, 1) : _mm256_castps256_ps128(v); }
+#else
+using vec_t = __m128;
+static inline vec_t load(const float* p) { return _mm_loadu_ps(p); }
+static inline vec_t set1(float v) { return _mm_set1_ps(v); }
+static inline vec_t add(vec_t a, vec_t b) { return _mm_add_ps(a, b); }
+static inline vec_t sub(vec_t a, vec_t b) { return _mm_sub_ps(a, b); }
+static inline vec_t mul(vec_t a, vec_t b) { return _mm_mul_ps(a, b); }
+static inline __m128 half(vec_t v, int) { return v; }
+#endif
+
+void TransformStore::updateGroup(size_t first)
+{
+    const vec_t x = load(&m_rotX[first]);
+    const vec_t y = load(&m_rotY[first]);
+    const vec_t z = load(&m_rotZ[first]);
+    const vec_t w = load(&m_rotW[first]);
+    const vec_t one = set1(1.0f);
+    const vec_t two = set1(2.0f);
+
+    const vec_t x2 = mul(x, two);
+    const vec_t y2 = mul(y, two);
+    const vec_t z2 = mul(z, two);
+    const vec_t xx = mul(x, x2);
+    const vec_t yy = mul(y, y2);
+    const vec_t zz = mul(z, z2);
+    const vec_t xy = mul(x, y2);
+    const vec_t xz = mul(x, z2);
+    const vec_t yz = mul(y, z2);
+    const vec_t wx = mul(w, x2);
+    const vec_t wy = mul(w, y2);
+    const vec_t wz = mul(w, z2);
+
+    const vec_t sx = load(&m_scaleX[first]);
+    const vec_t sy = load(&m_scaleY[first]);
+    const vec_t sz = load(&m_scaleZ[first]);
+
+    // Component `r` of column `c` for every transform in the group
+    const vec_t cols[4][3] = {
+        {mul(sub(one, add(yy, zz)), sx), mul(add(xy, wz), sx), mul(sub(xz, wy), sx)},
+        {mul(sub(xy, wz), sy), mul(sub(one, add(xx, zz)), sy), mul(add(yz, wx), sy)},
+        {mul(add(xz, wy), sz), mul(sub(yz, wx), sz), mul(sub(one, add(xx, yy)), sz)},
+        {load(&m_posX[first]), load(&m_posY[first]), load(&m_posZ[first])},
+    };
+
+    // Transpose groups of 4 into the column-major matrices
+    for (size_t lane{}; lane < groupSize/4; ++lane)
+    {
+        float* const dst = &m_matrices[(first+lane*4)*16];
+        for (int c{}; c < 4; ++c)
+        {
+            __m128 r0 = half(cols[c][0], lane);
+            __m128 r1 = half(cols[c][1], lane);
+            __m128 r2 = half(cols[c][2], lane);
+            __m128 r3 = _mm_set1_ps(c == 3 ? 1.0f : 0.0f);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dst+0*16+c*4, r0);
+            _mm_storeu_ps(dst+1*16+c*4, r1);
+            _mm_storeu_ps(dst+2*16+c*4, r2);
+            _mm_storeu_ps(dst+3*16+c*4, r3);
+        }
+    }
+}
+
+#else // No SSE
+
+void TransformStore::updateGroup(size_t first)
+{
+    for (size_t i = first; i < first+groupSize; ++i)
+    {
+        const float x = m_rotX[i], y = m_rotY[i], z = m_rotZ[i], w = m_rotW[i];
+        const float xx = x*x*2, yy = y*y*2, zz = z*z*2;
+        const float xy = x*y*2, xz = x*z*2, yz = y*z*2;
+        const float wx = w*x*2, wy = w*y*2, wz = w*z*2;
+        const float sx = m_scaleX[i], sy = m_scaleY[i], sz = m_scaleZ[i];
+        const float matrix[16] = {
+            (1-(yy+zz))*sx, (xy+wz)*sx, (xz-wy)*sx, 0,
+            (xy-wz)*sy, (1-(xx+zz))*sy, (yz+wx)*sy, 0,
+            (xz+wy)*sz, (yz-wx)*sz, (1-(xx+yy))*sz, 0,
+            m_posX[i], m_posY[i], m_posZ[i], 1,
+        };
+        for (int j{}; j < 16; ++j)
+            m_matrices[i*16+j] = matrix[j];
+    }
+}
+
+#endif
+
+size_t TransformStore::update()
+{
+    static constexpr uint64_t groupMask = (uint64_t(1) << groupSize)-1;
+
+    size_t updated{};
+    const size_t wordCount = (m_count+63)/64;
+    for (size_t wordI{}; wordI < wordCount; ++wordI)
+    {
+        const uint64_t word = m_dirtyBits[wordI];
+        if (word == 0)
+            continue;
+        updated += std::popcount(word);
+
+        for (size_t group{}; group < 64/groupSize; ++group)
+        {
+            if ((word >> (group*groupSize)) & groupMask)
+                updateGroup(wordI*64+group*groupSize);
+        }
+        m_dirtyBits[wordI] = 0;
+    }
+    m_updatedLastCall = updated;
+    return updated;
+}
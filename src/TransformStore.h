@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Stores the position, rotation and scale of transforms in structure-of-arrays
+ * layout, and computes their world matrices in batches.
+ *
+ * The setters only mark the transform dirty, `update()` recomputes the matrices
+ * of the dirty ones with SSE (or AVX, if enabled at compile time), a group of
+ * 4 (8) at a time. The matrices are stored one after the other, column-major,
+ * so they can be handed to OpenGL as they are.
+ *
+ * Handles stay valid until destroyed, the data is kept dense by moving
+ * the last transform into the place of a destroyed one.
+ */
+class TransformStore final
+{
+public:
+    using handle_t = uint32_t;
+    static constexpr handle_t nullHandle = UINT32_MAX;
+
+    // The number of transforms updated together. The arrays are padded to a multiple of it.
+#ifdef __AVX__
+    static constexpr size_t groupSize = 8;
+#else
+    static constexpr size_t groupSize = 4;
+#endif
+
+private:
+    // Indexed by the dense index
+    std::vector<float> m_posX, m_posY, m_posZ;
+    std::vector<float> m_rotX, m_rotY, m_rotZ, m_rotW;
+    std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+    std::vector<float> m_matrices; // 16 floats each
+    std::vector<uint64_t> m_dirtyBits;
+    std::vector<handle_t> m_denseToHandle;
+    size_t m_count{};
+
+    // Indexed by the handle
+    std::vector<uint32_t> m_handleToDense;
+    std::vector<handle_t> m_freeHandles;
+
+    size_t m_updatedLastCall{};
+
+    inline void markDirty(uint32_t i) { m_dirtyBits[i/64] |= uint64_t(1) << (i%64); }
+    // Sets the element to identity
+    void resetElement(uint32_t i);
+    void copyElement(uint32_t from, uint32_t to);
+    // Computes the matrices of the group starting at `first`
+    void updateGroup(size_t first);
+
+public:
+    TransformStore() {}
+
+    // Copy ctor, copy assignment op
+    TransformStore(const TransformStore&) = delete;
+    TransformStore& operator=(const TransformStore&) = delete;
+    // Move ctor, move assignment op
+    TransformStore(TransformStore&&) = delete;
+    TransformStore& operator=(TransformStore&&) = delete;
+
+    /*
+     * Adds an identity transform.
+     *
+     * Returns: The handle of the transform
+     */
+    handle_t create();
+    void destroy(handle_t handle);
+    inline size_t getCount() const { return m_count; }
+
+    inline void setPosition(handle_t handle, float x, float y, float z)
+    {
+        const uint32_t i = m_handleToDense[handle];
+        m_posX[i] = x; m_posY[i] = y; m_posZ[i] = z;
+        markDirty(i);
+    }
+
+    // The rotation is a unit quaternion
+    inline void setRotation(handle_t handle, float x, float y, float z, float w)
+    {
+        const uint32_t i = m_handleToDense[handle];
+        m_rotX[i] = x; m_rotY[i] = y; m_rotZ[i] = z; m_rotW[i] = w;
+        markDirty(i);
+    }
+
+    inline void setScale(handle_t handle, float x, float y, float z)
+    {
+        const uint32_t i = m_handleToDense[handle];
+        m_scaleX[i] = x; m_scaleY[i] = y; m_scaleZ[i] = z;
+        markDirty(i);
+    }
+
+    inline void getPosition(handle_t handle, float* x, float* y, float* z) const
+    {
+        const uint32_t i = m_handleToDense[handle];
+        *x = m_posX[i]; *y = m_posY[i]; *z = m_posZ[i];
+    }
+
+    inline void getRotation(handle_t handle, float* x, float* y, float* z, float* w) const
+    {
+        const uint32_t i = m_handleToDense[handle];
+        *x = m_rotX[i]; *y = m_rotY[i]; *z = m_rotZ[i]; *w = m_rotW[i];
+    }
+
+    inline void getScale(handle_t handle, float* x, float* y, float* z) const
+    {
+        const uint32_t i = m_handleToDense[handle];
+        *x = m_scaleX[i]; *y = m_scaleY[i]; *z = m_scaleZ[i];
+    }
+
+    /*
+     * Returns: The column-major world matrix (translation * rotation * scale)
+     *          as of the last `update()`
+     */
+    inline const float* getMatrix(handle_t handle) const { return &m_matrices[m_handleToDense[handle]*16]; }
+
+    /*
+     * Recomputes the matrices of the dirty transforms and clears the dirty bits.
+     *
+     * Returns: The number of dirty transforms
+     */
+    size_t update();
+    inline size_t getUpdatedLastCall() const { return m_updatedLastCall; }
+};
+
@@ -0,0 +1,449 @@
+#include "WorldPartition.h"
+#include "Logger.h"
+#include <algorithm>
+#include <unordered_set>
+#include <cmath>
+#include <cassert>
+
+// An object with its body and its transform in the store, without the collision shape and the assets
+static constexpr size_t objectMemSize = sizeof(GameObject)+PhysicsWorld::bodyMemSize+(3+4+3+16)*sizeof(float);
+
+static size_t getCollShapeMemSize(const btCollisionShape* shape)
+{
+    switch (shape->getShapeType())
+    {
+    case CONVEX_HULL_SHAPE_PROXYTYPE:
+        return sizeof(btConvexHullShape)+((const btConvexHullShape*)shape)->getNumPoints()*sizeof(btVector3);
+    case SPHERE_SHAPE_PROXYTYPE:
+        return sizeof(btSphereShape);
+    case BOX_SHAPE_PROXYTYPE:
+        return sizeof(btBoxShape);
+    case CYLINDER_SHAPE_PROXYTYPE:
+        return sizeof(btCylinderShape);
+    default:
+        return sizeof(btCollisionShape);
+    }
+}
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+WorldPartition::WorldPartition(
+        std::unique_ptr<GameMap> map,
+        const Config& config,
+        ThreadPool* pool,
+        PhysicsWorld* physics,
+        DynamicBvh* bvh,
+        modelOpener_t openModel,
+        textureOpener_t openTexture)
+    : m_map{std::move(map)}
+    , m_config{config}
+    , m_pool{pool}
+    , m_physics{physics}
+    , m_bvh{bvh}
+    , m_openModel{std::move(openModel)}
+    , m_openTexture{std::move(openTexture)}
+{
+    assert(m_pool && m_physics && m_bvh);
+    assert(m_config.cellSize > 0);
+    assert(m_config.unloadRadius > m_config.loadRadius);
+
+    //                 Grid coords  Index in `m_cells`
+    std::unordered_map<uint64_t, size_t> cellIndices;
+    const GameMap::objectList_t& descrs = m_map->getObjects();
+    for (uint32_t i{}; i < descrs.size(); ++i)
+    {
+        const glm::vec3& pos = descrs[i]->pos;
+        const int x = (int)std::floor(pos.x/m_config.cellSize);
+        const int z = (int)std::floor(pos.z/m_config.cellSize);
+        const uint64_t key = (uint64_t)(uint32_t)x << 32 | (uint32_t)z;
+
+        auto [it, isNew] = cellIndices.try_emplace(key, m_cells.size());
+        if (isNew)
+        {
+            m_cells.emplace_back();
+            m_cells.back().x = x;
+            m_cells.back().z = z;
+        }
+        m_cells[it->second].objectIs.push_back(i);
+    }
+
+    Logger::log << "Split " << descrs.size() << " objects into " << m_cells.size() << " cells of "
+        << m_config.cellSize << 'x' << m_config.cellSize << ", load radius: " << m_config.loadRadius
+        << ", unload radius: " << m_config.unloadRadius << ", budget: "
+        << m_config.memoryBudget/1024/1024 << " MiB" << Logger::End;
+}
+
+float WorldPartition::getCellDistance(const Cell& cell, const glm::vec3& pos) const
+{
+    // Distance from the square of the cell on the XZ plane, 0 inside it
+    const float minX = cell.x*m_config.cellSize;
+    const float minZ = cell.z*m_config.cellSize;
+    const float dx = std::max({minX-pos.x, 0.0f, pos.x-(minX+m_config.cellSize)});
+    const float dz = std::max({minZ-pos.z, 0.0f, pos.z-(minZ+m_config.cellSize)});
+    return std::sqrt(dx*dx+dz*dz);
+}
+
+size_t WorldPartition::estimateCellBytes(const Cell& cell) const
+{
+    if (cell.measuredBytes)
+        return cell.measuredBytes;
+
+    // Never loaded, assume its objects cost as much as the resident ones on average
+    const size_t avgObjectBytes = (m_objectCount ? getResidentBytes()/m_objectCount : 0);
+    return cell.objectIs.size()*std::max(avgObjectBytes, objectMemSize);
+}
+
+void WorldPartition::addAssetUse(const void* key, std::shared_ptr<Model> model, std::shared_ptr<Texture> texture)
+{
+    auto [it, isNew] = m_assetUses.try_emplace(key);
+    if (isNew)
+    {
+        it->second.model = std::move(model);
+        it->second.texture = std::move(texture);
+        m_unsizedAssetKeys.push_back(key);
+    }
+    ++it->second.cellCount;
+}
+
+void WorldPartition::releaseAssetUse(const void* key)
+{
+    auto it = m_assetUses.find(key);
+    assert(it != m_assetUses.end());
+    if (--it->second.cellCount == 0)
+    {
+        m_assetBytes -= it->second.bytes;
+        m_assetUses.erase(it);
+    }
+}
+
+void WorldPartition::updateAssetSizes()
+{
+    std::erase_if(m_unsizedAssetKeys, [this](const void* key){
+        auto it = m_assetUses.find(key);
+        // Released while loading, or the key was reused by a new asset that is listed again
+        if (it == m_assetUses.end() || it->second.isSized)
+            return true;
+
+        AssetUse& use = it->second;
+        if (use.model)
+        {
+            const Model::State state = use.model->getState();
+            if (state == Model::State::Uninitialized || state == Model::State::Loading)
+                return false;
+            use.bytes = use.model->getGpuMemSize();
+        }
+        else
+        {
+            const Texture::State state = use.texture->getState();
+            if (state == Texture::State::Uninitialized || state == Texture::State::Loading)
+                return false;
+            use.bytes = use.texture->getGpuMemSize();
+        }
+        use.isSized = true;
+        m_assetBytes += use.bytes;
+        return true;
+    });
+}
+
+void WorldPartition::releaseCellAssets(Cell* cell)
+{
+    cell->assets.clear();
+    for (const void* key : cell->assetKeys)
+        releaseAssetUse(key);
+    cell->assetKeys.clear();
+}
+
+void WorldPartition::startLoadingCell(size_t cellI)
+{
+    Cell& cell = m_cells[cellI];
+    assert(cell.state == CellState::Unloaded);
+    cell.loadStart = clock_t::now();
+    cell.reservedBytes = estimateCellBytes(cell);
+    m_loadingBytes += cell.reservedBytes;
+
+    // The assets load on the pool too, while the shapes are being built
+    const GameMap::objectList_t& descrs = m_map->getObjects();
+    std::unordered_set<const void*> keys;
+    cell.assets.reserve(cell.objectIs.size());
+    for (uint32_t objI : cell.objectIs)
+    {
+        const GameMap::ObjectDescr& descr = *descrs[objI];
+        std::shared_ptr<Model> model = m_openModel(descr.modelName);
+        std::shared_ptr<Texture> texture = m_openTexture(descr.textureName);
+        if (keys.insert(model.get()).second)
+            addAssetUse(model.get(), model, nullptr);
+        if (keys.insert(texture.get()).second)
+            addAssetUse(texture.get(), nullptr, texture);
+        cell.assets.emplace_back(std::move(model), std::move(texture));
+    }
+    cell.assetKeys.assign(keys.begin(), keys.end());
+
+    // The cells are not added or removed, so the task can refer to it by index
+    cell.pendingShapes = m_pool->submit([this, cellI](){ return buildCellShapes(cellI); });
+    cell.state = CellState::Loading;
+    ++m_loadingCellCount;
+}
+
+WorldPartition::CellShapes WorldPartition::buildCellShapes(size_t cellI)
+{
+    const auto start = clock_t::now();
+    const Cell& cell = m_cells[cellI];
+    const GameMap::objectList_t& descrs = m_map->getObjects();
+
+    CellShapes output;
+    shapeList_t& shapes = output.shapes;
+    shapes.reserve(cell.objectIs.size());
+    for (uint32_t objI : cell.objectIs)
+    {
+        const GameMap::ObjectDescr& descr = *descrs[objI];
+        if (descr.collShapeType != BinaryMap::CollShapeType::Mesh)
+        {
+            shapes.push_back(GameMap::createCollShape(descr));
+            continue;
+        }
+        ++output.meshRefs;
+
+        // Share the meshes with the other resident cells
+        {
+            std::lock_guard<std::mutex> lock{m_meshShapesMutex};
+            auto it = m_meshShapes.find(descr.collMeshPath);
+            if (it != m_meshShapes.end())
+            {
+                if (std::shared_ptr<btCollisionShape> shape = it->second.lock())
+                {
+                    shapes.push_back(std::move(shape));
+                    continue;
+                }
+            }
+        }
+
+        // Built without the lock, another task may build the same mesh meanwhile
+        std::shared_ptr<btCollisionShape> shape = GameMap::createCollShape(descr);
+        std::lock_guard<std::mutex> lock{m_meshShapesMutex};
+        std::weak_ptr<btCollisionShape>& cached = m_meshShapes[descr.collMeshPath];
+        if (std::shared_ptr<btCollisionShape> other = cached.lock())
+        {
+            shape = std::move(other);
+        }
+        else
+        {
+            cached = shape;
+            ++output.builtMeshes;
+        }
+        shapes.push_back(std::move(shape));
+    }
+    output.buildMs = msSince(start);
+    return output;
+}
+
+void WorldPartition::pollLoadingCells(const glm::vec3& viewerPos)
+{
+    for (size_t cellI{}; cellI < m_cells.size(); ++cellI)
+    {
+        Cell& cell = m_cells[cellI];
+        if (cell.state != CellState::Loading
+         || cell.pendingShapes.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+            continue;
+
+        --m_loadingCellCount;
+        m_loadingBytes -= cell.reservedBytes;
+        try
+        {
+            CellShapes built = cell.pendingShapes.get();
+            cell.shapes = std::move(built.shapes);
+            ++m_shapeStats.cellCount;
+            m_shapeStats.buildMs += built.buildMs;
+            m_shapeStats.meshRefs += built.meshRefs;
+            m_shapeStats.builtMeshes += built.builtMeshes;
+            LOGGER_VERB << "Built the collision shapes of cell (" << cell.x << ", " << cell.z << ") in "
+                << built.buildMs << "ms, " << built.builtMeshes << " of " << built.meshRefs
+                << " meshes built, the rest shared" << Logger::End;
+        }
+        catch (const std::runtime_error& e)
+        {
+            Logger::err << "Failed to load cell (" << cell.x << ", " << cell.z << "): " << e.what() << Logger::End;
+            releaseCellAssets(&cell);
+            cell.state = CellState::Failed;
+            continue;
+        }
+
+        // The viewer moved away while the cell was loading
+        if (getCellDistance(cell, viewerPos) > m_config.unloadRadius)
+        {
+            cell.shapes.clear();
+            releaseCellAssets(&cell);
+            cell.state = CellState::Unloaded;
+            continue;
+        }
+
+        // Count the shapes shared by several objects of the cell once
+        std::unordered_set<const btCollisionShape*> countedShapes;
+        cell.ownBytes = cell.objectIs.size()*objectMemSize;
+        for (const auto& shape : cell.shapes)
+        {
+            if (shape && countedShapes.insert(shape.get()).second)
+                cell.ownBytes += getCollShapeMemSize(shape.get());
+        }
+        m_cellBytes += cell.ownBytes;
+        ++m_residentCellCount;
+
+        cell.objects.reserve(cell.objectIs.size());
+        cell.state = CellState::Creating;
+        m_creatingCellIs.push_back(cellI);
+    }
+}
+
+void WorldPartition::createObjects(size_t maxObjects)
+{
+    const GameMap::objectList_t& descrs = m_map->getObjects();
+    std::vector<GameObject*> created;
+    while (!m_creatingCellIs.empty() && created.size() < maxObjects)
+    {
+        Cell& cell = m_cells[m_creatingCellIs.front()];
+        while (cell.objects.size() < cell.objectIs.size() && created.size() < maxObjects)
+        {
+            const size_t i = cell.objects.size();
+            const GameMap::ObjectDescr& descr = *descrs[cell.objectIs[i]];
+            auto& [model, texture] = cell.assets[i];
+
+            cell.objects.push_back(std::make_unique<GameObject>(
+                    std::move(model), glm::radians(descr.modelRotDeg), std::move(texture),
+                    std::move(cell.shapes[i]), descr.mass, descr.objName, descr.flags));
+            cell.objects.back()->setPos(descr.pos);
+            cell.objects.back()->scale(descr.scale);
+            created.push_back(cell.objects.back().get());
+        }
+        if (cell.objects.size() < cell.objectIs.size())
+            break;
+
+        // The objects hold the shapes and the assets from now on
+        cell.shapes.clear();
+        cell.assets.clear();
+        cell.state = CellState::Loaded;
+        m_creatingCellIs.erase(m_creatingCellIs.begin());
+        LOGGER_VERB << "Loaded cell (" << cell.x << ", " << cell.z << "): " << cell.objects.size()
+            << " objects in " << msSince(cell.loadStart) << "ms" << Logger::End;
+    }
+
+    m_objectCount += created.size();
+    if (!created.empty())
+        m_physics->addObjects(created);
+}
+
+void WorldPartition::unloadCell(Cell* cell)
+{
+    assert(cell->state == CellState::Creating || cell->state == CellState::Loaded);
+    if (cell->state == CellState::Creating)
+        std::erase(m_creatingCellIs, size_t(cell-m_cells.data()));
+
+    std::vector<GameObject*> objects;
+    objects.reserve(cell->objects.size());
+    for (const auto& object : cell->objects)
+    {
+        object->removeBvhProxy(m_bvh);
+        objects.push_back(object.get());
+    }
+    m_physics->removeObjects(objects);
+    m_objectCount -= objects.size();
+    cell->objects.clear();
+    cell->shapes.clear();
+
+    // Remember the cost of the cell, so it is not loaded again until it fits in the budget
+    size_t assetBytes{};
+    for (const void* key : cell->assetKeys)
+        assetBytes += m_assetUses.find(key)->second.bytes;
+    cell->measuredBytes = cell->ownBytes+assetBytes;
+    releaseCellAssets(cell);
+
+    m_cellBytes -= cell->ownBytes;
+    cell->ownBytes = 0;
+    --m_residentCellCount;
+    cell->state = CellState::Unloaded;
+    LOGGER_VERB << "Unloaded cell (" << cell->x << ", " << cell->z << "), "
+        << cell->measuredBytes/1024 << " KiB" << Logger::End;
+}
+
+void WorldPartition::update(const glm::vec3& viewerPos)
+{
+    updateAssetSizes();
+    pollLoadingCells(viewerPos);
+    createObjects(WORLD_MAX_OBJECTS_PER_UPDATE);
+
+    //                    Distance  Index in `m_cells`
+    std::vector<std::pair<float, size_t>> residentCells;
+    std::vector<std::pair<float, size_t>> cellsToLoad;
+    for (size_t cellI{}; cellI < m_cells.size(); ++cellI)
+    {
+        Cell& cell = m_cells[cellI];
+        const float distance = getCellDistance(cell, viewerPos);
+        switch (cell.state)
+        {
+        case CellState::Creating:
+        case CellState::Loaded:
+            if (distance > m_config.unloadRadius)
+                unloadCell(&cell);
+            else
+                residentCells.emplace_back(distance, cellI);
+            break;
+
+        case CellState::Unloaded:
+            if (distance <= m_config.loadRadius)
+                cellsToLoad.emplace_back(distance, cellI);
+            break;
+
+        case CellState::Loading:
+        case CellState::Failed:
+            break;
+        }
+    }
+
+    // Over the budget, unload the farthest cells, but never the one the viewer is in
+    std::sort(residentCells.begin(), residentCells.end());
+    while (getResidentBytes() > m_config.memoryBudget
+        && !residentCells.empty() && residentCells.back().first > 0)
+    {
+        LOGGER_VERB << "World memory over budget: " << getResidentBytes()/1024 << " KiB" << Logger::End;
+        unloadCell(&m_cells[residentCells.back().second]);
+        residentCells.pop_back();
+    }
+
+    // Load the nearest cells first, as long as they are expected to fit in the budget
+    std::sort(cellsToLoad.begin(), cellsToLoad.end());
+    size_t plannedBytes = getResidentBytes()+m_loadingBytes;
+    for (const auto& [distance, cellI] : cellsToLoad)
+    {
+        if (m_loadingCellCount >= WORLD_MAX_LOADING_CELLS)
+            break;
+        const size_t estimate = estimateCellBytes(m_cells[cellI]);
+        if (distance > 0 && plannedBytes+estimate > m_config.memoryBudget)
+            break;
+        plannedBytes += estimate;
+        startLoadingCell(cellI);
+    }
+}
+
+void WorldPartition::waitForLoadingCells(const glm::vec3& viewerPos)
+{
+    for (Cell& cell : m_cells)
+    {
+        if (cell.state == CellState::Loading)
+            cell.pendingShapes.wait();
+    }
+    pollLoadingCells(viewerPos);
+    createObjects(SIZE_MAX);
+}
+
+WorldPartition::~WorldPartition()
+{
+    for (Cell& cell : m_cells)
+    {
+        // The tasks refer to the cells
+        if (cell.state == CellState::Loading)
+            cell.pendingShapes.wait();
+        else if (cell.state == CellState::Creating || cell.state == CellState::Loaded)
+            unloadCell(&cell);
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <glm/vec3.hpp>
+#include "GameMap.h"
+#include "GameObject.h"
+#include "PhysicsWorld.h"
+#include "DynamicBvh.h"
+#include "ThreadPool.h"
+
+// The map is split into square cells of this size on the XZ plane
+#define WORLD_CELL_SIZE 64.0f
+// Cells closer to the viewer than this are loaded
+#define WORLD_LOAD_RADIUS 160.0f
+// Loaded cells are unloaded when they get farther than this. Larger than the load
+// radius, so moving back and forth on the border does not load and unload a cell every frame.
+#define WORLD_UNLOAD_RADIUS 224.0f
+// The resident cells and their assets may use this many bytes, the farthest cells are unloaded above it
+#define WORLD_MEMORY_BUDGET (512*1024*1024ull)
+// At most this many cells are loading on the pool at once
+#define WORLD_MAX_LOADING_CELLS 4
+// At most this many objects are created in one `update()`, to limit frame spikes
+#define WORLD_MAX_OBJECTS_PER_UPDATE 512
+
+/*
+ * Streams the objects of a map around the viewer.
+ *
+ * The objects of the map are sorted into a grid of cells by their position.
+ * Cells within the load radius are loaded in the background: their models and
+ * textures are opened asynchronously and their collision shapes are built on
+ * the pool. When the shapes are ready, the GameObjects are created over the
+ * next frames and their bodies are added to the physics world. Cells beyond
+ * the unload radius, or the farthest ones when the memory budget is exceeded,
+ * are unloaded: their objects are removed from the physics world and the BVH,
+ * and their asset references are dropped.
+ *
+ * The descriptors of the map stay in memory, they are small compared to
+ * the objects, bodies and assets created from them.
+ */
+class WorldPartition final
+{
+public:
+    using modelOpener_t = std::function<std::shared_ptr<Model>(const std::string&)>;
+    using textureOpener_t = std::function<std::shared_ptr<Texture>(const std::string&)>;
+
+    struct Config
+    {
+        float cellSize = WORLD_CELL_SIZE;
+        float loadRadius = WORLD_LOAD_RADIUS;
+        float unloadRadius = WORLD_UNLOAD_RADIUS;
+        size_t memoryBudget = WORLD_MEMORY_BUDGET;
+    };
+
+    // Building the collision shapes of the cells, summed over the loaded cells
+    struct ShapeStats
+    {
+        size_t cellCount{};
+        // CPU time, summed over the threads
+        double buildMs{};
+        // Objects with a mesh shape
+        size_t meshRefs{};
+        // The meshes that had to be built, the rest were shared with a resident cell
+        size_t builtMeshes{};
+    };
+
+private:
+    using clock_t = std::chrono::steady_clock;
+    using shapeList_t = std::vector<std::shared_ptr<btCollisionShape>>;
+
+    // The result of `buildCellShapes()`
+    struct CellShapes
+    {
+        // The collision shape of each object
+        shapeList_t shapes;
+        double buildMs{};
+        size_t meshRefs{};
+        size_t builtMeshes{};
+    };
+
+    enum class CellState
+    {
+        Unloaded,
+        Loading, // The collision shapes are being built on the pool
+        Creating, // The objects are being created
+        Loaded,
+        Failed, // A collision mesh failed to load, the cell is not loaded again
+    };
+
+    struct Cell
+    {
+        int x{};
+        int z{};
+        // Indices of the descriptors in the map
+        std::vector<uint32_t> objectIs;
+        CellState state{CellState::Unloaded};
+
+        clock_t::time_point loadStart;
+        // The collision shape of each object, built on the pool
+        std::future<CellShapes> pendingShapes;
+        shapeList_t shapes;
+        // The assets of each object, opened when the loading started
+        std::vector<std::pair<std::shared_ptr<Model>, std::shared_ptr<Texture>>> assets;
+        // The distinct assets of the cell, keys of `m_assetUses`
+        std::vector<const void*> assetKeys;
+        std::vector<std::unique_ptr<GameObject>> objects;
+
+        // The estimated bytes reserved for the cell in the budget while it is loading
+        size_t reservedBytes{};
+        // The objects, their bodies and their collision shapes
+        size_t ownBytes{};
+        // Everything used by the cell including its assets, measured when it was unloaded.
+        // 0 if it was never loaded.
+        size_t measuredBytes{};
+    };
+
+    // A model or texture used by the resident cells
+    struct AssetUse
+    {
+        // One of them is set
+        std::shared_ptr<Model> model;
+        std::shared_ptr<Texture> texture;
+        size_t cellCount{};
+        // 0 until the asset finished loading
+        size_t bytes{};
+        bool isSized{};
+    };
+
+    std::unique_ptr<GameMap> m_map;
+    Config m_config;
+    ThreadPool* m_pool;
+    PhysicsWorld* m_physics;
+    DynamicBvh* m_bvh;
+    modelOpener_t m_openModel;
+    textureOpener_t m_openTexture;
+
+    std::vector<Cell> m_cells;
+    // Indices of the cells in the `Creating` state, in the order they finished loading
+    std::vector<size_t> m_creatingCellIs;
+
+    std::unordered_map<const void*, AssetUse> m_assetUses;
+    // Keys of the assets in `m_assetUses` whose size is not known yet
+    std::vector<const void*> m_unsizedAssetKeys;
+
+    // The collision meshes used by the cells, built once while any cell uses them.
+    // Accessed by the loader tasks.
+    std::mutex m_meshShapesMutex;
+    std::unordered_map<std::string, std::weak_ptr<btCollisionShape>> m_meshShapes;
+
+    ShapeStats m_shapeStats;
+
+    size_t m_cellBytes{}; // Sum of `Cell::ownBytes` of the resident cells
+    size_t m_assetBytes{}; // Sum of `AssetUse::bytes`
+    size_t m_loadingBytes{}; // Sum of `Cell::reservedBytes` of the loading cells
+    size_t m_objectCount{};
+    size_t m_residentCellCount{}; // Creating or loaded
+    size_t m_loadingCellCount{};
+
+    float getCellDistance(const Cell& cell, const glm::vec3& pos) const;
+    // The bytes the cell is expected to use when loaded
+    size_t estimateCellBytes(const Cell& cell) const;
+
+    void addAssetUse(const void* key, std::shared_ptr<Model> model, std::shared_ptr<Texture> texture);
+    void releaseAssetUse(const void* key);
+    // Stores the sizes of the assets that finished loading
+    void updateAssetSizes();
+    void releaseCellAssets(Cell* cell);
+
+    // Opens the assets of the cell and starts building its collision shapes on the pool
+    void startLoadingCell(size_t cellI);
+    // Builds the collision shapes of the cell, called on the pool
+    CellShapes buildCellShapes(size_t cellI);
+    // Moves the cells whose shapes are ready to the `Creating` state, or unloads them if they are too far
+    void pollLoadingCells(const glm::vec3& viewerPos);
+    // Creates at most `maxObjects` objects of the cells in the `Creating` state
+    void createObjects(size_t maxObjects);
+    void unloadCell(Cell* cell);
+
+public:
+    /*
+     * Sorts the objects of the map into cells. No cell is loaded until `update()`.
+     *
+     * pool: The threads the collision shapes are built on
+     * physics: The world the bodies of the objects are added to
+     * bvh: The culling BVH the objects are removed from when unloaded
+     * openModel, openTexture: Called to get the assets of an object, should load asynchronously
+     */
+    WorldPartition(
+            std::unique_ptr<GameMap> map,
+            const Config& config,
+            ThreadPool* pool,
+            PhysicsWorld* physics,
+            DynamicBvh* bvh,
+            modelOpener_t openModel,
+            textureOpener_t openTexture);
+
+    // Copy ctor, copy assignment op
+    WorldPartition(const WorldPartition&) = delete;
+    WorldPartition& operator=(const WorldPartition&) = delete;
+    // Move ctor, move assignment op
+    WorldPartition(WorldPartition&&) = delete;
+    WorldPartition& operator=(WorldPartition&&) = delete;
+
+    // Waits for the loading cells and unloads everything
+    ~WorldPartition();
+
+    /*
+     * Loads and unloads cells around the viewer. Call it once per frame on the render thread.
+     */
+    void update(const glm::vec3& viewerPos);
+
+    /*
+     * Blocks until the loading cells are loaded and creates all of their objects,
+     * e.g. to have the cells around the viewer ready before the first frame.
+     */
+    void waitForLoadingCells(const glm::vec3& viewerPos);
+
+    // Calls `func(GameObject*)` for every object of the resident cells
+    template <typename F>
+    void forEachObject(F&& func)
+    {
+        for (const Cell& cell : m_cells)
+        {
+            for (const auto& object : cell.objects)
+                func(object.get());
+        }
+    }
+
+    inline const GameMap& getMap() const { return *m_map; }
+    inline size_t getCellCount() const { return m_cells.size(); }
+    inline size_t getResidentCellCount() const { return m_residentCellCount; }
+    inline size_t getLoadingCellCount() const { return m_loadingCellCount; }
+    inline size_t getObjectCount() const { return m_objectCount; }
+    inline const ShapeStats& getShapeStats() const { return m_shapeStats; }
+    // The memory used by the resident cells and their assets, loading assets are not counted yet
+    inline size_t getResidentBytes() const { return m_cellBytes+m_assetBytes; }
+    inline size_t getMemoryBudget() const { return m_config.memoryBudget; }
+};
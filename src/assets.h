@@ -3,4 +3,9 @@
 #define ASSET_DIR_MODELS "../models"
 #define ASSET_DIR_COLL_MESHES ASSET_DIR_MODELS
 #define ASSET_DIR_TEXTURES "../textures"
+#define ASSET_DIR_MAPS "../maps"
+#define ASSET_DIR_SHADERS "../shaders"
+#define ASSET_DIR_CACHE "../cache"
+#define ASSET_DIR_MESH_CACHE ASSET_DIR_CACHE "/meshes"
+#define ASSET_DIR_SHADER_CACHE ASSET_DIR_CACHE "/shaders"
 #define TEXTURE_FILENAME_PLACEHOLDER "placeholder.png"
@@ -0,0 +1,313 @@
+#include "dds.h"
+#include "Logger.h"
+#include <fstream>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cassert>
+
+namespace DDS
+{
+
+static constexpr char fileMagic[4] = {'D', 'D', 'S', ' '};
+// Larger than any GPU supports, keeps the level sizes from overflowing
+static constexpr uint32_t maxDimPx = 65536;
+
+static constexpr uint32_t DDSD_CAPS         = 0x1;
+static constexpr uint32_t DDSD_HEIGHT       = 0x2;
+static constexpr uint32_t DDSD_WIDTH        = 0x4;
+static constexpr uint32_t DDSD_PIXELFORMAT  = 0x1000;
+static constexpr uint32_t DDSD_MIPMAPCOUNT  = 0x20000;
+static constexpr uint32_t DDSD_LINEARSIZE   = 0x80000;
+static constexpr uint32_t DDPF_FOURCC       = 0x4;
+static constexpr uint32_t DDSCAPS_COMPLEX   = 0x8;
+static constexpr uint32_t DDSCAPS_TEXTURE   = 0x1000;
+static constexpr uint32_t DDSCAPS_MIPMAP    = 0x400000;
+
+static constexpr uint32_t DXGI_FORMAT_BC1_UNORM      = 71;
+static constexpr uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+static constexpr uint32_t DXGI_FORMAT_BC3_UNORM      = 77;
+static constexpr uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+static constexpr uint32_t DXGI_FORMAT_BC7_UNORM      = 98;
+static constexpr uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+static constexpr uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+static constexpr uint32_t makeFourCC(const char (&str)[5])
+{
+    return uint32_t(str[0]) | uint32_t(str[1]) << 8 | uint32_t(str[2]) << 16 | uint32_t(str[3]) << 24;
+}
+
+// Stored in `Header::reserved1[bottomUpMarkIndex]` of the bottom-up files.
+// Other tools use the reserved fields too, e.g. NVTT writes its name to the 10th.
+static constexpr size_t bottomUpMarkIndex = 8;
+static constexpr uint32_t bottomUpMark = makeFourCC("BTUP");
+
+#pragma pack(push, 1)
+struct PixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct Header
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    PixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct HeaderDx10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == 124);
+static_assert(sizeof(HeaderDx10) == 20);
+
+static size_t getLevelSize(Format format, int widthPx, int heightPx)
+{
+    const size_t blocksX = std::max(1, (widthPx+blockDimPx-1)/blockDimPx);
+    const size_t blocksY = std::max(1, (heightPx+blockDimPx-1)/blockDimPx);
+    return blocksX*blocksY*getBlockSize(format);
+}
+
+std::string getBakedPath(const std::string& sourcePath)
+{
+    return sourcePath+".dds";
+}
+
+bool canFlipLevel(Format format, int heightPx)
+{
+    return format != Format::BC7 && (heightPx <= blockDimPx || heightPx%blockDimPx == 0);
+}
+
+// Reverses the first `rowCount` rows of the indices of a BC1 block or the color half of a BC3 block
+static void flipColorBlockRows(unsigned char* block, int rowCount)
+{
+    // The 2 colors, then a byte of 2-bit indices per row
+    std::reverse(block+4, block+4+rowCount);
+}
+
+// Reverses the first `rowCount` rows of the indices of the alpha half of a BC3 block
+static void flipAlphaBlockRows(unsigned char* block, int rowCount)
+{
+    // The 2 alpha values, then 48 bits of 3-bit indices, 12 bits per row
+    uint64_t indices{};
+    for (int i{}; i < 6; ++i)
+        indices |= uint64_t(block[2+i]) << (i*8);
+
+    uint64_t flipped = indices;
+    for (int row{}; row < rowCount; ++row)
+    {
+        const int dstRow = rowCount-1-row;
+        flipped &= ~(uint64_t(0xfff) << (dstRow*12));
+        flipped |= ((indices >> (row*12)) & 0xfff) << (dstRow*12);
+    }
+
+    for (int i{}; i < 6; ++i)
+        block[2+i] = flipped >> (i*8);
+}
+
+void flipLevel(Format format, int widthPx, int heightPx, unsigned char* blocks)
+{
+    assert(canFlipLevel(format, heightPx));
+
+    const size_t blocksX = std::max(1, (widthPx+blockDimPx-1)/blockDimPx);
+    const size_t blocksY = std::max(1, (heightPx+blockDimPx-1)/blockDimPx);
+    const size_t blockSize = getBlockSize(format);
+    const size_t rowSize = blocksX*blockSize;
+
+    for (size_t y{}; y < blocksY/2; ++y)
+        std::swap_ranges(blocks+y*rowSize, blocks+(y+1)*rowSize, blocks+(blocksY-1-y)*rowSize);
+
+    // In a level lower than a block, the rows below it are padding and stay in place
+    const int rowsInBlock = std::min(heightPx, blockDimPx);
+    for (size_t i{}; i < blocksX*blocksY; ++i)
+    {
+        unsigned char* block = blocks+i*blockSize;
+        if (format == Format::BC1)
+        {
+            flipColorBlockRows(block, rowsInBlock);
+        }
+        else
+        {
+            flipAlphaBlockRows(block, rowsInBlock);
+            flipColorBlockRows(block+8, rowsInBlock);
+        }
+    }
+}
+
+int parse(std::string_view file, Image* output)
+{
+    if (file.size() < sizeof(fileMagic)+sizeof(Header) || memcmp(file.data(), fileMagic, sizeof(fileMagic)) != 0)
+    {
+        Logger::err << "Not a DDS file" << Logger::End;
+        return 1;
+    }
+
+    Header header;
+    memcpy(&header, file.data()+sizeof(fileMagic), sizeof(Header));
+    size_t dataOffset = sizeof(fileMagic)+sizeof(Header);
+    if (header.size != sizeof(Header) || !(header.pixelFormat.flags & DDPF_FOURCC))
+    {
+        Logger::err << "DDS file is not block compressed" << Logger::End;
+        return 1;
+    }
+
+    if (header.pixelFormat.fourCC == makeFourCC("DXT1"))
+    {
+        output->format = Format::BC1;
+    }
+    else if (header.pixelFormat.fourCC == makeFourCC("DXT5"))
+    {
+        output->format = Format::BC3;
+    }
+    else if (header.pixelFormat.fourCC == makeFourCC("DX10"))
+    {
+        if (file.size() < dataOffset+sizeof(HeaderDx10))
+        {
+            Logger::err << "DDS file is truncated" << Logger::End;
+            return 1;
+        }
+        HeaderDx10 headerDx10;
+        memcpy(&headerDx10, file.data()+dataOffset, sizeof(HeaderDx10));
+        dataOffset += sizeof(HeaderDx10);
+
+        if (headerDx10.resourceDimension != D3D10_RESOURCE_DIMENSION_TEXTURE2D || headerDx10.arraySize > 1)
+        {
+            Logger::err << "DDS file is not a 2D texture" << Logger::End;
+            return 1;
+        }
+        switch (headerDx10.dxgiFormat)
+        {
+        case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB: output->format = Format::BC1; break;
+        case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB: output->format = Format::BC3; break;
+        case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB: output->format = Format::BC7; break;
+        default:
+            Logger::err << "Unsupported DXGI format in DDS file: " << headerDx10.dxgiFormat << Logger::End;
+            return 1;
+        }
+    }
+    else
+    {
+        Logger::err << "Unsupported DDS format: " << std::string_view{(const char*)&header.pixelFormat.fourCC, 4} << Logger::End;
+        return 1;
+    }
+
+    if (header.width == 0 || header.height == 0)
+    {
+        Logger::err << "DDS file has no pixels" << Logger::End;
+        return 1;
+    }
+    if (header.width > maxDimPx || header.height > maxDimPx)
+    {
+        Logger::err << "DDS file is too large: " << header.width << 'x' << header.height << Logger::End;
+        return 1;
+    }
+    output->widthPx = header.width;
+    output->heightPx = header.height;
+    output->data = (const unsigned char*)file.data()+dataOffset;
+    output->isBottomUp = header.reserved1[bottomUpMarkIndex] == bottomUpMark;
+
+    const uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+    // The full chain ends at 1x1, GL can't use levels after it
+    const uint32_t maxLevelCount = std::bit_width(std::max(header.width, header.height));
+    if (levelCount > maxLevelCount)
+    {
+        Logger::err << "DDS file has " << levelCount << " mip levels, a " << header.width << 'x' << header.height
+            << " image has at most " << maxLevelCount << Logger::End;
+        return 1;
+    }
+    output->levels.clear();
+    size_t totalSize{};
+    for (uint32_t i{}, w = header.width, h = header.height; i < levelCount; ++i, w = std::max(1u, w/2), h = std::max(1u, h/2))
+    {
+        const size_t size = getLevelSize(output->format, w, h);
+        output->levels.push_back({(int)w, (int)h, totalSize, size});
+        totalSize += size;
+    }
+
+    if (file.size() < dataOffset+totalSize)
+    {
+        Logger::err << "DDS file is truncated" << Logger::End;
+        return 1;
+    }
+    return 0;
+}
+
+int write(const std::string& path, Format format, int widthPx, int heightPx,
+        const std::vector<std::vector<unsigned char>>& levels)
+{
+    assert(!levels.empty());
+    assert(levels[0].size() == getLevelSize(format, widthPx, heightPx));
+
+    Header header{};
+    header.size = sizeof(Header);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = heightPx;
+    header.width = widthPx;
+    header.pitchOrLinearSize = levels[0].size();
+    header.mipMapCount = levels.size();
+    header.reserved1[bottomUpMarkIndex] = bottomUpMark;
+    header.pixelFormat.size = sizeof(PixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.caps = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    HeaderDx10 headerDx10{};
+    switch (format)
+    {
+    case Format::BC1: header.pixelFormat.fourCC = makeFourCC("DXT1"); break;
+    case Format::BC3: header.pixelFormat.fourCC = makeFourCC("DXT5"); break;
+    case Format::BC7:
+        // Only expressible with the DX10 extension header
+        header.pixelFormat.fourCC = makeFourCC("DX10");
+        headerDx10.dxgiFormat = DXGI_FORMAT_BC7_UNORM;
+        headerDx10.resourceDimension = D3D10_RESOURCE_DIMENSION_TEXTURE2D;
+        headerDx10.arraySize = 1;
+        break;
+    }
+
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file)
+    {
+        Logger::err << "Failed to create DDS file: " << path << Logger::End;
+        return 1;
+    }
+    file.write(fileMagic, sizeof(fileMagic));
+    file.write((const char*)&header, sizeof(header));
+    if (format == Format::BC7)
+        file.write((const char*)&headerDx10, sizeof(headerDx10));
+    for (const auto& level : levels)
+        file.write((const char*)level.data(), level.size());
+
+    if (!file)
+    {
+        Logger::err << "Failed to write DDS file: " << path << Logger::End;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace DDS
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Reading and writing of block-compressed DirectDraw Surface files.
+ *
+ * The usual DDS files store the rows top-down. The files written by `write()`
+ * store them bottom-up, the way OpenGL expects them, so the blocks can be
+ * uploaded without flipping. These are marked in a reserved header field.
+ */
+namespace DDS
+{
+
+enum class Format
+{
+    BC1, // RGB, 1-bit alpha, 8 bytes per block
+    BC3, // RGBA, 16 bytes per block
+    BC7, // RGBA, high quality, 16 bytes per block
+};
+
+static constexpr int blockDimPx = 4;
+
+inline size_t getBlockSize(Format format)
+{
+    return format == Format::BC1 ? 8 : 16;
+}
+
+inline const char* formatToStr(Format format)
+{
+    switch (format)
+    {
+    case Format::BC1: return "BC1";
+    case Format::BC3: return "BC3";
+    case Format::BC7: return "BC7";
+    }
+    return "???";
+}
+
+struct Level
+{
+    int widthPx;
+    int heightPx;
+    size_t offset; // Offset of the blocks in `Image::data`
+    size_t size;
+};
+
+struct Image
+{
+    Format format{};
+    int widthPx{};
+    int heightPx{};
+    std::vector<Level> levels;
+    // Points into the parsed buffer
+    const unsigned char* data{};
+    // Written by `write()`, otherwise the rows are top-down
+    bool isBottomUp{};
+};
+
+/*
+ * Returns the path where `texbake` puts the compressed version of an image,
+ * the full source name with `.dds` appended, so `a.png` and `a.jpg` don't share it.
+ */
+std::string getBakedPath(const std::string& sourcePath);
+
+/*
+ * Parses the headers of a DDS file. The image data is not copied.
+ *
+ * Returns:
+ *      1 if failed,
+ *      0 otherwise
+ */
+int parse(std::string_view file, Image* output);
+
+/*
+ * Whether `flipLevel()` can flip a level exactly. The rows can only be moved
+ * inside the blocks, so taller levels must be made of whole blocks.
+ * BC7 blocks can't be flipped without decoding them.
+ */
+bool canFlipLevel(Format format, int heightPx);
+
+/*
+ * Flips the blocks of a mip level vertically in place.
+ * The level must pass `canFlipLevel()`.
+ */
+void flipLevel(Format format, int widthPx, int heightPx, unsigned char* blocks);
+
+/*
+ * Writes a DDS file, with the rows bottom-up.
+ *
+ * levels: The compressed blocks of each mip level, starting with the biggest
+ *
+ * Returns:
+ *      1 if failed,
+ *      0 otherwise
+ */
+int write(const std::string& path, Format format, int widthPx, int heightPx,
+        const std::vector<std::vector<unsigned char>>& levels);
+
+} // namespace DDS
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+namespace Hash
+{
+
+static constexpr uint64_t fnvOffsetBasis = 0xcbf29ce484222325ull;
+static constexpr uint64_t fnvPrime = 0x100000001b3ull;
+
+/*
+ * 64-bit FNV-1a hash. Pass the result of a previous call as `hash`
+ * to hash data in pieces.
+ */
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash=fnvOffsetBasis)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i{}; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= fnvPrime;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a64(std::string_view str, uint64_t hash=fnvOffsetBasis)
+{
+    return fnv1a64(str.data(), str.size(), hash);
+}
+
+} // namespace Hash
@@ -66,14 +66,14 @@ static int getSdlGlAttr(SDL_GLattr attr)
     return out;
 }
 
-int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOut)
+int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOut, bool isHidden/*=false*/)
 {
     if (SDL_Init(SDL_INIT_VIDEO))
     {
         Logger::err << "Failed to initialize SDL: " << SDL_GetError() << Logger::End;
         return 1;
     }
-    Logger::verb << "Initialized SDL" << Logger::End;
+    LOGGER_VERB << "Initialized SDL" << Logger::End;
 
     if (SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3)
      || SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3)
@@ -89,14 +89,16 @@ int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOu
             "OpenGL Engine",
             SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
             INITIAL_WIN_W, INITIAL_WIN_H,
-            SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | (WINDOW_FULLSCREEN_MODE ? WINDOW_FULLSCREEN_MODE : 0)
+            SDL_WINDOW_OPENGL | (isHidden
+                ? SDL_WINDOW_HIDDEN
+                : SDL_WINDOW_RESIZABLE | (WINDOW_FULLSCREEN_MODE ? WINDOW_FULLSCREEN_MODE : 0))
     );
     if (!*winOut)
     {
         Logger::err << "Failed to create window: " << SDL_GetError() << Logger::End;
         return 1;
     }
-    Logger::verb << "Created window" << Logger::End;
+    LOGGER_VERB << "Created window" << Logger::End;
 
     *contOut = SDL_GL_CreateContext(*winOut);
     if (!*contOut)
@@ -105,19 +107,24 @@ int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOu
         return 1;
     }
     *isVSyncActiveOut = false;
+    if (isHidden)
+    {
+        // Don't wait for a display that is not there
+        SDL_GL_SetSwapInterval(0);
+    }
 #if USE_VSYNC
-    if (SDL_GL_SetSwapInterval(1))
+    else if (SDL_GL_SetSwapInterval(1))
     {
         Logger::warn << "Failed to use V-Sync" << Logger::End;
         *isVSyncActiveOut = false;
     }
     else
     {
-        Logger::verb << "Using V-Sync" << Logger::End;
+        LOGGER_VERB << "Using V-Sync" << Logger::End;
         *isVSyncActiveOut = true;
     }
 #endif
-    Logger::verb << "Created and set up context" << Logger::End;
+    LOGGER_VERB << "Created and set up context" << Logger::End;
 
     {
         const int sampleCnt = getSdlGlAttr(SDL_GL_MULTISAMPLESAMPLES);
@@ -135,7 +142,7 @@ int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOu
         Logger::err << "Failed to initialize GLEW: " << glewGetErrorString(glewInitStatus) << Logger::End;
         return 1;
     }
-    Logger::verb << "Initialized GLEW" << Logger::End;
+    LOGGER_VERB << "Initialized GLEW" << Logger::End;
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
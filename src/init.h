@@ -5,6 +5,10 @@
 namespace Init
 {
 
-int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOut);
+/*
+ * Creates the window and the OpenGL context and initializes GLEW.
+ * isHidden: Render offscreen to a hidden window without V-Sync, for benchmarks
+ */
+int initVideo(SDL_Window** winOut, SDL_GLContext* contOut, bool* isVSyncActiveOut, bool isHidden=false);
 
 } // namespace Init
@@ -5,8 +5,11 @@
 #include <memory>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <cstdlib>
 #include "init.h"
 #include "Logger.h"
+#include "Trace.h"
 #include "ShaderProgram.h"
 #include "Camera.h"
 #include "GameObject.h"
@@ -19,11 +22,28 @@
 #include "ui/colors.h"
 #include "PhysicsWorld.h"
 #include "FileCache.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
+#include "RenderQueue.h"
+#include "DynamicBvh.h"
+#include "WorldPartition.h"
+#include "FileWatcher.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "dds.h"
 
 #define MOUSE_SENS 0.1f
 #define USE_VSYNC 1
 #define FOV_DEFAULT 45.0f
 #define FOV_ZOOM 10.0f
+// The unused models and textures are evicted above these
+#define MODEL_CACHE_MEMORY_BUDGET (256*1024*1024ull)
+#define TEXTURE_CACHE_MEMORY_BUDGET (512*1024*1024ull)
+#define MAP_PATH ASSET_DIR_MAPS "/test.json"
+// If this environment variable is set, the trace records are written to the file it names
+#define TRACE_FILE_ENV_VAR "ENGINE_TRACE_FILE"
+// Written when F4 is pressed
+#define PROFILER_TRACE_PATH "frame_profile.json"
 
 /*
 static UI::Window* createBuildMenuWin(std::shared_ptr<UI::OverlayRenderer> olrend, size_t modelCount)
@@ -62,19 +82,32 @@ static UI::Window* createBuildMenuWin(std::shared_ptr<UI::OverlayRenderer> olren
 }
 */
 
-int main()
+int main(int argc, char** argv)
 {
+    Benchmark::Options benchOptions;
+    if (Benchmark::parseArgs(argc, argv, &benchOptions))
+        return 1;
+    // Renders the scripted frames to a hidden window and exits
+    const bool isBenchmark = !benchOptions.mapPath.empty();
+    const std::string mapPath = isBenchmark ? benchOptions.mapPath : MAP_PATH;
+    Benchmark::CameraPath cameraPath;
+    if (!benchOptions.cameraPathPath.empty() && cameraPath.open(benchOptions.cameraPathPath))
+        return 1;
+
+    if (const char* tracePath = getenv(TRACE_FILE_ENV_VAR))
+        Trace::open(tracePath);
+
     SDL_Window* window;
     SDL_GLContext context;
     bool isVSyncActive;
-    if (Init::initVideo(&window, &context, &isVSyncActive))
+    if (Init::initVideo(&window, &context, &isVSyncActive, isBenchmark))
     {
         Logger::err << "Exiting with error" << Logger::End;
         return 1;
     }
 
     ShaderProgram shader;
-    if (shader.open("../shaders/basic.vert.glsl", "../shaders/basic.frag.glsl"))
+    if (shader.open(ASSET_DIR_SHADERS "/basic.vert.glsl", ASSET_DIR_SHADERS "/basic.frag.glsl"))
         return 1;
     shader.use();
 
@@ -82,14 +115,50 @@ int main()
     SDL_GetWindowSize(window, &winW, &winH);
     Camera camera{{0.0f, 10.0f, 0.0f}, (float)winW/winH};
     camera.setFovDeg(45.0f);
-    camera.updateShaderUniforms(shader.getId());
+    auto moveCameraOnPath{[&](float timeS){
+        const Benchmark::CameraPath::Keyframe keyframe = cameraPath.sample(timeS);
+        camera.setPosition(keyframe.pos);
+        camera.setYawDeg(keyframe.yawDeg);
+        camera.setPitchDeg(keyframe.pitchDeg);
+        camera.recalculateFrontVector();
+    }};
+    // Load the cells around the start of the path
+    if (!cameraPath.isEmpty())
+        moveCameraOnPath(0);
+    const auto modelMatUniform = shader.getUniform<glm::mat4>("modelMat");
+    const auto isTexUpsideDownUniform = shader.getUniform<int>("isTexUpsideDown");
+
+    // Draws the objects sharing a model and texture with one call
+    ShaderProgram instancedShader;
+    if (instancedShader.open(ASSET_DIR_SHADERS "/basic_instanced.vert.glsl", ASSET_DIR_SHADERS "/basic.frag.glsl"))
+        return 1;
+    const auto instancedIsTexUpsideDownUniform = instancedShader.getUniform<int>("isTexUpsideDown");
+    RenderQueue renderQueue;
+    // Contains the objects with a loaded model, for frustum culling
+    DynamicBvh objectBvh;
+    std::vector<GameObject*> visibleObjects;
+
+    // Decodes models and textures in the background
+    ThreadPool assetLoaderPool;
 
     static constexpr auto modelAssetDir = ASSET_DIR_MODELS;
     static constexpr auto modelPlaceholderFilename = std::string_view{};
-    FileCache<Model, modelAssetDir, modelPlaceholderFilename> modelCache;
+    FileCache<Model, modelAssetDir, modelPlaceholderFilename> modelCache{&assetLoaderPool, MODEL_CACHE_MEMORY_BUDGET};
     static constexpr auto textureAssetDir = ASSET_DIR_TEXTURES;
     static constexpr auto texturePlaceholderFilename = std::string_view{"placeholder.png"};
-    FileCache<Texture, textureAssetDir, texturePlaceholderFilename> textureCache;
+    FileCache<Texture, textureAssetDir, texturePlaceholderFilename> textureCache{&assetLoaderPool, TEXTURE_CACHE_MEMORY_BUDGET};
+    GameObject::setPlaceholderTexture(textureCache.getPlaceholder());
+    // Uploads the decoded textures over several frames, lowest resolution first
+    TextureStreamer textureStreamer;
+    textureCache.setUploader([&textureStreamer](std::shared_ptr<Texture> texture){
+            return textureStreamer.enqueue(std::move(texture)); });
+
+    // Memory, hits/misses/evictions
+    auto getCacheInfo{[](const auto& cache){
+        return std::to_string(cache.getResidentBytes()/1024/1024) + "MiB "
+            + std::to_string(cache.getStats().hits) + '/' + std::to_string(cache.getStats().misses)
+            + '/' + std::to_string(cache.getStats().evictions);
+    }};
 
     auto overlayRenderer = std::make_shared<UI::OverlayRenderer>();
     if (overlayRenderer->construct("../assets/crosshair.obj"))
@@ -98,33 +167,92 @@ int main()
 
     PhysicsWorld pworld;
 
-    std::vector<std::unique_ptr<GameObject>> gameObjects;
     {
-        GameMap map{"../maps/test.json"};
-        // Note: `objdescr->collShape` will be cleared here
-        for (const auto& objdescr : map.getObjects())
-        {
-            std::shared_ptr<Model> model = modelCache.open(objdescr->modelName);
-            std::shared_ptr<Texture> texture = textureCache.open(objdescr->textureName);
-
-            const glm::vec3 mRotRad = {
-                glm::radians(objdescr->modelRotDeg.x),
-                glm::radians(objdescr->modelRotDeg.y),
-                glm::radians(objdescr->modelRotDeg.z)};
-
-            gameObjects.push_back(std::unique_ptr<GameObject>{new GameObject{
-                    model, mRotRad, texture, std::move(objdescr->collShape), objdescr->mass, objdescr->objName, objdescr->flags}});
-            gameObjects.back()->setPos(objdescr->pos);
-            gameObjects.back()->scale(objdescr->scale);
-            pworld.addObject(gameObjects.back().get());
-        }
+        // Every program is built by now, the later ones only on hot-reload
+        const ShaderProgram::BuildStats& stats = ShaderProgram::getBuildStats();
+        Logger::log << "Built " << stats.cachedCount+stats.compiledCount << " shader programs in "
+            << stats.totalMs << "ms (" << stats.cachedCount << " from the binary cache, "
+            << stats.compiledCount << " compiled)" << Logger::End;
+    }
+
+    const uint32_t assetLoadStart = SDL_GetTicks();
+    // Reads the objects on the loader threads, they are created by the partition around the camera
+    std::unique_ptr<GameMap> map;
+    try
+    {
+        map = std::make_unique<GameMap>(mapPath, &assetLoaderPool);
+    }
+    catch (const std::runtime_error& e)
+    {
+        Logger::err << "Failed to load the map: " << e.what() << Logger::End;
+        return 1;
+    }
+    {
+        const GameMap::LoadTimings& timings = map->getTimings();
+        Logger::log << "Map loading stages:"
+            << "\n\tRead file:           " << timings.readMs << "ms"
+            << "\n\tParse:               " << timings.parseMs << "ms"
+            << "\n\tCreate descriptors:  " << timings.objectsMs << "ms (" << assetLoaderPool.getThreadCount() << " threads)"
+            << Logger::End;
+    }
+    // Also used to replace the partition when the map file changes
+    auto createPartition{[&](std::unique_ptr<GameMap> map){
+        auto partition = std::make_unique<WorldPartition>(std::move(map), WorldPartition::Config{},
+                &assetLoaderPool, &pworld, &objectBvh,
+                [&modelCache](const std::string& name){ return modelCache.openAsync(name); },
+                [&textureCache](const std::string& name){ return textureCache.openAsync(name); });
+        // Have the cells around the camera ready for the first frame
+        const uint32_t cellLoadStart = SDL_GetTicks();
+        partition->update(camera.getPosition());
+        partition->waitForLoadingCells(camera.getPosition());
+        const WorldPartition::ShapeStats& shapeStats = partition->getShapeStats();
+        Logger::log << "Loaded " << partition->getResidentCellCount() << " cells with "
+            << partition->getObjectCount() << " objects around the camera in "
+            << SDL_GetTicks()-cellLoadStart << "ms"
+            << "\n\tCollision shapes:    " << shapeStats.buildMs << "ms CPU time (" << assetLoaderPool.getThreadCount() << " threads)"
+            << "\n\tCollision meshes:    " << shapeStats.builtMeshes << " built for " << shapeStats.meshRefs << " objects"
+            << Logger::End;
+        return partition;
+    }};
+    std::unique_ptr<WorldPartition> worldPartition = createPartition(std::move(map));
+
+    // The benchmark frames advance the simulated time by a fixed step, whatever they take
+    const auto benchStep = std::chrono::duration_cast<PhysicsWorld::clock_t::duration>(
+            std::chrono::duration<double>{PHYS_FIXED_TIMESTEP});
+    const PhysicsWorld::clock_t::time_point benchStartTime = PhysicsWorld::clock_t::now();
+    uint32_t benchFrameI{};
+    int64_t benchStreamWaitNs{};
+    Benchmark::Recorder benchRecorder;
+    Benchmark::Recorder::RunInfo benchInfo;
+    if (isBenchmark)
+    {
+        benchInfo.mapPath = mapPath;
+        benchInfo.cameraPathPath = benchOptions.cameraPathPath;
+        benchInfo.renderer = (const char*)glGetString(GL_RENDERER);
+        benchInfo.timestepS = PHYS_FIXED_TIMESTEP;
+        benchRecorder.reserve(benchOptions.frameCount);
+        pworld.startManual(benchStartTime);
+        Logger::log << "Benchmarking " << benchOptions.frameCount << " frames of " << mapPath
+            << " on " << benchInfo.renderer << Logger::End;
+    }
+    else
+    {
+        pworld.start();
     }
 
+    // Reloads the assets edited while the engine runs, not while benchmarking
+    std::unique_ptr<FileWatcher> assetWatcher;
+    if (!isBenchmark)
+        assetWatcher.reset(new FileWatcher{{ASSET_DIR_SHADERS, ASSET_DIR_TEXTURES, ASSET_DIR_MODELS, ASSET_DIR_MAPS}});
+    // The new version of the map, read on a loader thread
+    std::future<std::unique_ptr<GameMap>> pendingMap;
+
     bool isDbgMenuOpen = false;
     bool isWireframeMode = false;
     bool isBlendingOn = true;
     bool isFaceCullingOn = true;
     bool isMultisamplingOn = true;
+    bool isInstancingOn = true;
     struct DbgMenuItem
     {
         std::string name;
@@ -159,6 +287,11 @@ int main()
         }, [&](){
             return isMultisamplingOn;
         }},
+        {"Instanced rendering", [&](){
+            isInstancingOn = !isInstancingOn;
+        }, [&](){
+            return isInstancingOn;
+        }},
         {"Bullet: Wireframe mode", [&](){
             pworld.setDbgMode(pworld.getDbgMode() ^ btIDebugDraw::DBG_DrawWireframe);
         }, [&](){
@@ -174,10 +307,21 @@ int main()
         }, [&](){
             return pworld.getDbgMode() & btIDebugDraw::DBG_NoDeactivation;
         }},
+        {"Bullet: Draw contact points", [&](){
+            pworld.setDbgMode(pworld.getDbgMode() ^ btIDebugDraw::DBG_DrawContactPoints);
+        }, [&](){
+            return pworld.getDbgMode() & btIDebugDraw::DBG_DrawContactPoints;
+        }},
     };
     constexpr int DBG_MENU_ITEM_COUNT = sizeof(dbgMenuItems)/sizeof(dbgMenuItems[0]);
     static_assert(DBG_MENU_ITEM_COUNT <= 9); // Only implemented for number keys (0 excluded)
 
+    bool areAssetsLoaded = false;
+
+    // F3 shows the breakdown, F4 exports the recent frames
+    Profiler profiler;
+    bool isProfilerShown = false;
+
     uint32_t lastTime{};
     uint32_t deltaTime{};
     SDL_ShowCursor(false);
@@ -188,6 +332,9 @@ int main()
     glm::vec<2, int> prevCursorPos{};
     while (!shouldQuit)
     {
+        profiler.beginFrame();
+        const uint32_t eventsZone = profiler.beginZone("Events", false);
+
         uint32_t currentTime = SDL_GetTicks();
         deltaTime = currentTime - lastTime;
         lastTime = currentTime;
@@ -204,7 +351,7 @@ int main()
             switch (event.type)
             {
             case SDL_QUIT:
-                Logger::verb << "Window close event" << Logger::End;
+                LOGGER_VERB << "Window close event" << Logger::End;
                 shouldQuit = true;
                 break;
 
@@ -230,6 +377,14 @@ int main()
                     isDbgMenuOpen = !isDbgMenuOpen;
                     break;
 
+                case SDLK_F3:
+                    isProfilerShown = !isProfilerShown;
+                    break;
+
+                case SDLK_F4:
+                    profiler.exportChromeTrace(PROFILER_TRACE_PATH);
+                    break;
+
                 case SDLK_e:
                     isBuildMenuShown = !isBuildMenuShown;
                     SDL_ShowCursor(isBuildMenuShown || isPaused);
@@ -263,6 +418,7 @@ int main()
                     const btVector3 fromVec = camera.getPositionBt();
                     const btVector3 toVec = camera.getFrontPosBt(RAY_LEN);
                     btCollisionWorld::ClosestRayResultCallback cb{fromVec, toVec};
+                    auto worldLock = pworld.lockWorld();
                     pworld.getWorld()->rayTest(fromVec, toVec, cb);
                     if (cb.hasHit())
                     {
@@ -297,8 +453,13 @@ int main()
         int windowW, windowH;
         SDL_GetWindowSize(window, &windowW, &windowH);
 
-        // Cursor movement handling
-        if (!isPaused && !isBuildMenuShown)
+        // The benchmark follows the camera path, otherwise the cursor movement is handled
+        if (isBenchmark)
+        {
+            if (!cameraPath.isEmpty())
+                moveCameraOnPath(benchFrameI*PHYS_FIXED_TIMESTEP);
+        }
+        else if (!isPaused && !isBuildMenuShown)
         {
             const int windowCenterX = windowW / 2;
             const int windowCenterY = windowH / 2;
@@ -313,6 +474,7 @@ int main()
         }
 
         // Keypress handling
+        if (!isBenchmark)
         {
             constexpr float cameraSpeed = 0.01f;
             auto keyboardState = SDL_GetKeyboardState(nullptr);
@@ -338,9 +500,150 @@ int main()
                 camera.setFovDeg(camera.getFovDeg()+5.0f);
         }
 
+        profiler.endZone(eventsZone);
+
+        const uint32_t streamingZone = profiler.beginZone("Streaming", true);
+        // Hot-reload the changed assets
+        for (const FileWatcher::Change& change : (assetWatcher ? assetWatcher->pollChanges() : std::vector<FileWatcher::Change>{}))
+        {
+            LOGGER_VERB << "File changed: " << change.root << '/' << change.path << Logger::End;
+            if (change.root == ASSET_DIR_SHADERS)
+            {
+                ShaderProgram::reloadFile(change.root+'/'+change.path);
+            }
+            else if (change.root == ASSET_DIR_TEXTURES)
+            {
+                // Either the source image or the version baked by `texbake`, `<source>.dds`
+                textureCache.reloadAsync([&](const std::string& name){
+                        return name == change.path || DDS::getBakedPath(name) == change.path; });
+            }
+            else if (change.root == ASSET_DIR_MODELS)
+            {
+                modelCache.reloadAsync([&](const std::string& name){ return name == change.path; });
+            }
+            else if (change.root == ASSET_DIR_MAPS
+                  && std::filesystem::path{change.path}.stem() == std::filesystem::path{mapPath}.stem())
+            {
+                Logger::log << "Map changed, reloading" << Logger::End;
+                // No pool for the map, the task would wait for the other tasks of the pool
+                pendingMap = assetLoaderPool.submit([mapPath](){
+                    try
+                    {
+                        return std::make_unique<GameMap>(mapPath);
+                    }
+                    catch (const std::runtime_error& e)
+                    {
+                        Logger::err << "Failed to reload the map: " << e.what() << Logger::End;
+                        return std::unique_ptr<GameMap>{};
+                    }
+                });
+            }
+        }
+        if (pendingMap.valid() && pendingMap.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+        {
+            if (std::unique_ptr<GameMap> newMap = pendingMap.get())
+            {
+                // The old objects leave the physics world and the BVH before the new ones are created
+                worldPartition.reset();
+                worldPartition = createPartition(std::move(newMap));
+            }
+            else
+            {
+                Logger::warn << "Keeping the previous version of the map" << Logger::End;
+            }
+        }
+
+        // Load and unload the cells around the camera
+        worldPartition->update(camera.getPosition());
+        int64_t frameStreamWaitNs{};
+        if (isBenchmark)
+        {
+            // Draw the same scene on every run, the wait is not counted in the frame time
+            const auto waitStart = PhysicsWorld::clock_t::now();
+            worldPartition->waitForLoadingCells(camera.getPosition());
+            modelCache.waitForPendingUploads();
+            textureCache.waitForPendingUploads();
+            frameStreamWaitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    PhysicsWorld::clock_t::now()-waitStart).count();
+        }
+
+        // Finish loading the assets decoded by the loader threads, the streamed cells keep queueing new ones
+        {
+            const size_t pendingCount = modelCache.finishPendingUploads()+textureCache.finishPendingUploads();
+            if (!areAssetsLoaded && pendingCount == 0)
+            {
+                areAssetsLoaded = true;
+                Logger::log << "Loaded the initial assets in " << SDL_GetTicks()-assetLoadStart << "ms using "
+                    << assetLoaderPool.getThreadCount() << " threads" << Logger::End;
+            }
+        }
+        textureStreamer.update();
+        profiler.endZone(streamingZone);
+
+        // The physics thread steps on its own, take the latest interpolated state
+        const uint32_t physicsZone = profiler.beginZone("Physics", false);
+        uint32_t benchPhysSteps{};
+        if (isBenchmark)
+        {
+            // No thread, one step per frame
+            const PhysicsWorld::clock_t::time_point simTime = benchStartTime+(benchFrameI+1)*benchStep;
+            benchPhysSteps = pworld.stepTo(simTime);
+            pworld.applyTransforms(simTime);
+        }
+        else
+        {
+            pworld.applyTransforms();
+        }
+        profiler.endZone(physicsZone);
+
+        const uint32_t transformZone = profiler.beginZone("Transform sync", false);
+        camera.uploadMatrices(); // Shared by every program
+        const size_t updatedMatrices = GameObject::updateTransforms();
+        profiler.endZone(transformZone);
+
+        const uint32_t sceneZone = profiler.beginZone("Scene draw", true);
         glClearColor(0.34f, 0.406f, 0.642f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        pworld.drawDebug();
 
+        // Cull the objects outside the view
+        {
+            Profiler::Zone zone{&profiler, "Culling"};
+            worldPartition->forEachObject([&](GameObject* object){ object->updateBvhProxy(&objectBvh); });
+            visibleObjects.clear();
+            objectBvh.queryFrustum(camera.getFrustum(), [&](void* userData){
+                    visibleObjects.push_back((GameObject*)userData); });
+        }
+
+        size_t drawnVertices{};
+        size_t drawnObjects{};
+        size_t drawCalls{};
+        if (isInstancingOn)
+        {
+            instancedShader.use();
+            for (GameObject* object : visibleObjects)
+            {
+                const size_t objVerts = object->enqueueDraw(&renderQueue, &instancedShader, instancedIsTexUpsideDownUniform);
+                drawnVertices += objVerts;
+                drawnObjects += (objVerts != 0);
+            }
+            renderQueue.flush();
+            drawCalls = renderQueue.getDrawCallsLastFlush();
+        }
+        else
+        {
+            shader.use();
+            for (GameObject* object : visibleObjects)
+            {
+                const size_t objVerts = object->draw(&shader, modelMatUniform, isTexUpsideDownUniform);
+                drawnVertices += objVerts;
+                drawnObjects += (objVerts != 0);
+            }
+            drawCalls = drawnObjects;
+        }
+        profiler.endZone(sceneZone);
+
+        const uint32_t overlayZone = profiler.beginZone("Overlay commit", true);
         if (isDbgMenuOpen)
         {
             std::string str = "Debug options:";
@@ -348,19 +651,11 @@ int main()
                 str += std::string("\n")+char('1'+i)+": "+dbgMenuItems[i].name+(dbgMenuItems[i].isOn() ? ": ON" : ": OFF");
             overlayRenderer->renderTextAtPerc(str, 1.0f, {1.f, 53.f}, {1.0f, 1.0f, 0.0f});
         }
-
-        // Update physics
-        pworld.updateDbgDrawUniforms(camera); // TODO: Refactor debug drawing
-        const uint32_t phyStepStart = SDL_GetTicks();
-        pworld.stepSimulation(1/60.0f);
-        const uint32_t phyStepDur = SDL_GetTicks()-phyStepStart;
-        pworld.applyTransforms(gameObjects);
-
-        size_t drawnVertices{};
-        shader.use();
-        camera.updateShaderUniforms(shader.getId());
-        for (size_t i{}; i < gameObjects.size(); ++i)
-            drawnVertices += gameObjects[i]->draw(shader.getId());
+        if (isProfilerShown)
+        {
+            overlayRenderer->renderTextAtPx(profiler.formatBreakdown(), 1.0f,
+                    {DEF_FONT_SIZE, windowH-DEF_FONT_SIZE*2}, {0.6f, 1.0f, 0.6f});
+        }
 
         /*
         if (isBuildMenuShown)
@@ -387,22 +682,80 @@ int main()
 
         const std::string renderInfoText
             = "Frame time:   " + std::to_string(deltaTime) + "ms"
-            + "\nPhysics time: " + std::to_string(phyStepDur) + "ms"
+            + "\nPhys update:  " + std::to_string(pworld.getLastUpdateDurUs()) + "us"
+            + "\nPhys steps:   " + std::to_string(pworld.getLastSubstepCount())
+            + "\nPhys moved:   " + std::to_string(pworld.getLastMovedCount())
+            + "\nMatrices upd: " + std::to_string(updatedMatrices)
             + "\nFPS:          " + std::to_string(int(1/(deltaTime/1000.0)))
-            + "\nObjs drawn:   " + std::to_string(gameObjects.size())
-            + "\nVerts drawn:  " + std::to_string(drawnVertices);
+            + "\nObjs drawn:   " + std::to_string(drawnObjects)
+            // Of the objects in the BVH, those with a model that is still loading are not counted
+            + "\nObjs culled:  " + std::to_string(objectBvh.getProxyCount()-visibleObjects.size())
+            + "\nVerts drawn:  " + std::to_string(drawnVertices)
+            + "\nDraw calls:   " + std::to_string(drawCalls)
+            + "\nDbg lines:    " + std::to_string(pworld.getDbgLineCount())
+            + "\nCells:        " + std::to_string(worldPartition->getResidentCellCount())
+                + "/" + std::to_string(worldPartition->getCellCount())
+                + " (" + std::to_string(worldPartition->getLoadingCellCount()) + " loading)"
+            + "\nCells mem:    " + std::to_string(worldPartition->getResidentBytes()/1024/1024)
+                + "/" + std::to_string(worldPartition->getMemoryBudget()/1024/1024) + "MiB"
+            + "\nModel cache:  " + getCacheInfo(modelCache)
+            + "\nTex cache:    " + getCacheInfo(textureCache)
+            + "\nTex queue:    " + std::to_string(textureStreamer.getQueueDepth())
+            + "\nTex upload:   " + std::to_string(textureStreamer.getBytesLastFrame()/1024) + "KiB/frame";
         overlayRenderer->renderTextAtPx(renderInfoText, 1.0f,
-                {windowW-DEF_FONT_SIZE*15, windowH-DEF_FONT_SIZE*2});
+                {windowW-DEF_FONT_SIZE*18, windowH-DEF_FONT_SIZE*2});
 
         overlayRenderer->commit();
+        profiler.endZone(overlayZone);
 
-        SDL_GL_SwapWindow(window);
+        {
+            Profiler::Zone zone{&profiler, "Swap"};
+            SDL_GL_SwapWindow(window);
+            // Nothing waits for the hidden window, count the GPU work in the frame
+            if (isBenchmark)
+                glFinish();
+        }
+        profiler.endFrame();
+
+        if (isBenchmark)
+        {
+            Benchmark::Recorder::FrameRecord record;
+            record.durNs = profiler.getLastFrameDurNs()-frameStreamWaitNs;
+            record.drawCalls = drawCalls;
+            record.drawnObjects = drawnObjects;
+            record.drawnVertices = drawnVertices;
+            record.physSteps = benchPhysSteps;
+            record.physUpdateUs = pworld.getLastUpdateDurUs();
+            record.physMovedCount = pworld.getLastMovedCount();
+            benchRecorder.addFrame(record);
+            benchStreamWaitNs += frameStreamWaitNs;
+            if (++benchFrameI == benchOptions.frameCount)
+                shouldQuit = true;
+        }
+    }
+
+    int exitCode = 0;
+    if (isBenchmark)
+    {
+        benchInfo.streamWaitNs = benchStreamWaitNs;
+        benchInfo.wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                PhysicsWorld::clock_t::now()-benchStartTime).count();
+        if (benchRecorder.getFrameCount() != benchOptions.frameCount)
+        {
+            Logger::err << "The benchmark was interrupted after " << benchRecorder.getFrameCount() << " frames" << Logger::End;
+            exitCode = 1;
+        }
+        else if (benchRecorder.writeJson(benchOptions.outputPath, benchInfo))
+        {
+            exitCode = 1;
+        }
     }
 
 
     SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
-    Logger::verb << "Cleaned up" << Logger::End;
-    return 0;
+    Trace::close();
+    LOGGER_VERB << "Cleaned up" << Logger::End;
+    return exitCode;
 }
 
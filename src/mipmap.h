@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Mipmap
+{
+
+// Returns the number of levels in a full mip chain, down to 1x1
+inline size_t getLevelCount(int widthPx, int heightPx)
+{
+    size_t count{1};
+    for (; widthPx > 1 || heightPx > 1; widthPx = std::max(1, widthPx/2), heightPx = std::max(1, heightPx/2))
+        ++count;
+    return count;
+}
+
+/*
+ * Builds the next mip level of an RGBA8 image with a 2x2 box filter.
+ * `dst` must have room for `max(1, srcW/2)` x `max(1, srcH/2)` pixels.
+ */
+inline void downsampleRgba8(const unsigned char* src, int srcW, int srcH, unsigned char* dst)
+{
+    const int dstW = std::max(1, srcW/2);
+    const int dstH = std::max(1, srcH/2);
+    for (int y{}; y < dstH; ++y)
+    {
+        const int y0 = std::min(y*2, srcH-1);
+        const int y1 = std::min(y*2+1, srcH-1);
+        for (int x{}; x < dstW; ++x)
+        {
+            const int x0 = std::min(x*2, srcW-1);
+            const int x1 = std::min(x*2+1, srcW-1);
+            for (int c{}; c < 4; ++c)
+            {
+                const int sum = src[((size_t)y0*srcW+x0)*4+c]
+                              + src[((size_t)y0*srcW+x1)*4+c]
+                              + src[((size_t)y1*srcW+x0)*4+c]
+                              + src[((size_t)y1*srcW+x1)*4+c];
+                dst[((size_t)y*dstW+x)*4+c] = (sum+2)/4;
+            }
+        }
+    }
+}
+
+} // namespace Mipmap
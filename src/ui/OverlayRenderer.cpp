@@ -11,6 +11,9 @@
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <bit>
+#include <cstring>
+#include <cstddef>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
@@ -28,7 +31,11 @@ OverlayRenderer::OverlayRenderer()
     m_modelPreviewShader = std::make_unique<ShaderProgram>();
 }
 
-static void setUpFont(std::map<char, OverlayRenderer::Character>* characters, uint* fontVAO, uint* fontVBO)
+/*
+ * Renders the ASCII glyphs and packs them into a single texture, row by row.
+ * Returns the ID of the atlas texture.
+ */
+static uint setUpFont(std::array<OverlayRenderer::Character, FONT_GLYPH_COUNT>* characters)
 {
     FT_Library ft;
     if (FT_Init_FreeType(&ft))
@@ -43,7 +50,7 @@ static void setUpFont(std::map<char, OverlayRenderer::Character>* characters, ui
         Logger::err << "Failed to get font file path" << Logger::End;
         abort();
     }
-    Logger::verb << "Loading font: " << fontFilePath << Logger::End;
+    LOGGER_VERB << "Loading font: " << fontFilePath << Logger::End;
     FT_Face face;
     if (FT_New_Face(ft, fontFilePath.c_str(), 0, &face))
     {
@@ -56,9 +63,20 @@ static void setUpFont(std::map<char, OverlayRenderer::Character>* characters, ui
         abort();
     }
 
-    Logger::verb << "Caching glyphs" << Logger::End;
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    for (int c{}; c < 128; ++c)
+    LOGGER_VERB << "Caching glyphs" << Logger::End;
+    struct GlyphBitmap
+    {
+        glm::ivec2 atlasPos;
+        std::vector<unsigned char> pixels;
+    };
+    std::vector<GlyphBitmap> bitmaps(FONT_GLYPH_COUNT);
+
+    // Place the glyphs in rows, padded so linear filtering doesn't bleed between them
+    static constexpr int padding = 1;
+    int penX = padding;
+    int penY = padding;
+    int rowHeight{};
+    for (int c{}; c < FONT_GLYPH_COUNT; ++c)
     {
         // Activate the current character
         if (FT_Load_Char(face, (char)c, FT_LOAD_RENDER))
@@ -67,80 +85,108 @@ static void setUpFont(std::map<char, OverlayRenderer::Character>* characters, ui
             abort();
         }
 
-        // Move the texture to the VRAM
-        uint textureId;
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        glTexImage2D(
-                GL_TEXTURE_2D, 0, GL_RED,
-                face->glyph->bitmap.width, face->glyph->bitmap.rows,
-                0, GL_RED, GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Store the character
-        characters->insert({(char)c, {
-                    textureId, // Texture
-                    {face->glyph->bitmap.width, face->glyph->bitmap.rows}, // Size
+        const FT_Bitmap& bitmap = face->glyph->bitmap;
+        const glm::ivec2 size{bitmap.width, bitmap.rows};
+        if (penX+size.x+padding > FONT_ATLAS_WIDTH)
+        {
+            penX = padding;
+            penY += rowHeight+padding;
+            rowHeight = 0;
+        }
+
+        bitmaps[c].atlasPos = {penX, penY};
+        bitmaps[c].pixels.resize((size_t)size.x*size.y);
+        for (int y{}; y < size.y; ++y)
+            memcpy(bitmaps[c].pixels.data()+(size_t)y*size.x, bitmap.buffer+(ptrdiff_t)y*bitmap.pitch, size.x);
+
+        // Store the character, the UVs are set when the atlas size is known
+        (*characters)[c] = {
+                    {}, {}, // UVs
+                    size, // Size
                     {face->glyph->bitmap_left, face->glyph->bitmap_top}, // Bearing
                     (uint)face->glyph->advance.x // Advance
-        }});
+        };
+
+        penX += size.x+padding;
+        rowHeight = std::max(rowHeight, size.y);
     }
     FT_Done_Face(face);
     FT_Done_FreeType(ft);
 
-    glGenVertexArrays(1, fontVAO);
-    glBindVertexArray(*fontVAO);
-    glGenBuffers(1, fontVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, *fontVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(0);
+    const int atlasHeight = std::bit_ceil((uint)(penY+rowHeight+padding));
+    std::vector<unsigned char> atlas((size_t)FONT_ATLAS_WIDTH*atlasHeight);
+    for (int c{}; c < FONT_GLYPH_COUNT; ++c)
+    {
+        OverlayRenderer::Character& ch = (*characters)[c];
+        const glm::ivec2 pos = bitmaps[c].atlasPos;
+        for (int y{}; y < ch.size.y; ++y)
+            memcpy(atlas.data()+(size_t)(pos.y+y)*FONT_ATLAS_WIDTH+pos.x, bitmaps[c].pixels.data()+(size_t)y*ch.size.x, ch.size.x);
+
+        ch.uvMin = {(float)pos.x/FONT_ATLAS_WIDTH, (float)pos.y/atlasHeight};
+        ch.uvMax = {(float)(pos.x+ch.size.x)/FONT_ATLAS_WIDTH, (float)(pos.y+ch.size.y)/atlasHeight};
+    }
+
+    // Move the atlas to the VRAM
+    uint textureId;
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, FONT_ATLAS_WIDTH, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    LOGGER_VERB << "Created glyph atlas (" << FONT_ATLAS_WIDTH << 'x' << atlasHeight << ')' << Logger::End;
+    return textureId;
+}
+
+// Creates a VAO with a streaming VBO for vertices of the given type
+template <typename Vertex>
+static void createStreamingVertexArray(uint* vaoOut, uint* vboOut)
+{
+    glGenVertexArrays(1, vaoOut);
+    glBindVertexArray(*vaoOut);
+    glGenBuffers(1, vboOut);
+    glBindBuffer(GL_ARRAY_BUFFER, *vboOut);
+    Vertex::setUpAttributes();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
 bool OverlayRenderer::construct(const std::string& crosshairModelPath)
 {
-    Logger::verb << "Opening font shaders" << Logger::End;
+    LOGGER_VERB << "Opening font shaders" << Logger::End;
     if (m_fontShader->open("../shaders/font.vert.glsl", "../shaders/font.frag.glsl"))
     {
         return 1;
     }
-    setUpFont(&m_characters, &m_fontVAO, &m_fontVBO);
+    m_fontProjMatUniform = m_fontShader->getUniform<glm::mat4>("projectionMat");
+    m_fontAtlasTexture = setUpFont(&m_characters);
+    createStreamingVertexArray<TextVertex>(&m_fontVAO, &m_fontVBO);
 
 
     //if (m_crosshairModel->open(crosshairModelPath))
     //{
     //    return 1;
     //}
-    //Logger::verb << "Opened crosshair model" << Logger::End;
+    //LOGGER_VERB << "Opened crosshair model" << Logger::End;
 
 
-    Logger::verb << "Opening UI shaders" << Logger::End;
+    LOGGER_VERB << "Opening UI shaders" << Logger::End;
     if (m_uiShader->open("../shaders/ui.vert.glsl", "../shaders/ui.frag.glsl"))
     {
         return 1;
     }
     m_uiShader->use();
-    const auto matrix = glm::ortho(0.0f, 100.0f, 0.0f, 100.0f);
-    glUniformMatrix4fv(glGetUniformLocation(m_uiShader->getId(), "projectionMat"), 1, GL_FALSE, glm::value_ptr(matrix));
-
-    // Create VAO and VBO for the UI rectangle
-    glGenVertexArrays(1, &m_uiVAO);
-    glBindVertexArray(m_uiVAO);
-    glGenBuffers(1, &m_uiVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_uiVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 2, nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    m_uiShader->setUniform(m_uiShader->getUniform<glm::mat4>("projectionMat"), glm::ortho(0.0f, 100.0f, 0.0f, 100.0f));
+
+    createStreamingVertexArray<RectVertex>(&m_uiVAO, &m_uiVBO);
 
 
-    Logger::verb << "Opening model preview shaders" << Logger::End;
+    LOGGER_VERB << "Opening model preview shaders" << Logger::End;
     if (m_modelPreviewShader->open("../shaders/build_menu.vert.glsl", "../shaders/build_menu.frag.glsl"))
     {
         return 1;
@@ -193,109 +239,166 @@ void OverlayRenderer::drawFilledRectangle(const glm::vec2& position, const glm::
     m_drawCommands.push_back(std::move(command));
 }
 
-void OverlayRenderer::commit()
+void OverlayRenderer::TextVertex::setUpAttributes()
 {
-    for (auto it = m_drawCommands.rbegin(); it != m_drawCommands.rend(); ++it)
-    {
-        const auto& c = *it;
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, pos));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, color));
+    glEnableVertexAttribArray(1);
+}
 
-        switch (c->type)
+void OverlayRenderer::RectVertex::setUpAttributes()
+{
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(RectVertex), (void*)offsetof(RectVertex, pos));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(RectVertex), (void*)offsetof(RectVertex, color));
+    glEnableVertexAttribArray(1);
+}
+
+void OverlayRenderer::appendRect(const RectDrawCommand& cmd)
+{
+    const glm::vec2 p0 = cmd.position;
+    const glm::vec2 p1 = cmd.position+cmd.size;
+    m_rectVerts.insert(m_rectVerts.end(), {
+        {{p0.x, p0.y}, cmd.color},
+        {{p0.x, p1.y}, cmd.color},
+        {{p1.x, p1.y}, cmd.color},
+        {{p1.x, p1.y}, cmd.color},
+        {{p1.x, p0.y}, cmd.color},
+        {{p0.x, p0.y}, cmd.color},
+    });
+}
+
+void OverlayRenderer::appendText(const TextDrawCommand& cmd)
+{
+    float textX = cmd.textPos.x;
+    float textY = cmd.textPos.y;
+
+    for (char c : cmd.text)
+    {
+        switch (c)
         {
-        case DrawCommand::Type::Rect:
+        case '\n':
+            textX = cmd.textPos.x;
+            textY -= (float)DEF_FONT_SIZE;
+            break;
+
+        case '\t':
+            textX += (float)DEF_FONT_SIZE*4;
+            break;
+
+        default: // Printable char
         {
-            const auto cmd = dynamic_cast<RectDrawCommand*>(c.get());
-            m_uiShader->use();
+            if ((unsigned char)c >= FONT_GLYPH_COUNT)
+                break;
+            const Character& ch = m_characters[(unsigned char)c];
+
+            const float x0 = textX + ch.bearing.x * cmd.scale;
+            const float y0 = textY - (ch.size.y - ch.bearing.y) * cmd.scale;
+            const float x1 = x0 + ch.size.x * cmd.scale;
+            const float y1 = y0 + ch.size.y * cmd.scale;
+
+            // The atlas rows are top-down
+            m_textVerts.insert(m_textVerts.end(), {
+                {{x0, y1, ch.uvMin.x, ch.uvMin.y}, cmd.textColor},
+                {{x0, y0, ch.uvMin.x, ch.uvMax.y}, cmd.textColor},
+                {{x1, y0, ch.uvMax.x, ch.uvMax.y}, cmd.textColor},
+
+                {{x0, y1, ch.uvMin.x, ch.uvMin.y}, cmd.textColor},
+                {{x1, y0, ch.uvMax.x, ch.uvMax.y}, cmd.textColor},
+                {{x1, y1, ch.uvMax.x, ch.uvMin.y}, cmd.textColor},
+            });
+            ++m_glyphsLastCommit;
+
+            textX += (ch.advance/64.f) * cmd.scale;
+            break;
+        }
+        }
+    }
+}
 
-            glUniform3f(glGetUniformLocation(m_uiShader->getId(), "uiColor"), cmd->color.r, cmd->color.g, cmd->color.b);
+// Uploads the vertices into the streaming buffer, orphaning the previous storage, and draws them
+template <typename Vertex>
+static void drawStreamed(uint vao, uint vbo, size_t* bufferCap, std::vector<Vertex>* verts)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (verts->size() > *bufferCap)
+        *bufferCap = std::bit_ceil(verts->size());
+    glBufferData(GL_ARRAY_BUFFER, *bufferCap*sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, verts->size()*sizeof(Vertex), verts->data());
+    glDrawArrays(GL_TRIANGLES, 0, verts->size());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    verts->clear();
+}
 
-            const float vertices[6][2] = {
-                {cmd->position.x,               cmd->position.y},
-                {cmd->position.x,               cmd->position.y + cmd->size.y},
-                {cmd->position.x + cmd->size.x, cmd->position.y + cmd->size.y},
-                {cmd->position.x + cmd->size.x, cmd->position.y + cmd->size.y},
-                {cmd->position.x + cmd->size.x, cmd->position.y},
-                {cmd->position.x,               cmd->position.y},
-            };
+void OverlayRenderer::flushBatch(DrawCommand::Type type)
+{
+    switch (type)
+    {
+    case DrawCommand::Type::Rect:
+        if (m_rectVerts.empty())
+            return;
+        m_uiShader->use();
+        drawStreamed(m_uiVAO, m_uiVBO, &m_uiVBOCap, &m_rectVerts);
+        break;
+
+    case DrawCommand::Type::Text:
+        if (m_textVerts.empty())
+            return;
+        m_fontShader->use();
+        // The matrix size will be = to the window size, so we can use pixels as size
+        m_fontShader->setUniform(m_fontProjMatUniform, glm::ortho(0.0f, (float)m_windowWidth, 0.0f, (float)m_windowHeight));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, m_fontAtlasTexture);
+        drawStreamed(m_fontVAO, m_fontVBO, &m_fontVBOCap, &m_textVerts);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        break;
+    }
+    ++m_drawCallsLastCommit;
+}
 
-            glBindVertexArray(m_uiVAO);
-            glBindBuffer(GL_ARRAY_BUFFER, m_uiVBO);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
+void OverlayRenderer::commit()
+{
+    m_drawCallsLastCommit = 0;
+    m_glyphsLastCommit = 0;
 
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Consecutive commands of the same type are drawn with one call,
+    // a new batch is only started when the type changes, to keep the order
+    DrawCommand::Type batchType{};
+    for (auto it = m_drawCommands.rbegin(); it != m_drawCommands.rend(); ++it)
+    {
+        const auto& c = *it;
+        if (it != m_drawCommands.rbegin() && c->type != batchType)
+            flushBatch(batchType);
+        batchType = c->type;
 
-            glBindVertexArray(0);
+        switch (c->type)
+        {
+        case DrawCommand::Type::Rect:
+            appendRect(*static_cast<RectDrawCommand*>(c.get()));
             break;
-        }
 
         case DrawCommand::Type::Text:
-        {
-            const auto cmd = dynamic_cast<TextDrawCommand*>(c.get());
-            float textX = cmd->textPos.x;
-            float textY = cmd->textPos.y;
-
-            m_fontShader->use();
-            glUniform3f(glGetUniformLocation(m_fontShader->getId(), "textColor"), cmd->textColor.r, cmd->textColor.g, cmd->textColor.b);
-            // The matrix size will be = to the window size, so we can use pixels as size
-            const auto matrix = glm::ortho(0.0f, (float)m_windowWidth, 0.0f, (float)m_windowHeight);
-            glUniformMatrix4fv(glGetUniformLocation(m_fontShader->getId(), "projectionMat"), 1, false, glm::value_ptr(matrix));
-            glActiveTexture(GL_TEXTURE0);
-            glBindVertexArray(m_fontVAO);
-
-            for (auto it = cmd->text.begin(); it != cmd->text.end(); ++it)
-            {
-                switch (*it)
-                {
-                case '\n':
-                    textX = cmd->textPos.x;
-                    textY -= (float)DEF_FONT_SIZE;
-                    break;
-
-                case '\t':
-                    textX += (float)DEF_FONT_SIZE*4;
-                    break;
- 
-                default: // Printable char
-                    const Character& ch = m_characters[*it];
-
-                    const float charXPos = textX + ch.bearing.x * cmd->scale;
-                    const float charYPos = textY - (ch.size.y - ch.bearing.y) * cmd->scale;
-                    const float charWidth = ch.size.x * cmd->scale;
-                    const float charHeight = ch.size.y * cmd->scale;
-
-                    const float vertices[6][4] = {
-                        {charXPos,             charYPos + charHeight, 0.0f, 0.0f},
-                        {charXPos,             charYPos,              0.0f, 1.0f},
-                        {charXPos + charWidth, charYPos,              1.0f, 1.0f},
-
-                        {charXPos,             charYPos + charHeight, 0.0f, 0.0f},
-                        {charXPos + charWidth, charYPos,              1.0f, 1.0f},
-                        {charXPos + charWidth, charYPos + charHeight, 1.0f, 0.0f},
-                    };
-
-                    glBindTexture(GL_TEXTURE_2D, ch.textureId);
-
-                    glBindBuffer(GL_ARRAY_BUFFER, m_fontVBO);
-                    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-                    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-                    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-                    textX += (ch.advance/64.f) * cmd->scale;
-
-                    break;
-                }
-            }
-
-            glBindVertexArray(0);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            appendText(*static_cast<TextDrawCommand*>(c.get()));
             break;
         }
-        }
     }
+    if (!m_drawCommands.empty())
+        flushBatch(batchType);
 
     m_drawCommands.clear();
 }
 
+OverlayRenderer::~OverlayRenderer()
+{
+    glDeleteTextures(1, &m_fontAtlasTexture);
+    glDeleteVertexArrays(1, &m_fontVAO);
+    glDeleteBuffers(1, &m_fontVBO);
+    glDeleteVertexArrays(1, &m_uiVAO);
+    glDeleteBuffers(1, &m_uiVBO);
+}
+
 } // namespace UI
 
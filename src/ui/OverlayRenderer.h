@@ -10,6 +10,9 @@
 #include <vector>
 
 #define DEF_FONT_SIZE 16
+// The glyphs of the ASCII characters are packed into one texture of this width
+#define FONT_GLYPH_COUNT 128
+#define FONT_ATLAS_WIDTH 256
 
 class Model;
 
@@ -21,7 +24,9 @@ class OverlayRenderer final
 public:
     struct Character
     {
-        uint textureId;
+        // The rectangle of the glyph in the atlas
+        glm::vec2 uvMin;
+        glm::vec2 uvMax;
         glm::ivec2 size;
         glm::ivec2 bearing;
         uint advance;
@@ -32,16 +37,41 @@ private:
     int m_windowHeight{};
     float m_windowRatio{1.0f};
 
+    struct TextVertex
+    {
+        glm::vec4 pos; // Position, texture coords
+        glm::vec3 color;
+
+        static void setUpAttributes();
+    };
+
+    struct RectVertex
+    {
+        glm::vec2 pos;
+        glm::vec3 color;
+
+        static void setUpAttributes();
+    };
+
     std::unique_ptr<ShaderProgram> m_fontShader;
-    std::map<char, Character> m_characters;
+    ShaderProgram::UniformHandle<glm::mat4> m_fontProjMatUniform;
+    std::array<Character, FONT_GLYPH_COUNT> m_characters{};
+    uint m_fontAtlasTexture{};
     uint m_fontVBO{};
+    size_t m_fontVBOCap{}; // In vertices
     uint m_fontVAO{};
+    std::vector<TextVertex> m_textVerts;
 
     //std::unique_ptr<Model> m_crosshairModel;
 
     std::unique_ptr<ShaderProgram> m_uiShader;
     uint m_uiVBO{};
+    size_t m_uiVBOCap{}; // In vertices
     uint m_uiVAO{};
+    std::vector<RectVertex> m_rectVerts;
+
+    size_t m_drawCallsLastCommit{};
+    size_t m_glyphsLastCommit{};
 
     std::unique_ptr<ShaderProgram> m_modelPreviewShader;
 
@@ -81,9 +111,21 @@ private:
 
     std::vector<std::unique_ptr<DrawCommand>> m_drawCommands;
 
+    void appendRect(const RectDrawCommand& cmd);
+    void appendText(const TextDrawCommand& cmd);
+    // Draws the collected vertices of the type with a single draw call
+    void flushBatch(DrawCommand::Type type);
+
 public:
     OverlayRenderer();
 
+    // Copy ctor, copy assignment op
+    OverlayRenderer(const OverlayRenderer&) = delete;
+    OverlayRenderer& operator=(const OverlayRenderer&) = delete;
+    // Move ctor, move assignment op
+    OverlayRenderer(OverlayRenderer&&) = delete;
+    OverlayRenderer& operator=(OverlayRenderer&&) = delete;
+
     void setWindowSize(int width, int height) { m_windowRatio = (float)width/height; m_windowWidth = width; m_windowHeight = height; }
 
     inline int getWindowWidth() const { return m_windowWidth; }
@@ -120,7 +162,16 @@ public:
 
     void drawCrosshair();
 
+    /*
+     * Draws the queued rectangles and texts, in as few draw calls as the
+     * order allows, and clears the queue.
+     */
     void commit();
+
+    inline size_t getDrawCallsLastCommit() const { return m_drawCallsLastCommit; }
+    inline size_t getGlyphsLastCommit() const { return m_glyphsLastCommit; }
+
+    ~OverlayRenderer();
 };
 
 } // namespace UI
@@ -0,0 +1,89 @@
+/*
+ * Converts JSON maps to the binary map format (see `BinaryMap`), and writes
+ * them next to the sources as `.emap` files. `GameMap` loads them instead of
+ * the JSON files while they are up to date.
+ *
+ * Usage: mapconv [--force] [map files...]
+ *      Without files, every JSON map in the map folder is converted.
+ *      Unless `--force` is given, maps with an up to date `.emap` are skipped.
+ */
+
+#include "../src/GameMap.h"
+#include "../src/BinaryMap.h"
+#include "../src/Logger.h"
+#include "../src/assets.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <chrono>
+
+static int convertMap(const std::string& source)
+{
+    try
+    {
+        const GameMap map{source, nullptr, false};
+        const std::string bakedPath = BinaryMap::getBakedPath(source);
+        if (map.writeBinary(bakedPath))
+            return 1;
+        Logger::log << "Converted " << source << " -> " << bakedPath
+            << " (" << map.getObjects().size() << " objects)" << Logger::End;
+        return 0;
+    }
+    catch (const std::runtime_error& e)
+    {
+        Logger::err << "Failed to convert " << source << ": " << e.what() << Logger::End;
+        return 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool isForced = false;
+    std::vector<std::string> sources;
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--force")
+            isForced = true;
+        else
+            sources.emplace_back(arg);
+    }
+
+    if (sources.empty())
+    {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator{ASSET_DIR_MAPS, ec})
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".json")
+                sources.push_back(entry.path().string());
+        }
+        if (ec)
+        {
+            Logger::err << "Failed to list the map folder: " << ec.message() << Logger::End;
+            return 1;
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    int failedCount{};
+    int skippedCount{};
+    for (const auto& source : sources)
+    {
+        std::error_code ec;
+        const std::string bakedPath = BinaryMap::getBakedPath(source);
+        if (!isForced && std::filesystem::exists(bakedPath, ec)
+         && std::filesystem::last_write_time(bakedPath, ec) >= std::filesystem::last_write_time(source, ec)
+         && !ec)
+        {
+            LOGGER_VERB << "Up to date: " << bakedPath << Logger::End;
+            ++skippedCount;
+            continue;
+        }
+        failedCount += convertMap(source);
+    }
+
+    const double durationSec = std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+    Logger::log << "Converted " << sources.size()-skippedCount-failedCount << " maps in " << durationSec
+        << "s (" << skippedCount << " up to date, " << failedCount << " failed)" << Logger::End;
+    return failedCount ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Compresses the textures to BC1 (opaque images) or BC3 (images with alpha)
+ * with a full mip chain, and writes them next to the sources as `<source>.dds` files.
+ * `Texture::load()` picks them up instead of the sources while they are up to date.
+ *
+ * Usage: texbake [--bc1|--bc3] [--force] [image files...]
+ *      Without files, every PNG, JPG, TGA and BMP in the texture folder is baked.
+ *      Unless `--force` is given, images with an up to date `.dds` are skipped.
+ */
+
+#include "../src/dds.h"
+#include "../src/mipmap.h"
+#include "../src/Logger.h"
+#include "../src/assets.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_FAILURE_USERMSG
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "../submodules/stb/stb_image.h"
+#pragma GCC diagnostic pop
+
+#define STB_DXT_IMPLEMENTATION
+#include "../submodules/stb/stb_dxt.h"
+
+static bool isSourceImage(const std::filesystem::path& path)
+{
+    const std::string ext = path.extension().string();
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+}
+
+static bool hasAlpha(const unsigned char* pixels, size_t pixelCount)
+{
+    for (size_t i{}; i < pixelCount; ++i)
+    {
+        if (pixels[i*4+3] != 255)
+            return true;
+    }
+    return false;
+}
+
+// Compresses an RGBA8 image block by block, repeating the edge pixels to fill the partial blocks
+static std::vector<unsigned char> compressLevel(const unsigned char* pixels, int widthPx, int heightPx, DDS::Format format)
+{
+    const int blocksX = (widthPx+DDS::blockDimPx-1)/DDS::blockDimPx;
+    const int blocksY = (heightPx+DDS::blockDimPx-1)/DDS::blockDimPx;
+    const size_t blockSize = DDS::getBlockSize(format);
+    std::vector<unsigned char> output((size_t)blocksX*blocksY*blockSize);
+
+    unsigned char block[DDS::blockDimPx*DDS::blockDimPx*4];
+    for (int by{}; by < blocksY; ++by)
+    {
+        for (int bx{}; bx < blocksX; ++bx)
+        {
+            for (int y{}; y < DDS::blockDimPx; ++y)
+            {
+                const int srcY = std::min(by*DDS::blockDimPx+y, heightPx-1);
+                for (int x{}; x < DDS::blockDimPx; ++x)
+                {
+                    const int srcX = std::min(bx*DDS::blockDimPx+x, widthPx-1);
+                    memcpy(block+(y*DDS::blockDimPx+x)*4, pixels+((size_t)srcY*widthPx+srcX)*4, 4);
+                }
+            }
+            stb_compress_dxt_block(output.data()+((size_t)by*blocksX+bx)*blockSize, block,
+                    format == DDS::Format::BC3, STB_DXT_HIGHQUAL);
+        }
+    }
+    return output;
+}
+
+/*
+ * Returns:
+ *      1 if failed,
+ *      0 otherwise
+ */
+static int bakeImage(const std::string& sourcePath, std::optional<DDS::Format> forcedFormat)
+{
+    const std::string bakedPath = DDS::getBakedPath(sourcePath);
+
+    int widthPx, heightPx, channelCount;
+    // The engine expects the rows bottom-up
+    stbi_set_flip_vertically_on_load(1);
+    unsigned char* pixels = stbi_load(sourcePath.c_str(), &widthPx, &heightPx, &channelCount, 4);
+    if (!pixels)
+    {
+        Logger::err << "Failed to open image: " << sourcePath << ": " << stbi_failure_reason() << Logger::End;
+        return 1;
+    }
+
+    const DDS::Format format = forcedFormat.value_or(
+            hasAlpha(pixels, (size_t)widthPx*heightPx) ? DDS::Format::BC3 : DDS::Format::BC1);
+
+    std::vector<std::vector<unsigned char>> levels;
+    std::vector<unsigned char> levelPixels(pixels, pixels+(size_t)widthPx*heightPx*4);
+    stbi_image_free(pixels);
+    std::vector<unsigned char> nextLevelPixels;
+    size_t uncompressedSize{};
+    for (int w = widthPx, h = heightPx;; w = std::max(1, w/2), h = std::max(1, h/2))
+    {
+        levels.push_back(compressLevel(levelPixels.data(), w, h, format));
+        uncompressedSize += (size_t)w*h*4;
+        if (w == 1 && h == 1)
+            break;
+
+        nextLevelPixels.resize((size_t)std::max(1, w/2)*std::max(1, h/2)*4);
+        Mipmap::downsampleRgba8(levelPixels.data(), w, h, nextLevelPixels.data());
+        std::swap(levelPixels, nextLevelPixels);
+    }
+
+    if (DDS::write(bakedPath, format, widthPx, heightPx, levels))
+        return 1;
+
+    size_t compressedSize{};
+    for (const auto& level : levels)
+        compressedSize += level.size();
+    Logger::log << sourcePath << " -> " << bakedPath << " (" << widthPx << 'x' << heightPx
+        << ", " << DDS::formatToStr(format) << ", " << levels.size() << " levels, "
+        << uncompressedSize/1024 << " KiB -> " << compressedSize/1024 << " KiB)" << Logger::End;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::optional<DDS::Format> forcedFormat;
+    bool isForced = false;
+    std::vector<std::string> sources;
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--bc1")
+            forcedFormat = DDS::Format::BC1;
+        else if (arg == "--bc3")
+            forcedFormat = DDS::Format::BC3;
+        else if (arg == "--force")
+            isForced = true;
+        else
+            sources.emplace_back(arg);
+    }
+
+    if (sources.empty())
+    {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator{ASSET_DIR_TEXTURES, ec})
+        {
+            if (entry.is_regular_file() && isSourceImage(entry.path()))
+                sources.push_back(entry.path().string());
+        }
+        if (ec)
+        {
+            Logger::err << "Failed to list the texture folder: " << ec.message() << Logger::End;
+            return 1;
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    int failedCount{};
+    int skippedCount{};
+    for (const auto& source : sources)
+    {
+        std::error_code ec;
+        const std::string bakedPath = DDS::getBakedPath(source);
+        if (!isForced && std::filesystem::exists(bakedPath, ec)
+         && std::filesystem::last_write_time(bakedPath, ec) >= std::filesystem::last_write_time(source, ec)
+         && !ec)
+        {
+            LOGGER_VERB << "Up to date: " << bakedPath << Logger::End;
+            ++skippedCount;
+            continue;
+        }
+        failedCount += bakeImage(source, forcedFormat);
+    }
+
+    const double durationSec = std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+    Logger::log << "Baked " << sources.size()-skippedCount-failedCount << " textures in " << durationSec
+        << "s (" << skippedCount << " up to date, " << failedCount << " failed)" << Logger::End;
+    return failedCount ? 1 : 0;
+}
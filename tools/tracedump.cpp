@@ -0,0 +1,199 @@
+/*
+ * Decodes a binary trace file written by `LOGGER_TRACE` (see `Trace.h`)
+ * and prints the records as text, sorted by their timestamps.
+ * The threads write their records in batches, so the file is not in order.
+ *
+ * Usage: tracedump <trace file>
+ *      Each line is the timestamp in milliseconds, the source file and the formatted record.
+ */
+
+#include "../src/Trace.h"
+#include "../src/Logger.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+struct CallSiteInfo
+{
+    std::string argTypes;
+    std::string file;
+    std::string format;
+};
+
+// Reads a zero terminated string, returns false if there is none
+static bool readCString(const char** src, const char* end, std::string* output)
+{
+    const char* terminator = (const char*)std::memchr(*src, '\0', end-*src);
+    if (!terminator)
+        return false;
+    output->assign(*src, terminator);
+    *src = terminator+1;
+    return true;
+}
+
+/*
+ * Formats the arguments of a record into the `{}` placeholders of the format.
+ *
+ * Returns:
+ *      true if failed,
+ *      false otherwise
+ */
+static bool formatRecord(const CallSiteInfo& site, const char* src, const char* end, std::string* output)
+{
+    std::vector<std::string> args;
+    for (char type : site.argTypes)
+    {
+        std::ostringstream arg;
+        if ((Trace::ArgType)type == Trace::ArgType::String)
+        {
+            uint32_t size;
+            if (end-src < (ptrdiff_t)sizeof(size))
+                return 1;
+            std::memcpy(&size, src, sizeof(size));
+            src += sizeof(size);
+            if (end-src < (ptrdiff_t)size)
+                return 1;
+            arg << std::string_view{src, size};
+            src += size;
+        }
+        else
+        {
+            if (end-src < (ptrdiff_t)sizeof(uint64_t))
+                return 1;
+            switch ((Trace::ArgType)type)
+            {
+            case Trace::ArgType::Int:   { int64_t value;  std::memcpy(&value, src, sizeof(value)); arg << value; break; }
+            case Trace::ArgType::UInt:  { uint64_t value; std::memcpy(&value, src, sizeof(value)); arg << value; break; }
+            case Trace::ArgType::Float: { double value;   std::memcpy(&value, src, sizeof(value)); arg << value; break; }
+            default: return 1;
+            }
+            src += sizeof(uint64_t);
+        }
+        args.push_back(arg.str());
+    }
+
+    size_t argI{};
+    for (size_t i{}; i < site.format.size(); ++i)
+    {
+        if (site.format.compare(i, 2, "{}") == 0 && argI < args.size())
+        {
+            *output += args[argI++];
+            ++i;
+        }
+        else
+        {
+            *output += site.format[i];
+        }
+    }
+    // The arguments without a placeholder
+    for (; argI < args.size(); ++argI)
+        *output += " "+args[argI];
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        Logger::err << "Usage: " << argv[0] << " <trace file>" << Logger::End;
+        return 1;
+    }
+
+    std::ifstream file{argv[1], std::ios::binary};
+    if (!file.is_open())
+    {
+        Logger::err << "Failed to open trace file: " << argv[1] << ": " << strerror(errno) << Logger::End;
+        return 1;
+    }
+    const std::string content{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+    Trace::FileHeader header;
+    if (content.size() < sizeof(header))
+    {
+        Logger::err << "Not a trace file" << Logger::End;
+        return 1;
+    }
+    std::memcpy(&header, content.data(), sizeof(header));
+    if (std::memcmp(header.magic, Trace::fileMagic, sizeof(Trace::fileMagic)) != 0
+     || header.version != Trace::fileVersion)
+    {
+        Logger::err << "Not a trace file or unsupported version" << Logger::End;
+        return 1;
+    }
+
+    std::unordered_map<uint32_t, CallSiteInfo> callSites;
+    //                    Timestamp  Line
+    std::vector<std::pair<uint64_t, std::string>> records;
+    std::string output;
+    const char* src = content.data()+sizeof(header);
+    const char* const end = content.data()+content.size();
+    while (end-src >= (ptrdiff_t)sizeof(Trace::EntryHeader))
+    {
+        Trace::EntryHeader entry;
+        std::memcpy(&entry, src, sizeof(entry));
+        src += sizeof(entry);
+        if (end-src < (ptrdiff_t)entry.size)
+        {
+            Logger::warn << "The trace file is truncated" << Logger::End;
+            break;
+        }
+        const char* const entryEnd = src+entry.size;
+
+        if (entry.id == Trace::callSiteEntryId)
+        {
+            uint32_t id;
+            CallSiteInfo site;
+            if (entry.size < sizeof(id))
+            {
+                Logger::err << "Invalid call site entry" << Logger::End;
+                return 1;
+            }
+            std::memcpy(&id, src, sizeof(id));
+            const char* field = src+sizeof(id);
+            if (!readCString(&field, entryEnd, &site.argTypes)
+             || !readCString(&field, entryEnd, &site.file)
+             || !readCString(&field, entryEnd, &site.format))
+            {
+                Logger::err << "Invalid call site entry" << Logger::End;
+                return 1;
+            }
+            callSites[id] = std::move(site);
+        }
+        else
+        {
+            auto siteIt = callSites.find(entry.id);
+            uint64_t timestamp;
+            output.clear();
+            if (siteIt == callSites.end() || entry.size < sizeof(timestamp))
+            {
+                Logger::err << "Record of an unknown call site: " << entry.id << Logger::End;
+                return 1;
+            }
+            std::memcpy(&timestamp, src, sizeof(timestamp));
+            if (formatRecord(siteIt->second, src+sizeof(timestamp), entryEnd, &output))
+            {
+                Logger::err << "Invalid record of call site " << entry.id << Logger::End;
+                return 1;
+            }
+            records.emplace_back(timestamp, siteIt->second.file+": "+output);
+        }
+        src = entryEnd;
+    }
+
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b){
+            return a.first < b.first; });
+    for (const auto& [timestamp, line] : records)
+    {
+        char prefix[32];
+        snprintf(prefix, sizeof(prefix), "%12.3f ", timestamp/1e6);
+        std::cout << prefix << line << '\n';
+    }
+
+    Logger::log << "Decoded " << records.size() << " records from " << callSites.size() << " call sites" << Logger::End;
+    return 0;
+}